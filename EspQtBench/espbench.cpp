@@ -0,0 +1,115 @@
+#include "espbench.h"
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QSysInfo>
+
+#include <atomic>
+#include <stdlib.h>
+
+static std::atomic<quint64> gAllocations(0);
+static volatile qint64 gSink = 0;
+
+#if defined(__GLIBC__)
+// Qt containers allocate with malloc, so the count is taken there rather
+// than in operator new (which ends up in malloc as well)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+EspBench::EspBench(qint64 minTimeMs) : mMinTimeMs(minTimeMs) {
+}
+
+bool EspBench::run(const QString &name, qint64 bytesPerOp, const EspBenchFunction &op) {
+    if(!mFilter.isEmpty() && !name.contains(mFilter)) return false;
+
+    // Warm up caches and the buffers reused by the code under test
+    op();
+
+    QElapsedTimer timer;
+    qint64 iterations = 1;
+    qint64 elapsedNs = 0;
+    quint64 allocs = 0;
+    while(true) {
+        quint64 allocsBefore = allocations();
+        timer.start();
+        for(qint64 i=0;i<iterations;i++) op();
+        elapsedNs = timer.nsecsElapsed();
+        allocs = allocations() - allocsBefore;
+
+        if(elapsedNs >= mMinTimeMs * 1000000) break;
+        // Aim straight at the minimum time once the estimate is meaningful
+        qint64 next = elapsedNs > 1000000 ? iterations * mMinTimeMs * 1100000 / elapsedNs : iterations * 10;
+        iterations = qMax(iterations + 1, next);
+    }
+
+    EspBenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.bytesPerOp = bytesPerOp;
+    result.nsPerOp = (double)elapsedNs / iterations;
+    result.allocsPerOp = (double)allocs / iterations;
+    mResults.append(result);
+    return true;
+}
+
+void EspBench::print(QTextStream &out) const {
+    out << qSetFieldWidth(28) << left << "benchmark" << qSetFieldWidth(14) << right << "ns/op" << "MB/s" << "allocs/op" << qSetFieldWidth(0) << endl;
+    foreach(const EspBenchResult &result, mResults) {
+        out << qSetFieldWidth(28) << left << result.name << qSetFieldWidth(14) << right
+            << QString::number(result.nsPerOp, 'f', 1)
+            << (result.bytesPerOp ? QString::number(result.bytesPerSecond() / 1e6, 'f', 1) : QString("-"))
+            << QString::number(result.allocsPerOp, 'f', 2) << qSetFieldWidth(0) << endl;
+    }
+}
+
+QByteArray EspBench::toJson() const {
+    QJsonArray results;
+    foreach(const EspBenchResult &result, mResults) {
+        QJsonObject item;
+        item.insert("name", result.name);
+        item.insert("iterations", (double)result.iterations);
+        item.insert("bytes_per_op", (double)result.bytesPerOp);
+        item.insert("ns_per_op", result.nsPerOp);
+        item.insert("bytes_per_second", result.bytesPerSecond());
+        item.insert("allocs_per_op", result.allocsPerOp);
+        results.append(item);
+    }
+
+    QJsonObject root;
+    root.insert("date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    root.insert("host", QSysInfo::machineHostName());
+    root.insert("cpu", QSysInfo::currentCpuArchitecture());
+    root.insert("qt", QString(qVersion()));
+    root.insert("results", results);
+    return QJsonDocument(root).toJson();
+}
+
+quint64 EspBench::allocations() {
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+void EspBench::sink(qint64 value) {
+    gSink = gSink + value;
+}
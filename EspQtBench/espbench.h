@@ -0,0 +1,44 @@
+#ifndef ESPBENCH_H
+#define ESPBENCH_H
+
+#include <QString>
+#include <QList>
+#include <QByteArray>
+#include <QTextStream>
+
+#include <functional>
+
+class EspBenchResult {
+public:
+    EspBenchResult() : iterations(0), bytesPerOp(0), nsPerOp(0), allocsPerOp(0) { }
+    double bytesPerSecond() const { return nsPerOp > 0 ? bytesPerOp * 1e9 / nsPerOp : 0.0; }
+public:
+    QString name;
+    qint64 iterations;
+    qint64 bytesPerOp;
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+typedef std::function<void()> EspBenchFunction;
+
+// Minimal benchmark runner: repeats an operation until the run lasts long
+// enough, then records time, throughput and heap allocations per operation
+class EspBench {
+public:
+    EspBench(qint64 minTimeMs=500);
+    void setFilter(const QString &filter) { mFilter = filter; }
+    bool run(const QString &name, qint64 bytesPerOp, const EspBenchFunction &op);
+    const QList<EspBenchResult> &results() const { return mResults; }
+    void print(QTextStream &out) const;
+    QByteArray toJson() const;
+public:
+    static quint64 allocations();
+    static void sink(qint64 value);
+private:
+    qint64 mMinTimeMs;
+    QString mFilter;
+    QList<EspBenchResult> mResults;
+};
+
+#endif // ESPBENCH_H
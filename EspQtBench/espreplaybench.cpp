@@ -0,0 +1,119 @@
+#include "espreplaybench.h"
+#include "espbench.h"
+#include "esprom.h"
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QSysInfo>
+
+#include <ctime>
+#include <algorithm>
+
+EspReplayBench::EspReplayBench(double timeScale) : mTimeScale(timeScale) {
+}
+
+bool EspReplayBench::load(const QString &traceFile) {
+    mTraceFile = traceFile;
+    if(!mScript.load(traceFile)) {
+        mErrorString = mScript.errorString();
+        return false;
+    }
+    if(!mScript.errorString().isEmpty()) qWarning("%s, replaying what was read", mScript.errorString().toLatin1().constData());
+    return true;
+}
+
+void EspReplayBench::run(const EspReplayScenario &scenario, int repeat) {
+    for(int i=0;i<repeat;i++) {
+        EspReplayRun run;
+        QElapsedTimer timer;
+        quint64 allocsBefore = EspBench::allocations();
+        std::clock_t cpuBefore = std::clock();
+        timer.start();
+        {
+            EspReplayDevice device(mScript, mTimeScale);
+            EspRom rom(&device, mScript.baudRate);
+            run.ok = rom.syncEsp() && scenario(rom);
+            run.complete = device.isComplete();
+            run.divergence = device.divergenceOffset();
+        }
+        run.wallUs = timer.nsecsElapsed() / 1000;
+        run.cpuUs = (qint64)(std::clock() - cpuBefore) * 1000000 / CLOCKS_PER_SEC;
+        run.allocations = EspBench::allocations() - allocsBefore;
+        mRuns.append(run);
+    }
+}
+
+bool EspReplayBench::passed() const {
+    if(mRuns.isEmpty()) return false;
+    foreach(const EspReplayRun &run, mRuns) {
+        if(!run.ok || !run.complete || run.divergence >= 0) return false;
+    }
+    return true;
+}
+
+qint64 EspReplayBench::median(QList<qint64> values) {
+    if(values.isEmpty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+
+void EspReplayBench::print(QTextStream &out) const {
+    out << QString("Replay of %1 (%2), %3 bytes sent, %4 replies, recorded in %5 ms\n").arg(mTraceFile).arg(mScript.label).arg(mScript.sent.size()).arg(mScript.replies.size()).arg(mScript.durationUs / 1000);
+    out << qSetFieldWidth(6) << right << "run" << qSetFieldWidth(14) << "wall ms" << "cpu ms" << "allocs" << qSetFieldWidth(0) << "  result" << endl;
+
+    QList<qint64> wall, cpu, allocs;
+    for(int i=0;i<mRuns.size();i++) {
+        const EspReplayRun &run = mRuns.at(i);
+        QString result = run.ok ? QString("ok") : QString("failed");
+        if(run.divergence >= 0) result += QString(", diverged at byte %1").arg(run.divergence);
+        else if(!run.complete) result += QString(", stopped before the end of the recording");
+        out << qSetFieldWidth(6) << right << i << qSetFieldWidth(14)
+            << QString::number(run.wallUs / 1000.0, 'f', 2)
+            << QString::number(run.cpuUs / 1000.0, 'f', 2)
+            << run.allocations << qSetFieldWidth(0) << "  " << result << endl;
+        wall << run.wallUs;
+        cpu << run.cpuUs;
+        allocs << run.allocations;
+    }
+    out << qSetFieldWidth(6) << right << "median" << qSetFieldWidth(14)
+        << QString::number(median(wall) / 1000.0, 'f', 2)
+        << QString::number(median(cpu) / 1000.0, 'f', 2)
+        << median(allocs) << qSetFieldWidth(0) << endl;
+}
+
+QByteArray EspReplayBench::toJson() const {
+    QJsonArray runs;
+    QList<qint64> wall, cpu, allocs;
+    foreach(const EspReplayRun &run, mRuns) {
+        QJsonObject item;
+        item.insert("ok", run.ok);
+        item.insert("complete", run.complete);
+        item.insert("divergence", (double)run.divergence);
+        item.insert("wall_us", (double)run.wallUs);
+        item.insert("cpu_us", (double)run.cpuUs);
+        item.insert("allocations", (double)run.allocations);
+        runs.append(item);
+        wall << run.wallUs;
+        cpu << run.cpuUs;
+        allocs << run.allocations;
+    }
+
+    QJsonObject root;
+    root.insert("date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    root.insert("host", QSysInfo::machineHostName());
+    root.insert("cpu", QSysInfo::currentCpuArchitecture());
+    root.insert("qt", QString(qVersion()));
+    root.insert("trace", mTraceFile);
+    root.insert("label", mScript.label);
+    root.insert("time_scale", mTimeScale);
+    root.insert("recorded_us", (double)mScript.durationUs);
+    root.insert("passed", passed());
+    root.insert("median_wall_us", (double)median(wall));
+    root.insert("median_cpu_us", (double)median(cpu));
+    root.insert("median_allocations", (double)median(allocs));
+    root.insert("runs", runs);
+    return QJsonDocument(root).toJson();
+}
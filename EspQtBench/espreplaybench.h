@@ -0,0 +1,51 @@
+#ifndef ESPREPLAYBENCH_H
+#define ESPREPLAYBENCH_H
+
+#include <QString>
+#include <QList>
+#include <QByteArray>
+#include <QTextStream>
+
+#include <functional>
+
+#include "espreplay.h"
+
+class EspRom;
+
+class EspReplayRun {
+public:
+    EspReplayRun() : ok(false), complete(false), divergence(-1), wallUs(0), cpuUs(0), allocations(0) { }
+public:
+    bool ok;
+    bool complete;
+    qint64 divergence;
+    qint64 wallUs;
+    qint64 cpuUs;
+    quint64 allocations;
+};
+
+typedef std::function<bool(EspRom &)> EspReplayScenario;
+
+// Runs a flashing scenario against a recorded session again and again. Each
+// run gets a fresh EspRom talking to an EspReplayDevice and is measured end
+// to end: wall time, host CPU time and heap allocations.
+class EspReplayBench {
+public:
+    EspReplayBench(double timeScale=0.0);
+    bool load(const QString &traceFile);
+    QString errorString() const { return mErrorString; }
+    void run(const EspReplayScenario &scenario, int repeat);
+    bool passed() const;
+    void print(QTextStream &out) const;
+    QByteArray toJson() const;
+private:
+    static qint64 median(QList<qint64> values);
+private:
+    double mTimeScale;
+    QString mTraceFile;
+    EspReplayScript mScript;
+    QList<EspReplayRun> mRuns;
+    QString mErrorString;
+};
+
+#endif // ESPREPLAYBENCH_H
@@ -0,0 +1,288 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QBuffer>
+#include <QFile>
+#include <QTemporaryFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "espbench.h"
+#include "esprom.h"
+#include "espslip.h"
+#include "espstub.h"
+#include "espchecksum.h"
+#include "espflashplan.h"
+#include "esptelemetry.h"
+#include "espreplaybench.h"
+
+// RAM upload block, the largest packet built by EspRom
+#define BENCH_RAM_BLOCK     0x1800
+// Cesanta stub read block, the bulk of the frames received
+#define BENCH_READ_FRAME    0x400
+#define BENCH_READ_FRAMES   64
+
+static QByteArray randomData(int size) {
+    QByteArray data(size, '\0');
+    for(int i=0;i<size;i++) data[i] = (char)(qrand() & 0xFF);
+    return data;
+}
+
+static QByteArray escapedData(int size) {
+    // Worst case for SLIP, every byte needs an escape
+    QByteArray data(size, '\0');
+    for(int i=0;i<size;i++) data[i] = (char)(i & 1 ? SLIP_END : SLIP_ESC);
+    return data;
+}
+
+static void benchSlip(EspBench &bench) {
+    QByteArray block = randomData(BENCH_RAM_BLOCK);
+    QByteArray escaped = escapedData(BENCH_RAM_BLOCK);
+    EspSlipEncoder encoder;
+
+    bench.run("slip_encode", block.size(), [&]() {
+        EspBench::sink(encoder.encode(block));
+    });
+    bench.run("slip_encode_escaped", escaped.size(), [&]() {
+        EspBench::sink(encoder.encode(escaped));
+    });
+
+    // A burst of read frames as the stub sends them, decoded from a device
+    QByteArray stream;
+    for(int i=0;i<BENCH_READ_FRAMES;i++) {
+        encoder.encode(randomData(BENCH_READ_FRAME));
+        stream.append(encoder.data(), encoder.size());
+    }
+    QBuffer device(&stream);
+    device.open(QIODevice::ReadOnly);
+    EspSlipDecoder decoder;
+
+    bench.run("slip_decode", stream.size(), [&]() {
+        device.seek(0);
+        decoder.readFrom(&device);
+        while(decoder.hasPacket()) EspBench::sink(decoder.takePacket().size());
+    });
+}
+
+static void benchCommand(EspBench &bench) {
+    QByteArray block = randomData(BENCH_RAM_BLOCK);
+    QByteArray packet;
+
+    bench.run("command_build", block.size(), [&]() {
+        EspRom::buildCommand(packet, 0x07, block, 0xef);
+        EspBench::sink(packet.size());
+    });
+    bench.run("checksum", block.size(), [&]() {
+        EspBench::sink(EspRom::checksum(block));
+    });
+    bench.run("checksum_scalar", block.size(), [&]() {
+        EspBench::sink(EspChecksum::computeScalar(block.constData(), block.size()));
+    });
+}
+
+static bool checkChecksum() {
+    // The lane kernel against the byte loop, over odd lengths, offsets and split points
+    QByteArray data = randomData(BENCH_RAM_BLOCK + 64);
+    for(int i=0;i<20000;i++) {
+        int offset = qrand() % 64;
+        int len = qrand() % BENCH_RAM_BLOCK;
+        int split = len ? qrand() % len : 0;
+        quint8 seed = qrand() & 0xFF;
+        const char *ptr = data.constData() + offset;
+
+        quint8 expected = EspChecksum::computeScalar(ptr, len, seed);
+        EspChecksum incremental(seed);
+        incremental.update(ptr, split);
+        incremental.update(ptr + split, len - split);
+        if(EspChecksum::compute(ptr, len, seed) != expected || incremental.state() != expected) {
+            qWarning("Checksum mismatch offset:%d len:%d split:%d seed:%d", offset, len, split, seed);
+            return false;
+        }
+    }
+    return true;
+}
+
+static QByteArray stubJson(const EspStub &stub) {
+    QJsonObject object;
+    object.insert("code", QString(stub.code.toHex()));
+    object.insert("code_start", (double)stub.codeStart);
+    object.insert("data", QString(stub.data.toHex()));
+    object.insert("data_start", (double)stub.dataStart);
+    object.insert("params_start", (double)stub.paramsStart);
+    object.insert("entry", (double)stub.entry);
+    object.insert("num_params", stub.numParams);
+    return QJsonDocument(object).toJson();
+}
+
+static void benchStub(EspBench &bench) {
+    EspStub builtin = EspStub::builtin();
+    qint64 size = builtin.code.size() + builtin.data.size();
+
+    bench.run("stub_builtin", size, [&]() {
+        EspBench::sink(EspStub::builtin().code.size());
+    });
+
+    // A runtime supplied stub: parsed from scratch and through the cache
+    QByteArray json = stubJson(builtin);
+    QTemporaryFile file;
+    file.open();
+    file.write(json);
+    file.flush();
+
+    bench.run("stub_parse", json.size(), [&]() {
+        EspBench::sink(EspStub::fromJson(json).code.size());
+    });
+    bench.run("stub_cached", json.size(), [&]() {
+        EspBench::sink(EspStub::cached(file.fileName()).code.size());
+    });
+}
+
+static void benchDigest(EspBench &bench, int imageSize) {
+    QByteArray image = randomData(imageSize);
+
+    bench.run("md5_image", image.size(), [&]() {
+        EspBench::sink(QCryptographicHash::hash(image, QCryptographicHash::Md5).size());
+    });
+    bench.run("md5_sectors", image.size(), [&]() {
+        EspBench::sink(EspFlashPlan::blockDigests(image, ESP_FLASH_SECTOR).size());
+    });
+}
+
+static void benchTelemetry(EspBench &bench) {
+    // The updates of one stub write chunk, the price of leaving telemetry on
+    EspTelemetry telemetry;
+    qint64 rtt = 0;
+    bench.run("telemetry_chunk", 0x400, [&]() {
+        telemetry.addRaw(0x400);
+        telemetry.addPayload(0x400);
+        telemetry.addAckRtt(rtt++ & 0xFFFF);
+    });
+    bench.run("telemetry_snapshot", 0, [&]() {
+        EspBench::sink(telemetry.snapshot().payloadBytes);
+    });
+}
+
+static quint32 parseNumber(const QString &text, bool *ok) {
+    return text.startsWith("0x") ? text.mid(2).toUInt(ok, 16) : text.toUInt(ok, 10);
+}
+
+static bool buildScenario(const QCommandLineParser &parser, EspReplayScenario &scenario) {
+    // The host side must do what it did when the trace was recorded
+    if(parser.isSet("replay-write")) {
+        QString arg = parser.value("replay-write");
+        int sep = arg.indexOf(':');
+        bool ok = false;
+        quint32 address = parseNumber(arg.left(sep), &ok);
+        QFile file(arg.mid(sep + 1));
+        if(sep < 0 || !ok || !file.open(QIODevice::ReadOnly)) {
+            qWarning("Bad --replay-write %s, expected address:file", arg.toLatin1().constData());
+            return false;
+        }
+        QByteArray image = file.readAll();
+        EspRom::WriteOptions options = EspRom::WriteDefault;
+        if(parser.isSet("diff")) options |= EspRom::WriteDifferential;
+        if(parser.isSet("verify")) options |= EspRom::WriteVerify;
+        if(parser.isSet("skip-blank")) options |= EspRom::WriteSkipBlank;
+        bool reboot = parser.isSet("reboot");
+        scenario = [=](EspRom &rom) {
+            rom.setWriteOptions(options);
+            return rom.flashWrite(address, image, reboot);
+        };
+    } else if(parser.isSet("replay-read")) {
+        QString arg = parser.value("replay-read");
+        int sep = arg.indexOf(':');
+        bool okAddress = false, okSize = false;
+        quint32 address = parseNumber(arg.left(sep), &okAddress);
+        quint32 size = parseNumber(arg.mid(sep + 1), &okSize);
+        if(sep < 0 || !okAddress || !okSize) {
+            qWarning("Bad --replay-read %s, expected address:size", arg.toLatin1().constData());
+            return false;
+        }
+        scenario = [=](EspRom &rom) {
+            return rom.flashRead(address, (int)size).size() == (int)size;
+        };
+    } else {
+        // Connection only
+        scenario = [](EspRom &) { return true; };
+    }
+    return true;
+}
+
+static int runReplay(const QCommandLineParser &parser) {
+    EspReplayScenario scenario;
+    if(!buildScenario(parser, scenario)) return 1;
+
+    EspReplayBench replay(parser.value("replay-speed").toDouble());
+    if(!replay.load(parser.value("replay"))) {
+        qWarning("%s", replay.errorString().toLatin1().constData());
+        return 1;
+    }
+    replay.run(scenario, qMax(1, parser.value("repeat").toInt()));
+
+    QTextStream out(stdout);
+    replay.print(out);
+
+    if(parser.isSet("json")) {
+        QFile file(parser.value("json"));
+        if(!file.open(QIODevice::WriteOnly)) {
+            qWarning("Unable to write %s", file.fileName().toLatin1().constData());
+            return 1;
+        }
+        file.write(replay.toJson());
+    }
+    return replay.passed() ? 0 : 2;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("EspQtBench");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("EspQtBench - Microbenchmarks of the EspQtLib host side hot paths");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(QCommandLineOption(QStringList() << "t" << "min-time", QCoreApplication::translate("main", "Minimum run time of each benchmark"), "ms", QString::number(500)));
+    parser.addOption(QCommandLineOption(QStringList() << "f" << "filter", QCoreApplication::translate("main", "Run only benchmarks whose name contains this text"), "text"));
+    parser.addOption(QCommandLineOption(QStringList() << "j" << "json", QCoreApplication::translate("main", "Write the results as JSON to this file"), "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "s" << "image-size", QCoreApplication::translate("main", "Image size for the digest benchmarks"), "bytes", QString::number(0x100000)));
+    parser.addOption(QCommandLineOption(QStringList() << "r" << "replay", QCoreApplication::translate("main", "Replay this recorded session instead of running the microbenchmarks"), "trace"));
+    parser.addOption(QCommandLineOption(QStringList() << "replay-write", QCoreApplication::translate("main", "Replayed scenario: write the file at the address"), "address:file"));
+    parser.addOption(QCommandLineOption(QStringList() << "replay-read", QCoreApplication::translate("main", "Replayed scenario: read size bytes at the address"), "address:size"));
+    parser.addOption(QCommandLineOption(QStringList() << "replay-speed", QCoreApplication::translate("main", "Scale of the recorded delays, 1 is real time, 0 no wait"), "factor", QString::number(0)));
+    parser.addOption(QCommandLineOption(QStringList() << "n" << "repeat", QCoreApplication::translate("main", "Number of replays"), "count", QString::number(5)));
+    parser.addOption(QCommandLineOption(QStringList() << "diff", QCoreApplication::translate("main", "Replayed write was differential")));
+    parser.addOption(QCommandLineOption(QStringList() << "verify", QCoreApplication::translate("main", "Replayed write was verified")));
+    parser.addOption(QCommandLineOption(QStringList() << "skip-blank", QCoreApplication::translate("main", "Replayed write skipped blank sectors")));
+    parser.addOption(QCommandLineOption(QStringList() << "reboot", QCoreApplication::translate("main", "Replayed write rebooted the chip")));
+    parser.process(app);
+
+    if(parser.isSet("replay")) return runReplay(parser);
+
+    EspBench bench(parser.value("min-time").toLongLong());
+    bench.setFilter(parser.value("filter"));
+    qsrand(1);
+
+    if(!checkChecksum()) return 1;
+
+    benchSlip(bench);
+    benchCommand(bench);
+    benchStub(bench);
+    benchDigest(bench, parser.value("image-size").toInt());
+    benchTelemetry(bench);
+
+    QTextStream out(stdout);
+    bench.print(out);
+
+    if(parser.isSet("json")) {
+        QFile file(parser.value("json"));
+        if(!file.open(QIODevice::WriteOnly)) {
+            qWarning("Unable to write %s", file.fileName().toLatin1().constData());
+            return 1;
+        }
+        file.write(bench.toJson());
+    }
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = EspQtEmulator
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    espemulator.cpp \
+    espflashmodel.cpp
+
+HEADERS += \
+    espemulator.h \
+    espflashmodel.h
+
+# The emulator speaks SLIP with the library codec
+unix: LIBS += -L$$OUT_PWD/../EspQtLib/ -lEspQtLib
+
+INCLUDEPATH += $$PWD/../EspQtLib
+DEPENDPATH += $$PWD/../EspQtLib
+
+unix: PRE_TARGETDEPS += $$OUT_PWD/../EspQtLib/libEspQtLib.a
@@ -0,0 +1,460 @@
+#include "espemulator.h"
+
+#include <QTimer>
+#include <QFile>
+#include <QtEndian>
+#include <QDebug>
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "espchecksum.h"
+#include "espprotocol.h"
+
+// ROM error codes
+#define ROM_ERR_INVALID_CMD 0x05
+#define ROM_ERR_FLASH       0x06
+#define ROM_ERR_CHECKSUM    0x07
+
+// Cesanta stub status codes
+#define STUB_ERR_ARGS       0x01
+#define STUB_ERR_WRITE      0x03
+#define STUB_ERR_UNKNOWN    0x07
+
+// SPI controller registers used to read the flash id
+#define SPI_CMD         0x60000200
+#define SPI_W0          0x60000240
+#define SPI_CMD_RDID    0x10000000
+
+// OTP words holding the MAC address
+#define OTP_MAC0        0x3ff00050
+#define OTP_MAC1        0x3ff00054
+#define OTP_MAC3        0x3ff0005c
+
+// Replies the ROM sends to a single sync
+#define EMU_SYNC_REPLIES    8
+// Programming unit of the Cesanta stub, an ack follows each one
+#define EMU_WRITE_CHUNK     0x400
+// Time the stub takes to boot and greet
+#define EMU_STUB_BOOT_MS    10
+// Bytes still in flight after a failed write are dropped for this long
+#define EMU_DISCARD_MS      100
+// Pump period and the largest burst the link credit may build up
+#define EMU_PUMP_MS         1
+#define EMU_MAX_BURST_MS    5
+
+EspEmulator::EspEmulator(EspFlashModel *flash, QObject *parent) : QObject(parent), mFlash(flash), mMaster(-1), mSlave(-1), mTimer(0), mLastPump(0), mBusyUntil(0), mDiscardUntil(0),
+    mInCredit(0), mOutCredit(0), mLinkRate(0), mRomLinkRate(0), mReceived(0), mMode(RomMode), mFlashId(0), mFlashOffset(0), mFlashBlockSize(0), mStubParam(0), mStubParamSeen(false),
+    mStubState(StubIdle), mStubCommand(0), mXferAddress(0), mXferSize(0), mXferDone(0), mXferAcked(0), mReadBlock(0), mReadInFlight(0),
+    mXferDigest(QCryptographicHash::Md5) {
+    setIdentity(0x5a000000, 0x0000e2d3, 0, 0x001640ef);
+    mTimer = new QTimer(this);
+    mTimer->setTimerType(Qt::PreciseTimer);
+    connect(mTimer, SIGNAL(timeout()), this, SLOT(onPump()));
+}
+
+EspEmulator::~EspEmulator() {
+    if(!mLinkPath.isEmpty()) QFile::remove(mLinkPath);
+    if(mSlave >= 0) ::close(mSlave);
+    if(mMaster >= 0) ::close(mMaster);
+}
+
+bool EspEmulator::open(const QString &linkPath) {
+    mMaster = posix_openpt(O_RDWR | O_NOCTTY);
+    if(mMaster < 0 || grantpt(mMaster) != 0 || unlockpt(mMaster) != 0) {
+        qWarning("EspEmulator::open unable to create a pseudo terminal");
+        return false;
+    }
+    fcntl(mMaster, F_SETFL, fcntl(mMaster, F_GETFL) | O_NONBLOCK);
+    mPortName = QString::fromLatin1(ptsname(mMaster));
+
+    // Holding the slave open keeps the master usable between client sessions
+    mSlave = ::open(mPortName.toLatin1().constData(), O_RDWR | O_NOCTTY);
+    if(mSlave >= 0) {
+        struct termios tio;
+        tcgetattr(mSlave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(mSlave, TCSANOW, &tio);
+    }
+
+    if(!linkPath.isEmpty()) {
+        QFile::remove(linkPath);
+        if(QFile::link(mPortName, linkPath)) mLinkPath = linkPath;
+        else qWarning("EspEmulator::open unable to create link %s", linkPath.toLatin1().constData());
+    }
+
+    mClock.start();
+    mTimer->start(EMU_PUMP_MS);
+    return true;
+}
+
+void EspEmulator::setIdentity(quint32 mac0, quint32 mac1, quint32 mac3, quint32 flashId) {
+    mRegs[OTP_MAC0] = mac0;
+    mRegs[OTP_MAC1] = mac1;
+    mRegs[OTP_MAC3] = mac3;
+    mFlashId = flashId;
+}
+
+void EspEmulator::onPump() {
+    qint64 now = mClock.elapsed();
+    double dt = (now - mLastPump) / 1000.0;
+    mLastPump = now;
+
+    // While the flash is busy the chip neither reads nor answers
+    if(now < mBusyUntil) return;
+
+    if(mLinkRate > 0) {
+        // A start bit, eight data bits and a stop bit per byte
+        double rate = mLinkRate / 10.0;
+        double burst = qMax(64.0, rate * EMU_MAX_BURST_MS / 1000.0);
+        mInCredit = qMin(burst, mInCredit + rate * dt);
+        mOutCredit = qMin(burst, mOutCredit + rate * dt);
+    } else {
+        mInCredit = mOutCredit = 0x10000;
+    }
+
+    pumpOutput((qint64)mOutCredit);
+    pumpInput((qint64)mInCredit);
+}
+
+void EspEmulator::pumpInput(qint64 budget) {
+    char buffer[0x1000];
+    while(budget > 0 && mClock.elapsed() >= mBusyUntil) {
+        ssize_t len = ::read(mMaster, buffer, qMin<qint64>(budget, sizeof(buffer)));
+        if(len <= 0) break;
+        budget -= len;
+        mInCredit -= len;
+        mReceived += len;
+
+        if(mFaults.stallAfter >= 0 && mReceived > mFaults.stallAfter) continue;
+        if(mClock.elapsed() < mDiscardUntil) continue;
+        processInput(buffer, len);
+    }
+}
+
+void EspEmulator::pumpOutput(qint64 budget) {
+    if(mOutput.isEmpty() || budget <= 0) return;
+    ssize_t len = ::write(mMaster, mOutput.constData(), qMin<qint64>(budget, mOutput.size()));
+    if(len > 0) {
+        mOutput.remove(0, len);
+        mOutCredit -= len;
+    }
+}
+
+void EspEmulator::processInput(const char *data, int len) {
+    while(len > 0) {
+        if(mMode == StubMode && mStubState == StubWriteData) {
+            // Flash data follows the write command unframed
+            int used = processWriteData(data, len);
+            data += used;
+            len -= used;
+            continue;
+        }
+
+        mDecoder.decode(data, len);
+        len = 0;
+        while(mDecoder.hasPacket()) processFrame(mDecoder.takePacket());
+    }
+}
+
+void EspEmulator::processFrame(const QByteArray &frame) {
+    const uchar *pkt = (const uchar *)frame.constData();
+    bool romFrame = frame.size() >= 8 && pkt[0] == 0x00 && qFromLittleEndian<quint16>(pkt + 2) == frame.size() - 8;
+
+    // A reset is invisible on a pty, a sync always finds the ROM listening
+    if(romFrame && pkt[1] == ESP_SYNC && mMode != RomMode) resetToRom();
+
+    if(mMode == RomMode) {
+        if(romFrame) processRomCommand(frame);
+    } else if(mMode == StubMode) {
+        if(mStubState == StubArgs) {
+            processStubCommand(mStubCommand, frame);
+        } else if(mStubState == StubReadData) {
+            processReadAck(frame);
+        } else if(frame.size() == 1) {
+            mStubCommand = pkt[0];
+            // Commands without arguments run at once
+            if(mStubCommand == CMD_BOOT_FW || mStubCommand == CMD_FLASH_READ_CHIP_ID || mStubCommand == CMD_FLASH_ERASE_CHIP) processStubCommand(mStubCommand, QByteArray());
+            else mStubState = StubArgs;
+        } else {
+            qDebug("EspEmulator::processFrame unexpected %d bytes frame in stub", frame.size());
+        }
+    }
+}
+
+void EspEmulator::processRomCommand(const QByteArray &frame) {
+    const uchar *pkt = (const uchar *)frame.constData();
+    quint8 op = pkt[1];
+    quint8 chk = pkt[4];
+    const uchar *args = pkt + 8;
+    int argsSize = frame.size() - 8;
+
+    if(argsSize < 4 && op != ESP_SYNC) {
+        replyStatus(op, ROM_ERR_INVALID_CMD);
+        return;
+    }
+
+    quint32 arg[4] = { 0, 0, 0, 0 };
+    for(int i=0; i<4 && (i + 1) * 4 <= argsSize; i++) arg[i] = qFromLittleEndian<quint32>(args + i * 4);
+
+    // Data commands carry a 16 bytes header, a block and its checksum
+    QByteArray block;
+    if(op == ESP_FLASH_DATA || op == ESP_MEM_DATA) {
+        block = frame.mid(8 + 16, arg[0]);
+        if(block.size() != (int)arg[0] || EspChecksum::compute(block.constData(), block.size()) != chk) {
+            qDebug("EspEmulator::processRomCommand op %02X bad block seq %d", op, arg[1]);
+            replyStatus(op, ROM_ERR_CHECKSUM);
+            return;
+        }
+    }
+
+    switch(op) {
+    case ESP_SYNC:
+        for(int i=0;i<EMU_SYNC_REPLIES;i++) replyStatus(op);
+        break;
+    case ESP_READ_REG:
+        replyStatus(op, 0, mRegs.value(arg[0]));
+        break;
+    case ESP_WRITE_REG:
+        mRegs[arg[0]] = (mRegs.value(arg[0]) & ~arg[2]) | (arg[1] & arg[2]);
+        if(arg[0] == SPI_CMD && (arg[1] & SPI_CMD_RDID)) {
+            mRegs[SPI_W0] = mFlashId;
+            mRegs[SPI_CMD] = 0;
+        }
+        replyStatus(op);
+        break;
+    case ESP_FLASH_BEGIN: {
+        // The ROM counts the head sectors of the first block twice, the
+        // erase size sent by the host is meant to compensate for that
+        quint32 sectors = (arg[0] + 0xFFF) / 0x1000;
+        quint32 head = qMin(16 - (arg[3] / 0x1000) % 16, sectors);
+        erase(arg[3], (sectors + head) * 0x1000);
+        mFlashOffset = arg[3];
+        mFlashBlockSize = arg[2];
+        replyStatus(op);
+        break;
+    }
+    case ESP_FLASH_DATA:
+        replyStatus(op, program(mFlashOffset + arg[1] * mFlashBlockSize, block.constData(), block.size()) ? 0 : ROM_ERR_FLASH);
+        break;
+    case ESP_FLASH_END:
+        replyStatus(op);
+        if(arg[0] == 0) setMode(FirmwareMode);
+        break;
+    case ESP_MEM_BEGIN:
+        replyStatus(op);
+        break;
+    case ESP_MEM_DATA:
+        // The first word loaded is the first stub parameter, the baud rate
+        if(!mStubParamSeen && block.size() >= 4) {
+            mStubParam = qFromLittleEndian<quint32>((const uchar *)block.constData());
+            mStubParamSeen = true;
+        }
+        replyStatus(op);
+        break;
+    case ESP_MEM_END:
+        replyStatus(op);
+        if(arg[0] == 0) {
+            setMode(StubMode);
+            if(mLinkRate > 0 && mStubParam > 0) mLinkRate = mStubParam;
+            mBusyUntil = mClock.elapsed() + EMU_STUB_BOOT_MS;
+            sendFrame(QByteArray(ESP_STUB_GREETING));
+        }
+        break;
+    default:
+        qDebug("EspEmulator::processRomCommand unsupported op %02X", op);
+        replyStatus(op, ROM_ERR_INVALID_CMD);
+        break;
+    }
+}
+
+void EspEmulator::processStubCommand(quint8 cmd, const QByteArray &args) {
+    const uchar *pkt = (const uchar *)args.constData();
+    quint32 arg[4] = { 0, 0, 0, 0 };
+    for(int i=0; i<4 && (i + 1) * 4 <= args.size(); i++) arg[i] = qFromLittleEndian<quint32>(pkt + i * 4);
+    mStubState = StubIdle;
+
+    switch(cmd) {
+    case CMD_FLASH_WRITE:
+        if(args.size() < 12 || arg[0] % 0x1000 || arg[1] % 0x1000 || !mFlash->contains(arg[0], arg[1])) {
+            sendFrame(QByteArray(1, STUB_ERR_ARGS));
+            break;
+        }
+        if(arg[2]) erase(arg[0], arg[1]);
+        mXferAddress = arg[0];
+        mXferSize = arg[1];
+        mXferDone = 0;
+        mWriteChunk.clear();
+        mXferDigest.reset();
+        mStubState = StubWriteData;
+        sendValue(0);
+        break;
+    case CMD_FLASH_READ:
+        if(args.size() < 16 || !mFlash->contains(arg[0], arg[1]) || arg[2] == 0) {
+            sendFrame(QByteArray(1, STUB_ERR_ARGS));
+            break;
+        }
+        mXferAddress = arg[0];
+        mXferSize = arg[1];
+        mReadBlock = arg[2];
+        mReadInFlight = qMax(arg[2], arg[3]);
+        mXferDone = mXferAcked = 0;
+        mXferDigest.reset();
+        mStubState = StubReadData;
+        sendReadBlocks();
+        break;
+    case CMD_FLASH_DIGEST:
+        if(args.size() < 12 || !mFlash->contains(arg[0], arg[1])) {
+            sendFrame(QByteArray(1, STUB_ERR_ARGS));
+            break;
+        }
+        for(quint32 offset=0; arg[2] > 0 && offset < arg[1]; offset += arg[2]) {
+            sendFrame(mFlash->digest(arg[0] + offset, qMin(arg[2], arg[1] - offset)));
+        }
+        sendFrame(mFlash->digest(arg[0], arg[1]));
+        sendFrame(QByteArray(1, '\0'));
+        break;
+    case CMD_FLASH_READ_CHIP_ID:
+        sendValue(mFlashId);
+        sendFrame(QByteArray(1, '\0'));
+        break;
+    case CMD_FLASH_ERASE_CHIP:
+        erase(0, mFlash->size());
+        sendFrame(QByteArray(1, '\0'));
+        break;
+    case CMD_BOOT_FW:
+        sendFrame(QByteArray(1, '\0'));
+        setMode(FirmwareMode);
+        break;
+    default:
+        qDebug("EspEmulator::processStubCommand unsupported command %d", cmd);
+        sendFrame(QByteArray(1, STUB_ERR_UNKNOWN));
+        break;
+    }
+}
+
+int EspEmulator::processWriteData(const char *data, int len) {
+    int used = qMin<quint32>(len, mXferSize - mXferDone - mWriteChunk.size());
+    mWriteChunk.append(data, used);
+
+    while(mWriteChunk.size() >= EMU_WRITE_CHUNK || (!mWriteChunk.isEmpty() && mXferDone + mWriteChunk.size() == mXferSize)) {
+        int chunk = qMin(mWriteChunk.size(), EMU_WRITE_CHUNK);
+        mXferDigest.addData(mWriteChunk.constData(), chunk);
+        if(!program(mXferAddress + mXferDone, mWriteChunk.constData(), chunk)) {
+            sendFrame(QByteArray(1, STUB_ERR_WRITE));
+            mWriteChunk.clear();
+            mStubState = StubIdle;
+            mDiscardUntil = mClock.elapsed() + EMU_DISCARD_MS;
+            return len;
+        }
+        mWriteChunk.remove(0, chunk);
+        mXferDone += chunk;
+        sendValue(mXferDone);
+    }
+
+    if(mXferDone == mXferSize) {
+        sendFrame(mXferDigest.result());
+        sendFrame(QByteArray(1, '\0'));
+        mStubState = StubIdle;
+    }
+    return used;
+}
+
+void EspEmulator::processReadAck(const QByteArray &frame) {
+    if(frame.size() != 4) {
+        qDebug("EspEmulator::processReadAck unexpected %d bytes frame", frame.size());
+        return;
+    }
+
+    mXferAcked = qFromLittleEndian<quint32>((const uchar *)frame.constData());
+    if(mXferAcked >= mXferSize) {
+        sendFrame(mXferDigest.result());
+        sendFrame(QByteArray(1, '\0'));
+        mStubState = StubIdle;
+    } else {
+        sendReadBlocks();
+    }
+}
+
+void EspEmulator::sendReadBlocks() {
+    while(mXferDone < mXferSize && mXferDone - mXferAcked < mReadInFlight) {
+        quint32 len = qMin(mReadBlock, mXferSize - mXferDone);
+        QByteArray block = mFlash->read(mXferAddress + mXferDone, len);
+        mXferDigest.addData(block);
+        sendFrame(block);
+        mXferDone += len;
+    }
+}
+
+void EspEmulator::reply(quint8 op, const QByteArray &body, quint32 val) {
+    QByteArray payload(8, '\0');
+    uchar *pkt = (uchar *)payload.data();
+    pkt[0] = 0x01;
+    pkt[1] = op;
+    qToLittleEndian((quint16)body.size(), pkt + 2);
+    qToLittleEndian(val, pkt + 4);
+    payload.append(body);
+    sendFrame(payload);
+}
+
+void EspEmulator::replyStatus(quint8 op, quint8 error, quint32 val) {
+    QByteArray body(2, '\0');
+    body[0] = error ? 1 : 0;
+    body[1] = error;
+    reply(op, body, val);
+}
+
+void EspEmulator::sendFrame(const QByteArray &payload) {
+    if(chance(mFaults.dropRate)) {
+        qDebug("EspEmulator::sendFrame dropping %d bytes frame", payload.size());
+        return;
+    }
+    mEncoder.encode(payload);
+    mOutput.append(mEncoder.data(), mEncoder.size());
+}
+
+void EspEmulator::sendValue(quint32 value) {
+    QByteArray data(4, '\0');
+    qToLittleEndian(value, (uchar *)data.data());
+    sendFrame(data);
+}
+
+bool EspEmulator::program(quint32 address, const char *data, int len) {
+    if(mFaults.failAddress >= address && mFaults.failAddress < (qint64)address + len) {
+        qDebug("EspEmulator::program injected failure at 0x%06x", address);
+        return false;
+    }
+    if(!mFlash->write(address, data, len)) return false;
+    if(len > 0 && chance(mFaults.corruptRate)) {
+        quint32 target = address + qrand() % len;
+        qDebug("EspEmulator::program injected bit flip at 0x%06x", target);
+        mFlash->flipBit(target, qrand() % 8);
+    }
+    return true;
+}
+
+void EspEmulator::erase(quint32 address, quint32 len) {
+    int ms = mFlash->erase(address, len);
+    mBusyUntil = mClock.elapsed() + ms;
+    qDebug("EspEmulator::erase 0x%06x size 0x%x busy %d ms", address, len, ms);
+}
+
+void EspEmulator::resetToRom() {
+    mStubState = StubIdle;
+    mStubParam = 0;
+    mStubParamSeen = false;
+    mLinkRate = mRomLinkRate;
+    setMode(RomMode);
+}
+
+void EspEmulator::setMode(Mode mode) {
+    static const char *names[] = { "rom", "stub", "firmware" };
+    if(mode != mMode) qDebug("EspEmulator::setMode %s", names[mode]);
+    mMode = mode;
+}
+
+bool EspEmulator::chance(double probability) const {
+    return probability > 0 && qrand() < probability * RAND_MAX;
+}
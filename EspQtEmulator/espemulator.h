@@ -0,0 +1,108 @@
+#ifndef ESPEMULATOR_H
+#define ESPEMULATOR_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
+#include "espslip.h"
+#include "espflashmodel.h"
+
+class QTimer;
+
+// Faults the emulator injects on purpose
+class EspEmulatorFaults {
+public:
+    EspEmulatorFaults() : dropRate(0), corruptRate(0), failAddress(-1), stallAfter(-1) { }
+public:
+    // Probability that an outgoing frame is lost on the wire
+    double dropRate;
+    // Probability that a programmed 1k chunk ends up with a flipped bit
+    double corruptRate;
+    // Flash writes covering this address fail, -1 to disable
+    qint64 failAddress;
+    // Stop answering after this many received bytes, -1 to disable
+    qint64 stallAfter;
+};
+
+// ESP8266 seen from the serial port: the ROM bootloader, the Cesanta flasher
+// stub and the esptool stub commands used by EspRom, served on a pty.
+class EspEmulator : public QObject {
+    Q_OBJECT
+public:
+    enum Mode { RomMode, StubMode, FirmwareMode };
+    EspEmulator(EspFlashModel *flash, QObject *parent=0);
+    ~EspEmulator();
+    bool open(const QString &linkPath=QString());
+    QString portName() const { return mPortName; }
+    void setLinkRate(int baud) { mRomLinkRate = mLinkRate = baud; }
+    void setFaults(const EspEmulatorFaults &faults) { mFaults = faults; }
+    void setIdentity(quint32 mac0, quint32 mac1, quint32 mac3, quint32 flashId);
+private slots:
+    void onPump();
+private:
+    enum StubState { StubIdle, StubArgs, StubWriteData, StubReadData };
+    void pumpInput(qint64 budget);
+    void pumpOutput(qint64 budget);
+    void processInput(const char *data, int len);
+    void processFrame(const QByteArray &frame);
+    void processRomCommand(const QByteArray &frame);
+    void processStubCommand(quint8 cmd, const QByteArray &args);
+    int processWriteData(const char *data, int len);
+    void processReadAck(const QByteArray &frame);
+    void sendReadBlocks();
+    void reply(quint8 op, const QByteArray &body, quint32 val=0);
+    void replyStatus(quint8 op, quint8 error=0, quint32 val=0);
+    void sendFrame(const QByteArray &payload);
+    void sendValue(quint32 value);
+    bool program(quint32 address, const char *data, int len);
+    void erase(quint32 address, quint32 len);
+    void resetToRom();
+    void setMode(Mode mode);
+    bool chance(double probability) const;
+private:
+    EspFlashModel *mFlash;
+    int mMaster;
+    int mSlave;
+    QString mPortName;
+    QString mLinkPath;
+    QTimer *mTimer;
+    QElapsedTimer mClock;
+    qint64 mLastPump;
+    qint64 mBusyUntil;
+    qint64 mDiscardUntil;
+    double mInCredit;
+    double mOutCredit;
+    int mLinkRate;
+    int mRomLinkRate;
+    EspEmulatorFaults mFaults;
+    qint64 mReceived;
+private:
+    EspSlipDecoder mDecoder;
+    EspSlipEncoder mEncoder;
+    QByteArray mOutput;
+    Mode mMode;
+    QHash<quint32, quint32> mRegs;
+    quint32 mFlashId;
+private:
+    // ROM download state
+    quint32 mFlashOffset;
+    quint32 mFlashBlockSize;
+    quint32 mStubParam;
+    bool mStubParamSeen;
+    // Cesanta stub state
+    StubState mStubState;
+    quint8 mStubCommand;
+    quint32 mXferAddress;
+    quint32 mXferSize;
+    quint32 mXferDone;
+    quint32 mXferAcked;
+    quint32 mReadBlock;
+    quint32 mReadInFlight;
+    QByteArray mWriteChunk;
+    QCryptographicHash mXferDigest;
+};
+
+#endif // ESPEMULATOR_H
@@ -0,0 +1,57 @@
+#include "espflashmodel.h"
+
+#include <QCryptographicHash>
+
+#include <string.h>
+
+#define FLASH_SECTOR    0x1000
+#define FLASH_BLOCK     0x10000
+
+EspFlashModel::EspFlashModel(quint32 size, int sectorEraseMs, int blockEraseMs) : mSectorEraseMs(sectorEraseMs), mBlockEraseMs(blockEraseMs), mErasedBytes(0), mWrittenBytes(0) {
+    mData.fill((char)0xFF, size);
+}
+
+int EspFlashModel::erase(quint32 address, quint32 len) {
+    // Whole sectors are erased, 64k aligned blocks with the faster block erase
+    quint32 start = address & ~(FLASH_SECTOR - 1);
+    quint32 end = qMin<quint32>(mData.size(), (address + len + FLASH_SECTOR - 1) & ~(FLASH_SECTOR - 1));
+    int ms = 0;
+
+    quint32 pos = start;
+    while(pos < end) {
+        quint32 step = (pos % FLASH_BLOCK == 0 && end - pos >= FLASH_BLOCK) ? FLASH_BLOCK : FLASH_SECTOR;
+        ms += step == FLASH_BLOCK ? mBlockEraseMs : mSectorEraseMs;
+        pos += step;
+    }
+
+    if(end > start) {
+        memset(mData.data() + start, 0xFF, end - start);
+        mErasedBytes += end - start;
+    }
+    return ms;
+}
+
+bool EspFlashModel::write(quint32 address, const char *data, int len) {
+    if(!contains(address, len)) return false;
+
+    char *dst = mData.data() + address;
+    for(int i=0;i<len;i++) dst[i] &= data[i];
+    mWrittenBytes += len;
+    return true;
+}
+
+QByteArray EspFlashModel::read(quint32 address, quint32 len) const {
+    if(!contains(address, len)) return QByteArray();
+    return mData.mid(address, len);
+}
+
+QByteArray EspFlashModel::digest(quint32 address, quint32 len) const {
+    if(!contains(address, len)) return QByteArray();
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    md5.addData(mData.constData() + address, len);
+    return md5.result();
+}
+
+void EspFlashModel::flipBit(quint32 address, int bit) {
+    if(address < (quint32)mData.size()) mData[address] = mData.at(address) ^ (char)(1 << bit);
+}
@@ -0,0 +1,28 @@
+#ifndef ESPFLASHMODEL_H
+#define ESPFLASHMODEL_H
+
+#include <QByteArray>
+
+// Simulated NOR flash: erase sets bits, programming can only clear them
+class EspFlashModel {
+public:
+    EspFlashModel(quint32 size=0x400000, int sectorEraseMs=40, int blockEraseMs=150);
+    quint32 size() const { return mData.size(); }
+    bool contains(quint32 address, quint32 len) const { return address <= (quint32)mData.size() && len <= mData.size() - address; }
+    int erase(quint32 address, quint32 len);
+    bool write(quint32 address, const char *data, int len);
+    bool write(quint32 address, const QByteArray &data) { return write(address, data.constData(), data.size()); }
+    QByteArray read(quint32 address, quint32 len) const;
+    QByteArray digest(quint32 address, quint32 len) const;
+    void flipBit(quint32 address, int bit);
+    quint64 erasedBytes() const { return mErasedBytes; }
+    quint64 writtenBytes() const { return mWrittenBytes; }
+private:
+    QByteArray mData;
+    int mSectorEraseMs;
+    int mBlockEraseMs;
+    quint64 mErasedBytes;
+    quint64 mWrittenBytes;
+};
+
+#endif // ESPFLASHMODEL_H
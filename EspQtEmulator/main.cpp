@@ -0,0 +1,75 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFile>
+
+#include <signal.h>
+
+#include "espemulator.h"
+#include "espflashmodel.h"
+
+static void onSignal(int) {
+    QCoreApplication::quit();
+}
+
+static quint32 parseNumber(const QString &text, bool *ok) {
+    return text.toUInt(ok, 0);
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("EspQtEmulator");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("EspQtEmulator - esp8266 ROM bootloader and flasher stub on a pseudo terminal");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(QCommandLineOption(QStringList() << "l" << "link", QCoreApplication::translate("main", "Symlink created to the emulated port"), "path"));
+    parser.addOption(QCommandLineOption(QStringList() << "b" << "baud", QCoreApplication::translate("main", "Emulated link rate, 0 for no throttling"), "rate", QString::number(115200)));
+    parser.addOption(QCommandLineOption(QStringList() << "s" << "flash-size", QCoreApplication::translate("main", "Flash size in bytes"), "size", "0x400000"));
+    parser.addOption(QCommandLineOption(QStringList() << "i" << "image", QCoreApplication::translate("main", "Initial flash content, loaded at address 0"), "file"));
+    parser.addOption(QCommandLineOption("sector-erase-ms", QCoreApplication::translate("main", "Time to erase a 4k sector"), "ms", QString::number(40)));
+    parser.addOption(QCommandLineOption("block-erase-ms", QCoreApplication::translate("main", "Time to erase a 64k block"), "ms", QString::number(150)));
+    parser.addOption(QCommandLineOption("drop", QCoreApplication::translate("main", "Probability that a reply frame is lost"), "p", "0"));
+    parser.addOption(QCommandLineOption("corrupt", QCoreApplication::translate("main", "Probability that a programmed 1k chunk gets a flipped bit"), "p", "0"));
+    parser.addOption(QCommandLineOption("fail-at", QCoreApplication::translate("main", "Flash writes covering this address fail"), "address"));
+    parser.addOption(QCommandLineOption("stall-after", QCoreApplication::translate("main", "Stop answering after this many received bytes"), "bytes"));
+    parser.addOption(QCommandLineOption("seed", QCoreApplication::translate("main", "Seed of the fault injection"), "n", "1"));
+    parser.process(app);
+
+    bool ok;
+    quint32 flashSize = parseNumber(parser.value("flash-size"), &ok);
+    if(!ok || flashSize == 0) parser.showHelp(1);
+
+    EspFlashModel flash(flashSize, parser.value("sector-erase-ms").toInt(), parser.value("block-erase-ms").toInt());
+    if(parser.isSet("image")) {
+        QFile file(parser.value("image"));
+        if(!file.open(QIODevice::ReadOnly)) {
+            qWarning("Unable to open %s", file.fileName().toLatin1().constData());
+            return 1;
+        }
+        flash.write(0, file.read(flashSize));
+    }
+
+    EspEmulatorFaults faults;
+    faults.dropRate = parser.value("drop").toDouble();
+    faults.corruptRate = parser.value("corrupt").toDouble();
+    if(parser.isSet("fail-at")) faults.failAddress = parseNumber(parser.value("fail-at"), &ok);
+    if(parser.isSet("stall-after")) faults.stallAfter = parseNumber(parser.value("stall-after"), &ok);
+    qsrand(parser.value("seed").toUInt());
+
+    EspEmulator emulator(&flash);
+    emulator.setLinkRate(parser.value("baud").toInt());
+    emulator.setFaults(faults);
+    if(!emulator.open(parser.value("link"))) return 1;
+
+    QTextStream(stdout) << "EspQtEmulator listening on " << emulator.portName() << endl;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    int res = app.exec();
+
+    QTextStream(stdout) << "Erased " << flash.erasedBytes() << " bytes, programmed " << flash.writtenBytes() << " bytes" << endl;
+    return res;
+}
@@ -61,6 +61,15 @@ int FirmwareRepository::repositoryFileIndex(const QString &name) {
     return found;
 }
 
+FlashBlob FirmwareRepository::flashBlob() const {
+    // Images are implicitly shared, the blob does not copy the loaded data
+    FlashBlob blob;
+    for(int i=0;i<mList.size();i++) {
+        if(!mList.at(i).memoryData.isEmpty()) blob.append(qMakePair(mList.at(i).flashAddress, mList.at(i).memoryData));
+    }
+    return blob;
+}
+
 QString FirmwareRepository::repositoryFileName() const {
     QFileInfo fi(mFilePath);
     return fi.baseName();
@@ -3,6 +3,8 @@
 
 #include <QObject>
 
+#include "esprom.h"
+
 class FatItem {
 public:
     FatItem(quint32 address, const QString &name) : flashAddress(address), fileName(name) { }
@@ -19,6 +21,7 @@ public:
     bool loadFromFile(const QString &filename, bool firmwareOnly);
     int repositoryFileIndex(const QString &name);
     const QList<FatItem> &items() const { return mList; }
+    FlashBlob flashBlob() const;
     QString repositoryFileName() const;
     QString firmwareVersion() const { return mVersionString; }
 private:
@@ -11,7 +11,7 @@
 #include <QProgressBar>
 #include <QSerialPortInfo>
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow), mEspInt(NULL), mCurrentRepoItem(0), mLastBytesWritten(0), mOldBytesWritten(0) {
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow), mEspInt(NULL) {
     ui->setupUi(this);
     mProgress = new QProgressBar(this);
     mProgress->setMinimum(0);
@@ -48,7 +48,6 @@ void MainWindow::on_seleectRepo_clicked() {
 }
 
 void MainWindow::printReposistoryStats(const QString &reponame) {
-    mLastBytesWritten = mOldBytesWritten = 0;
     mProgress->setValue(0);
     mProgress->setMaximum(repositoryBytesToWrite());
 
@@ -75,9 +74,10 @@ void MainWindow::on_flashDevice_clicked() {
         QString portName = ui->serialPorts->currentText();
         quint32 baudRate = ui->baudRates->currentText().toUInt();
         mEspInt = new EspInterface(portName, baudRate, this);
+        // Repository images are mostly padding, their blank sectors are not sent
+        mEspInt->setWriteOptions(EspRom::WriteSkipBlank);
         connect(mEspInt, SIGNAL(operationCompleted(int,bool)),this,SLOT(onEspOperationTerminated(int,bool)));
         connect(mEspInt, SIGNAL(flasherProgress(int)), this, SLOT(onFlasherProgress(int)));
-        mLastBytesWritten = mOldBytesWritten = 0;
         mProgress->setValue(0);
         setBusyState(true);
     } else {
@@ -97,7 +97,7 @@ void MainWindow::onEspOperationTerminated(int op, bool res) {
         } else if(op == EspInterface::opChipId) {
         } else if(op == EspInterface::opFlashId) {
         } else if(op == EspInterface::opReadFlash) {
-        } else if(op == EspInterface::opWriteFlash) {
+        } else if(op == EspInterface::opWriteBlob) {
             onWriteFinished();
         } else if(op == EspInterface::opRebootFw) {
             onDeviceRebooted();
@@ -112,9 +112,10 @@ void MainWindow::onEspOperationTerminated(int op, bool res) {
 }
 
 void MainWindow::onFlasherProgress(int written) {
-    if(written < mLastBytesWritten) mOldBytesWritten += mLastBytesWritten;
-    mProgress->setValue(mOldBytesWritten + written);
-    mLastBytesWritten = written;
+    // Progress already counts across all the segments
+    mProgress->setValue(written);
+    EspTelemetrySnapshot link = mEspInt->telemetry();
+    mProgress->setFormat(QString("%p% - %1 KB/s at %2 baud").arg(link.instantThroughput / 1024, 0, 'f', 1).arg(link.baudRate));
 }
 
 void MainWindow::setBusyState(bool busy) {
@@ -128,36 +129,19 @@ void MainWindow::setBusyState(bool busy) {
 }
 
 void MainWindow::onEspConnected() {
-    mCurrentRepoItem = 0;
-    while(mCurrentRepoItem<mRepository.items().size() && mRepository.items().at(mCurrentRepoItem).memoryData.isEmpty()) mCurrentRepoItem++;
-
-    if(mCurrentRepoItem<mRepository.items().size()) {
-        const FatItem &item = mRepository.items().at(mCurrentRepoItem);
+    // All the segments go in one session, the device reboots after the last
+    for(int i=0;i<mRepository.items().size();i++) {
+        const FatItem &item = mRepository.items().at(i);
+        if(item.memoryData.isEmpty()) continue;
         ui->programStatusView->appendPlainText(QString("%1 bytes at address %2 - %3").arg(item.memoryData.size(),5,16,QChar('0')).arg(item.flashAddress,6,16,QChar('0')).arg(item.fileName));
-        mEspInt->writeFlash(item.flashAddress, item.memoryData, false);
-    } else {
-        onWriteFinished();
     }
+    mEspInt->writeFlashBlob(mRepository.flashBlob(), true);
 }
 
 void MainWindow::onWriteFinished() {
-    mCurrentRepoItem += 1;
-    while(mCurrentRepoItem<mRepository.items().size() && mRepository.items().at(mCurrentRepoItem).memoryData.isEmpty()) mCurrentRepoItem++;
-
-    if(mCurrentRepoItem<mRepository.items().size()) {
-        const FatItem &item = mRepository.items().at(mCurrentRepoItem);
-        ui->programStatusView->appendPlainText(QString("%1 bytes at address %2 - %3").arg(item.memoryData.size(),5,16,QChar('0')).arg(item.flashAddress,6,16,QChar('0')).arg(item.fileName));
-        QThread::msleep(50); // FIXME very bad line to syncronize thread
-        mEspInt->writeFlash(item.flashAddress, item.memoryData, false);
-    } else {
-        onAllImageWrited();
-    }
-
-}
-
-void MainWindow::onAllImageWrited() {
-    //mCurrentRepoItem = 0;
-    mEspInt->startOperation(EspInterface::opRebootFw);
+    EspWriteStats stats = mEspInt->writeStats();
+    ui->programStatusView->appendPlainText(QString("%1 bytes written in %2 ms, %3 blank bytes skipped").arg(stats.payloadBytes).arg(stats.elapsedMs).arg(stats.skippedBytes));
+    onDeviceRebooted();
 }
 
 void MainWindow::onDeviceRebooted() {
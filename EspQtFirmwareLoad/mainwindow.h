@@ -27,7 +27,6 @@ private:
     void setBusyState(bool busy);
     void onEspConnected();
     void onWriteFinished();
-    void onAllImageWrited();
     void onDeviceRebooted();
 private:
     void printReposistoryStats(const QString &reponame);
@@ -36,9 +35,6 @@ private:
     Ui::MainWindow *ui;
     FirmwareRepository mRepository;
     EspInterface *mEspInt;
-    int mCurrentRepoItem;
-    int mLastBytesWritten;
-    int mOldBytesWritten;
 private:
     QProgressBar *mProgress;
 };
@@ -4,6 +4,11 @@ SUBDIRS += \
     quazip/quazip \
     EspQtLib \
     EspQtToolTest \
-    EspQtFirmwareLoad
+    EspQtFirmwareLoad \
+    EspQtBench \
+    EspQtTrace
+
+# The emulator serves a pseudo terminal
+unix: SUBDIRS += EspQtEmulator
 
 
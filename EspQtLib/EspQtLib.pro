@@ -4,26 +4,62 @@
 #
 #-------------------------------------------------
 
-QT +=  serialport
+QT +=  serialport concurrent
 QT -= gui
 
 TARGET = EspQtLib
 TEMPLATE = lib
-CONFIG += staticlib
+CONFIG += staticlib c++11
 
 SOURCES += \
     esprom.cpp \
     espinterface.cpp \
-    espflasher.cpp
+    espflasher.cpp \
+    espslip.cpp \
+    espflashplan.cpp \
+    espflashfarm.cpp \
+    espstub.cpp \
+    espchecksum.cpp \
+    espimage.cpp \
+    espflowcontrol.cpp \
+    espjobqueue.cpp \
+    espasyncrom.cpp \
+    esptelemetry.cpp \
+    esptrace.cpp \
+    espreplay.cpp \
+    espresume.cpp
 
 HEADERS += \
     esprom.h \
     espinterface.h \
-    espflasher.h
+    espflasher.h \
+    espslip.h \
+    espflashplan.h \
+    espflashfarm.h \
+    espstub.h \
+    espchecksum.h \
+    espimage.h \
+    espflowcontrol.h \
+    espjobqueue.h \
+    espasyncrom.h \
+    espprotocol.h \
+    esptelemetry.h \
+    esptrace.h \
+    espreplay.h \
+    espresume.h \
+    espstubdata.h
+
 unix {
     target.path = /usr/lib
     INSTALLS += target
 }
 
-RESOURCES += \
-    resources.qrc
+# The flasher stub is compiled in from the committed espstubdata.h. After
+# changing the JSON image, regenerate it by hand with "make stubdata" and
+# commit the result: a build never needs python3
+stubdata.commands = python3 $$PWD/res/stub2header.py $$PWD/res/stub_flasher.json $$PWD/espstubdata.h
+QMAKE_EXTRA_TARGETS += stubdata
+
+OTHER_FILES += \
+    res/stub_flasher.json \
+    res/stub2header.py
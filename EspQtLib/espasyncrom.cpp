@@ -0,0 +1,546 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espasyncrom.h"
+#include "espprotocol.h"
+#include "esprom.h"
+#include "espflasher.h"
+#include "espstub.h"
+#include "espflowcontrol.h"
+#include "esptrace.h"
+
+#include <QSerialPort>
+#include <QTimer>
+#include <QtEndian>
+#include <QScopedPointer>
+
+#define ERR_StubInvalid "Flasher stub image not valid"
+#define ERR_CommandFailed   "Command %1 failed"
+#define ERR_Aborted "Operation aborted"
+
+// An operation queued on an EspAsyncRom. It is started when it reaches the
+// head of the queue, then fed every frame received and the expiry of the
+// timer it armed, until it marks itself done.
+class EspAsyncOperation {
+public:
+    EspAsyncOperation(EspAsyncRom *rom) : mRom(rom), mDone(false) { }
+    virtual ~EspAsyncOperation() { }
+    bool isDone() const { return mDone; }
+    virtual void start() = 0;
+    virtual void packet(const QByteArray &packet) = 0;
+    virtual void timeout() {
+        telemetry().addTimeout();
+        fail(ERR_ReadError);
+    }
+    virtual void fail(const QString &error) = 0;
+protected:
+    QSerialPort *port() const { return mRom->mPort; }
+    int baudRate() const { return mRom->mBaudRate; }
+    int romBaudRate() const { return mRom->mRomBaudRate; }
+    bool isSynced() const { return mRom->mIsSynced; }
+    bool isStubRunning() const { return mRom->mStubRunning; }
+    void setSynced(bool synced) { mRom->mIsSynced = synced; }
+    void setStubRunning(bool running) { mRom->mStubRunning = running; }
+    void setBaudRate(int baudRate);
+    void resetDecoder() { mRom->mDecoder.reset(); }
+    EspTelemetry &telemetry() { return mRom->mTelemetry; }
+    void setLastError(const QString &error) { mRom->setLastError(error); }
+    void arm(int ms) { mRom->mTimer->start(ms); }
+    void progress(int done) { emit mRom->progress(done); }
+    void sendCommand(quint8 op, const QByteArray &data, quint32 chk=0) { mRom->sendCommand(op, data, chk); }
+    void sendStubCommand(const EspStubCommand &command);
+    void writeFrame(const char *data, int len) { mRom->writeFrame(data, len); }
+    void writeRaw(const char *data, int len) { mRom->writeRaw(data, len); }
+    static bool romReply(const QByteArray &packet, quint8 op, quint32 *val=0);
+    static bool romStatusOk(const QByteArray &packet) { return EspRom::isStatusOk(packet.mid(8)); }
+protected:
+    EspAsyncRom *mRom;
+    bool mDone;
+};
+
+void EspAsyncOperation::setBaudRate(int baudRate) {
+    mRom->mPort->setBaudRate(baudRate);
+    mRom->mTelemetry.setBaudRate(baudRate);
+    if(mRom->mTrace) mRom->mTrace->baudRate(baudRate);
+}
+
+void EspAsyncOperation::sendStubCommand(const EspStubCommand &command) {
+    char cmd = (char)command.command();
+    writeFrame(&cmd, 1);
+    writeFrame(command.arguments().constData(), command.arguments().size());
+    arm(command.timeout());
+}
+
+bool EspAsyncOperation::romReply(const QByteArray &packet, quint8 op, quint32 *val) {
+    quint8 replyOp;
+    quint32 replyVal;
+    if(!EspRom::parseResponse(packet, replyOp, replyVal) || replyOp != op) {
+        return false;
+    }
+    if(val) *val = replyVal;
+    return true;
+}
+
+// Operation delivering a value of type T through a future
+template<typename T> class EspAsyncTask : public EspAsyncOperation {
+public:
+    EspAsyncTask(EspAsyncRom *rom) : EspAsyncOperation(rom) { mInterface.reportStarted(); }
+    ~EspAsyncTask() { if(!mInterface.isFinished()) report(EspResult<T>(false, T(), ERR_Aborted)); }
+    QFuture<EspResult<T> > future() { return mInterface.future(); }
+    virtual void fail(const QString &error) {
+        qDebug("EspAsyncRom::fail %s", error.toLatin1().constData());
+        setLastError(error);
+        report(EspResult<T>(false, T(), error));
+    }
+protected:
+    void finish(const T &value) { report(EspResult<T>(true, value)); }
+    // Hands a frame to a stub command, false once it failed
+    bool feed(EspStubCommand &command, const QByteArray &packet) {
+        command.packet(packet);
+        if(command.isFailed()) {
+            fail(command.error());
+            return false;
+        }
+        if(!command.isFinished()) arm(command.timeout());
+        return true;
+    }
+private:
+    void report(const EspResult<T> &result) {
+        mInterface.reportResult(result);
+        mInterface.reportFinished();
+        mDone = true;
+    }
+private:
+    QFutureInterface<EspResult<T> > mInterface;
+};
+
+// Resets the chip into the ROM bootloader and syncs with it, the same
+// sequence as EspRom::syncEsp() with the waits run by the timer
+class EspAsyncSync : public EspAsyncTask<bool> {
+public:
+    enum Phase { ResetHold, ResetRelease, Syncing, Draining };
+    EspAsyncSync(EspAsyncRom *rom) : EspAsyncTask<bool>(rom), mPhase(ResetHold), mAttempts(0) { }
+    virtual void start() {
+        // The reset ends any stub session, the ROM listens on the initial rate
+        setSynced(false);
+        setStubRunning(false);
+        setBaudRate(romBaudRate());
+        resetDecoder();
+        port()->setDataTerminalReady(false);
+        port()->setRequestToSend(true);
+        arm(ESP_RESET_PULSE);
+    }
+    virtual void packet(const QByteArray &packet) {
+        if(mPhase == Syncing && romReply(packet, ESP_SYNC)) {
+            mPhase = Draining;
+            arm(ESP_SYNC_TIMEOUT);
+        } else if(mPhase == Draining) {
+            // The ROM answers a single sync with several replies, drop the others
+            arm(ESP_SYNC_TIMEOUT);
+        }
+    }
+    virtual void timeout() {
+        switch(mPhase) {
+        case ResetHold:
+            port()->setDataTerminalReady(true);
+            port()->setRequestToSend(false);
+            mPhase = ResetRelease;
+            arm(ESP_RESET_PULSE);
+            break;
+        case ResetRelease:
+            port()->setDataTerminalReady(false);
+            mPhase = Syncing;
+            sendSync();
+            break;
+        case Syncing:
+            telemetry().addTimeout();
+            if(++mAttempts < ESP_SYNC_ATTEMPTS) {
+                telemetry().addRetry();
+                sendSync();
+            } else {
+                fail(ERR_NotSynced);
+            }
+            break;
+        case Draining:
+            setSynced(true);
+            finish(true);
+            break;
+        }
+    }
+private:
+    void sendSync() {
+        sendCommand(ESP_SYNC, EspRom::syncData());
+        arm(ESP_SYNC_TIMEOUT);
+    }
+private:
+    Phase mPhase;
+    int mAttempts;
+};
+
+// One register read, a ROM service
+class EspAsyncReadReg : public EspAsyncTask<quint32> {
+public:
+    EspAsyncReadReg(EspAsyncRom *rom, const QByteArray &data) : EspAsyncTask<quint32>(rom), mData(data) { }
+    virtual void start() {
+        if(!isSynced()) {
+            fail(ERR_NotSynced);
+            return;
+        }
+        sendCommand(ESP_READ_REG, mData);
+        arm(ESP_DEFAULT_TIMEOUT);
+    }
+    virtual void packet(const QByteArray &packet) {
+        quint32 val;
+        if(!romReply(packet, ESP_READ_REG, &val)) return;
+        if(romStatusOk(packet)) finish(val);
+        else fail(QString(ERR_CommandFailed).arg(ESP_READ_REG, 2, 16, QChar('0')));
+    }
+private:
+    QByteArray mData;
+};
+
+// Uploads the flasher stub to RAM through the ROM, moves the link to the
+// stub rate and waits for its greeting. The upload is the one EspRom::runStub()
+// sends, replayed one command per reply.
+class EspAsyncStub : public EspAsyncTask<bool> {
+public:
+    enum Phase { Uploading, Greeting };
+    EspAsyncStub(EspAsyncRom *rom, const QList<EspRom::PipelinedCommand> &upload, int stubBaudRate) : EspAsyncTask<bool>(rom), mPhase(Uploading), mUpload(upload), mStubBaudRate(stubBaudRate), mNext(0) { }
+    virtual void start() {
+        if(isStubRunning()) {
+            finish(true);
+        } else if(mUpload.isEmpty()) {
+            fail(ERR_StubInvalid);
+        } else if(!isSynced()) {
+            fail(ERR_NotSynced);
+        } else {
+            sendNext();
+        }
+    }
+    virtual void packet(const QByteArray &packet) {
+        if(mPhase == Uploading) {
+            quint8 op = mUpload.at(mNext - 1).op;
+            if(!romReply(packet, op)) {
+                return;
+            } else if(!romStatusOk(packet)) {
+                fail(QString(ERR_CommandFailed).arg(op, 2, 16, QChar('0')));
+            } else if(mNext < mUpload.size()) {
+                sendNext();
+            } else {
+                // The stub is running, the ROM no longer listens
+                setSynced(false);
+                if(mStubBaudRate > 0) setBaudRate(mStubBaudRate);
+                mPhase = Greeting;
+                arm(ESP_STUB_GREETING_TIMEOUT);
+            }
+        } else if(packet.contains(ESP_STUB_GREETING)) {
+            qDebug("EspAsyncRom stub loaded");
+            setStubRunning(true);
+            finish(true);
+        } else {
+            arm(ESP_STUB_GREETING_TIMEOUT);
+        }
+    }
+    virtual void timeout() {
+        telemetry().addTimeout();
+        setSynced(false);
+        fail(ERR_StubNotRunning);
+    }
+private:
+    void sendNext() {
+        const EspRom::PipelinedCommand &cmd = mUpload.at(mNext++);
+        sendCommand(cmd.op, cmd.data, cmd.chk);
+        arm(ESP_DEFAULT_TIMEOUT);
+    }
+private:
+    Phase mPhase;
+    QList<EspRom::PipelinedCommand> mUpload;
+    int mStubBaudRate;
+    int mNext;
+};
+
+// Reads a flash region through the stub, acking every block as it arrives
+class EspAsyncRead : public EspAsyncTask<QByteArray> {
+public:
+    EspAsyncRead(EspAsyncRom *rom, quint32 address, quint32 size) : EspAsyncTask<QByteArray>(rom), mCommand(address, size), mSize(size), mReported(0) { }
+    virtual void start() {
+        if(!isStubRunning()) {
+            fail(ERR_StubNotRunning);
+            return;
+        }
+        mMemory.reserve(mSize);
+        sendStubCommand(mCommand);
+    }
+    virtual void packet(const QByteArray &packet) {
+        if(!feed(mCommand, packet)) {
+            return;
+        }
+
+        if(mCommand.isBlock()) {
+            mMemory.append(packet);
+            telemetry().addPayload(packet.size());
+
+            uchar ack[4];
+            mCommand.ack(ack);
+            writeFrame((const char *)ack, sizeof(ack));
+
+            quint32 received = mCommand.received();
+            if(received - mReported >= ESP_READ_PROGRESS_STEP || received == mSize) {
+                mReported = received;
+                progress(received);
+            }
+        }
+        if(mCommand.isFinished()) finish(mMemory);
+    }
+private:
+    EspStubRead mCommand;
+    quint32 mSize;
+    quint32 mReported;
+    QByteArray mMemory;
+};
+
+// Writes sector aligned data through the stub. The window is refilled on
+// every ack, so the link is kept busy without ever blocking the thread.
+class EspAsyncWrite : public EspAsyncTask<bool> {
+public:
+    EspAsyncWrite(EspAsyncRom *rom, quint32 address, const QByteArray &data) : EspAsyncTask<bool>(rom), mAddress(address), mData(data), mSent(0) { }
+    virtual void start() {
+        if(!isStubRunning()) {
+            fail(ERR_StubNotRunning);
+            return;
+        }
+        if(mAddress % ESP_FLASH_SECTOR != 0 || mData.isEmpty()) {
+            fail(QString(ERR_WrongArgument).arg("Address must be sector aligned and data not empty"));
+            return;
+        }
+
+        // The stub erases and writes whole sectors, the tail is padded as erased flash
+        int padding = (ESP_FLASH_SECTOR - mData.size() % ESP_FLASH_SECTOR) % ESP_FLASH_SECTOR;
+        mData.append(QByteArray(padding, (char)0xFF));
+        mFlow.reset(new EspFlowControl(port()->baudRate()));
+        mCommand.reset(new EspStubWrite(mAddress, mData.size()));
+        sendStubCommand(*mCommand);
+    }
+    virtual void packet(const QByteArray &packet) {
+        quint32 written = mCommand->written();
+        if(!feed(*mCommand, packet)) {
+            return;
+        }
+
+        if(mCommand->isAck()) {
+            if(mCommand->written() > written) telemetry().addPayload(mCommand->written() - written);
+            qint64 rtt = mFlow->acked(mCommand->written());
+            if(rtt >= 0) telemetry().addAckRtt(rtt);
+            progress(mCommand->written());
+            refill();
+        }
+        if(mCommand->isFinished()) finish(true);
+    }
+private:
+    void refill() {
+        quint32 size = mData.size();
+        while(mSent < size && mFlow->sendable(mSent, mCommand->written()) >= mFlow->chunkSize()) {
+            int len = mFlow->chunkSize();
+            writeRaw(mData.constData() + mSent, len);
+            mCommand->sent(mData.constData() + mSent, len);
+            mSent += len;
+            mFlow->sent(mSent);
+        }
+    }
+private:
+    quint32 mAddress;
+    QByteArray mData;
+    quint32 mSent;
+    QScopedPointer<EspStubWrite> mCommand;
+    QScopedPointer<EspFlowControl> mFlow;
+};
+
+// Digest of a flash region computed by the stub
+class EspAsyncDigest : public EspAsyncTask<QByteArray> {
+public:
+    EspAsyncDigest(EspAsyncRom *rom, quint32 address, quint32 size) : EspAsyncTask<QByteArray>(rom), mCommand(address, size) { }
+    virtual void start() {
+        if(!isStubRunning()) {
+            fail(ERR_StubNotRunning);
+            return;
+        }
+        sendStubCommand(mCommand);
+    }
+    virtual void packet(const QByteArray &packet) {
+        if(feed(mCommand, packet) && mCommand.isFinished()) finish(mCommand.regionDigest());
+    }
+private:
+    EspStubDigest mCommand;
+};
+
+EspAsyncRom::EspAsyncRom(const QString &port, int baud, QObject *parent) : QObject(parent), mPort(0), mTimer(0), mBaudRate(baud), mRomBaudRate(baud), mIsSynced(false), mStubRunning(false), mCurrent(0), mTrace(0) {
+    mTimer = new QTimer(this);
+    mTimer->setSingleShot(true);
+    connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+
+    mPort = new QSerialPort(port, this);
+    mPort->setBaudRate(baud);
+    mTelemetry.setBaudRate(baud);
+    connect(mPort, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    if(!mPort->open(QIODevice::ReadWrite)) {
+        setLastError(QString(ERR_PortOpen).arg(port));
+    }
+}
+
+EspAsyncRom::~EspAsyncRom() {
+    abortAll(ERR_Aborted);
+}
+
+bool EspAsyncRom::isPortOpen() const {
+    return mPort->isOpen();
+}
+
+QFuture<EspResult<bool> > EspAsyncRom::sync() {
+    EspAsyncSync *op = new EspAsyncSync(this);
+    QFuture<EspResult<bool> > future = op->future();
+    enqueue(op);
+    return future;
+}
+
+QFuture<EspResult<quint32> > EspAsyncRom::readReg(quint32 addr) {
+    EspAsyncReadReg *op = new EspAsyncReadReg(this, EspRom::readRegData(addr));
+    QFuture<EspResult<quint32> > future = op->future();
+    enqueue(op);
+    return future;
+}
+
+QFuture<EspResult<bool> > EspAsyncRom::startStub() {
+    QVector<quint32> params = EspFlasher::stubParams(mBaudRate);
+    EspStub stub = mStubFile.isEmpty() ? EspStub::builtin() : EspStub::cached(mStubFile);
+
+    // The upload is built here, the operation only replays it
+    EspAsyncStub *op = new EspAsyncStub(this, EspRom::stubUpload(stub, params), params.at(0));
+    QFuture<EspResult<bool> > future = op->future();
+    enqueue(op);
+    return future;
+}
+
+QFuture<EspResult<QByteArray> > EspAsyncRom::flashRead(quint32 address, quint32 size) {
+    EspAsyncRead *op = new EspAsyncRead(this, address, size);
+    QFuture<EspResult<QByteArray> > future = op->future();
+    enqueue(op);
+    return future;
+}
+
+QFuture<EspResult<bool> > EspAsyncRom::flashWrite(quint32 address, const QByteArray &data) {
+    EspAsyncWrite *op = new EspAsyncWrite(this, address, data);
+    QFuture<EspResult<bool> > future = op->future();
+    enqueue(op);
+    return future;
+}
+
+QFuture<EspResult<QByteArray> > EspAsyncRom::flashDigest(quint32 address, quint32 size) {
+    EspAsyncDigest *op = new EspAsyncDigest(this, address, size);
+    QFuture<EspResult<QByteArray> > future = op->future();
+    enqueue(op);
+    return future;
+}
+
+void EspAsyncRom::onReadyRead() {
+    int received = mDecoder.readFrom(mPort);
+    if(received) mTelemetry.addReceived(received);
+    while(mDecoder.hasPacket()) {
+        QByteArray packet = mDecoder.takePacket();
+        if(mTrace) mTrace->record(EspTraceRecord::FrameReceived, packet);
+        if(mCurrent) {
+            mCurrent->packet(packet);
+            reap();
+        } else {
+            qDebug("EspAsyncRom::onReadyRead dropped %d bytes, no operation running", packet.size());
+        }
+    }
+}
+
+void EspAsyncRom::onTimeout() {
+    if(mCurrent) {
+        mCurrent->timeout();
+        reap();
+    }
+}
+
+void EspAsyncRom::enqueue(EspAsyncOperation *operation) {
+    mOperations.enqueue(operation);
+    // Started from the event loop, the caller gets its future before any result
+    if(!mCurrent && mOperations.size() == 1) {
+        QTimer::singleShot(0, this, SLOT(startNext()));
+    }
+}
+
+void EspAsyncRom::startNext() {
+    while(!mCurrent && !mOperations.isEmpty()) {
+        mCurrent = mOperations.dequeue();
+        if(!mPort->isOpen()) {
+            mCurrent->fail(mLastError);
+        } else {
+            mCurrent->start();
+        }
+        reap();
+    }
+}
+
+void EspAsyncRom::reap() {
+    if(mCurrent && mCurrent->isDone()) {
+        mTimer->stop();
+        delete mCurrent;
+        mCurrent = 0;
+        startNext();
+    }
+}
+
+void EspAsyncRom::abortAll(const QString &error) {
+    mTimer->stop();
+    if(mCurrent) {
+        mCurrent->fail(error);
+        delete mCurrent;
+        mCurrent = 0;
+    }
+    while(!mOperations.isEmpty()) {
+        EspAsyncOperation *operation = mOperations.dequeue();
+        operation->fail(error);
+        delete operation;
+    }
+}
+
+void EspAsyncRom::sendCommand(quint8 op, const QByteArray &data, quint32 chk) {
+    EspRom::buildCommand(mCommandBuffer, op, data, chk);
+    writeFrame(mCommandBuffer.constData(), mCommandBuffer.size());
+}
+
+void EspAsyncRom::writeFrame(const char *data, int len) {
+    mEncoder.encode(data, len);
+    mTelemetry.addFrame(len, mEncoder.size());
+    if(mTrace) mTrace->record(EspTraceRecord::FrameSent, data, len);
+    mPort->write(mEncoder.data(), mEncoder.size());
+}
+
+void EspAsyncRom::writeRaw(const char *data, int len) {
+    mTelemetry.addRaw(len);
+    if(mTrace) mTrace->record(EspTraceRecord::RawSent, data, len);
+    mPort->write(data, len);
+}
@@ -0,0 +1,102 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPASYNCROM_H
+#define ESPASYNCROM_H
+
+#include <QObject>
+#include <QQueue>
+#include <QFuture>
+
+#include "espslip.h"
+#include "espjobqueue.h"
+#include "esptelemetry.h"
+
+class QSerialPort;
+class QTimer;
+class EspAsyncOperation;
+class EspTraceRecorder;
+
+// Non blocking counterpart of EspRom. The port is driven from the event loop
+// of the thread owning the object, no call ever waits: each one queues an
+// operation and returns a future of its result. Operations run in the order
+// they were queued, so a thread may drive any number of devices and compose
+// flows with espThen() instead of running a thread per port.
+//
+// Register access needs the ROM, see sync(); flash access needs the flasher
+// stub, see startStub(). Methods must be called from the owning thread.
+class EspAsyncRom : public QObject {
+    Q_OBJECT
+public:
+    EspAsyncRom(const QString &port, int baud, QObject *parent = 0);
+    ~EspAsyncRom();
+    bool isPortOpen() const;
+    bool isSynced() const { return mIsSynced; }
+    bool isStubRunning() const { return mStubRunning; }
+    int pendingOperations() const { return mOperations.size() + (mCurrent ? 1 : 0); }
+    void setStubFile(const QString &file) { mStubFile = file; }
+    QString lastError() const { return mLastError; }
+    const EspTelemetry &telemetry() const { return mTelemetry; }
+    void setTrace(EspTraceRecorder *trace) { mTrace = trace; }
+public:
+    QFuture<EspResult<bool> > sync();
+    QFuture<EspResult<quint32> > readReg(quint32 addr);
+    QFuture<EspResult<bool> > startStub();
+    QFuture<EspResult<QByteArray> > flashRead(quint32 address, quint32 size);
+    QFuture<EspResult<bool> > flashWrite(quint32 address, const QByteArray &data);
+    QFuture<EspResult<QByteArray> > flashDigest(quint32 address, quint32 size);
+private slots:
+    void onReadyRead();
+    void onTimeout();
+    void startNext();
+private:
+    friend class EspAsyncOperation;
+    void enqueue(EspAsyncOperation *operation);
+    void reap();
+    void abortAll(const QString &error);
+    void setLastError(const QString &error) { mLastError = error; }
+    void sendCommand(quint8 op, const QByteArray &data, quint32 chk=0);
+    void writeFrame(const char *data, int len);
+    void writeRaw(const char *data, int len);
+private:
+    QSerialPort *mPort;
+    QTimer *mTimer;
+    int mBaudRate;
+    int mRomBaudRate;
+    bool mIsSynced;
+    bool mStubRunning;
+    QString mStubFile;
+    EspSlipDecoder mDecoder;
+    EspSlipEncoder mEncoder;
+    QByteArray mCommandBuffer;
+    QQueue<EspAsyncOperation *> mOperations;
+    EspAsyncOperation *mCurrent;
+    QString mLastError;
+    EspTelemetry mTelemetry;
+    EspTraceRecorder *mTrace;
+signals:
+    void progress(int done);
+};
+
+#endif // ESPASYNCROM_H
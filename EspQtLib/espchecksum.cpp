@@ -0,0 +1,83 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espchecksum.h"
+
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+quint8 EspChecksum::compute(const char *data, int len, quint8 state) {
+    const quint8 *src = (const quint8 *)data;
+    const quint8 *end = src + len;
+
+    // XOR is associative: accumulate whole lanes, fold them to a byte at the end
+    quint64 acc = 0;
+#if defined(__AVX2__)
+    __m256i lanes0 = _mm256_setzero_si256();
+    __m256i lanes1 = _mm256_setzero_si256();
+    while(end - src >= 64) {
+        lanes0 = _mm256_xor_si256(lanes0, _mm256_loadu_si256((const __m256i *)src));
+        lanes1 = _mm256_xor_si256(lanes1, _mm256_loadu_si256((const __m256i *)(src + 32)));
+        src += 64;
+    }
+    lanes0 = _mm256_xor_si256(lanes0, lanes1);
+    __m128i lanes = _mm_xor_si128(_mm256_castsi256_si128(lanes0), _mm256_extracti128_si256(lanes0, 1));
+    acc = (quint64)_mm_cvtsi128_si64(lanes) ^ (quint64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(lanes, lanes));
+#elif defined(__SSE2__)
+    __m128i lanes0 = _mm_setzero_si128();
+    __m128i lanes1 = _mm_setzero_si128();
+    while(end - src >= 32) {
+        lanes0 = _mm_xor_si128(lanes0, _mm_loadu_si128((const __m128i *)src));
+        lanes1 = _mm_xor_si128(lanes1, _mm_loadu_si128((const __m128i *)(src + 16)));
+        src += 32;
+    }
+    lanes0 = _mm_xor_si128(lanes0, lanes1);
+    quint64 halves[2];
+    _mm_storeu_si128((__m128i *)halves, lanes0);
+    acc = halves[0] ^ halves[1];
+#endif
+    while(end - src >= 8) {
+        quint64 w;
+        memcpy(&w, src, sizeof(w));
+        acc ^= w;
+        src += 8;
+    }
+
+    acc ^= acc >> 32;
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+    state ^= (quint8)acc;
+
+    while(src < end) state ^= *src++;
+    return state;
+}
+
+quint8 EspChecksum::computeScalar(const char *data, int len, quint8 state) {
+    for(int i=0;i<len;i++) state ^= (quint8)data[i];
+    return state;
+}
@@ -0,0 +1,49 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPCHECKSUM_H
+#define ESPCHECKSUM_H
+
+#include <QByteArray>
+
+// Initial state for the checksum routine
+#define ESP_CHECKSUM_MAGIC 0xef
+
+// XOR checksum of the ROM data commands. The state can be carried across
+// calls, so a block may be checksummed in pieces as it is streamed.
+class EspChecksum {
+public:
+    EspChecksum(quint8 state=ESP_CHECKSUM_MAGIC) : mState(state) { }
+    void reset(quint8 state=ESP_CHECKSUM_MAGIC) { mState = state; }
+    void update(const char *data, int len) { mState = compute(data, len, mState); }
+    void update(const QByteArray &data) { update(data.constData(), data.size()); }
+    quint8 state() const { return mState; }
+public:
+    static quint8 compute(const char *data, int len, quint8 state=ESP_CHECKSUM_MAGIC);
+    static quint8 computeScalar(const char *data, int len, quint8 state=ESP_CHECKSUM_MAGIC);
+private:
+    quint8 mState;
+};
+
+#endif // ESPCHECKSUM_H
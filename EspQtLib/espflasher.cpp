@@ -23,218 +23,386 @@
  */
 
 #include "espflasher.h"
+#include "espprotocol.h"
 #include <QVector>
+#include <QBuffer>
 #include <QtEndian>
 #include <QCryptographicHash>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include "espflashplan.h"
+#include "espstub.h"
+#include "espimage.h"
+#include "espflowcontrol.h"
+
+// Time allowed to a running stub to answer the probe of ping()
+#define ESP_STUB_PROBE_TIMEOUT 100
+// Time allowed to erase the whole flash
+#define ESP_ERASE_CHIP_TIMEOUT 120000
+
+#define ERR_StubStatus "Stub command failed, status: %1"
+#define ERR_SinkFailure "Unable to store read data: %1"
+#define ERR_SourceFailure "Unable to read image data"
+#define ERR_VerifyFailure "Verify failed, %1 blocks differ, first at 0x%2"
+
+EspFlasher::EspFlasher(EspRom *esp, quint32 baudRate, bool upload) : QObject(esp), mEsp(esp), mRunStub(false), mLastErrorCode(NoError), mProgressOffset(0), mAcked(0) {
+    if(!upload) {
+        // Attaching to a stub already running, see ping()
+        return;
+    }
 
-//#define CESANTA_FLASHER_STUB ":/binary/cesanta.txt"
-#define CESANTA_FLASHER_STUB ":/binary/stub_flasher.json"
-// Default baudrate. The ROM auto-bauds, so we can use more or less whatever we waitnt.
-#define ESP_ROM_BAUD    115200
-
-
-#define CMD_FLASH_WRITE 1
-#define CMD_FLASH_READ 2
-#define CMD_FLASH_DIGEST 3
-#define CMD_BOOT_FW 6
-
-
-#define ERR_ReadError  "Read error"
-#define ERR_ExpectedStatusCode  "Expected status, got %1"
-#define ERR_ExpectedDigest "Expected digest, got: %1"
-#define ERR_DigestMismatch "Digest mismatch got:%1 exprected:%2"
-#define ERR_WrongArgument "Wrong argument: %1"
-#define ERR_WriteFailure "Write failure, status: %1"
-#define ERR_UnexpectedData "Unexpected data received"
-
-EspFlasher::EspFlasher(EspRom *esp, quint32 baudRate) : QObject(esp), mEsp(esp), mRunStub(false) {
     qDebug("Running Cesanta flasher stub baud rate:%d", baudRate);
-    if(baudRate <= ESP_ROM_BAUD) {
-        baudRate = 0;
+    QVector<quint32> params = stubParams(baudRate);
+    baudRate = params.at(0);
+    // The compiled in stub needs no parsing, a stub file is parsed once per process
+    EspStub stub = mEsp->mStubFile.isEmpty() ? EspStub::builtin() : EspStub::cached(mEsp->mStubFile);
+    // Only the Cesanta command set is spoken here, its stub takes the baud rate as single parameter
+    if(stub.numParams != 1) {
+        setError(WrongArguments, QString(ERR_WrongArgument).arg("Not a Cesanta flasher stub"));
+        return;
     }
-
-    QVector<quint32> params(1,baudRate);
-    Q_INIT_RESOURCE(resources);
-    mEsp->runStub(CESANTA_FLASHER_STUB, params, false);
+    mEsp->runStub(stub, params, false);
 
     if(baudRate > 0) {
         mEsp->setBaudRate(baudRate);
     }
 
-    for(int i=0; i<20; i++) {
-        mEsp->waitForReadyRead(10);
-        if(mEsp->read()) {
-            QByteArray p = mEsp->mLastPacket;
-            if(p.contains("OHAI")) {
-                mRunStub = true;
-                qDebug("CesantaFlasher::CesantaFlasher stub loaded!");
-            }
-            continue;
+    while(mEsp->readTimeout(ESP_STUB_GREETING_TIMEOUT)) {
+        if(mEsp->mLastPacket.contains(ESP_STUB_GREETING)) {
+            mRunStub = true;
+            qDebug("CesantaFlasher::CesantaFlasher stub loaded!");
+            break;
         }
     }
 }
 
-QByteArray EspFlasher::flashRead(quint32 address, int size) {
-    qDebug("CesantaFlasher::flashRead addr:%d size:%d", address, size);
-    mEsp->write(QByteArray(1,CMD_FLASH_READ));
-    mEsp->write(address, size, 32, 64);
-    QByteArray memory;
+QVector<quint32> EspFlasher::stubParams(quint32 baudRate) {
+    // The stub takes the rate to move the link to, 0 keeps the ROM one
+    return QVector<quint32>(1, baudRate > ESP_ROM_BAUD ? baudRate : 0);
+}
 
-    bool err = true;
-    while(true) {
-        mEsp->waitForReadyRead(10);
-        if(mEsp->readTimeout(1000)) {
-            memory.append(mEsp->mLastPacket);
-
-            QByteArray dataSize(4, '\0');
-            uchar *dataSizePtr = (uchar *)dataSize.data();
-            qToLittleEndian(memory.size(), dataSizePtr);
-            mEsp->write(dataSize);
-
-            if(memory.size() == size) {
-                err = false;
-                break;
-            } else if(memory.size() > size) {
-                qDebug("CesantaFlasher::flashRead Read more than expected");
-                break;
-            }
-        } else {
-            qDebug("CesantaFlasher::flashRead read error");
-            break;
+bool EspFlasher::ping() {
+    // A stub that has just started still has its greeting queued
+    while(mEsp->readTimeout(ESP_STUB_PROBE_TIMEOUT)) {
+        if(mEsp->lastPacketReaded().contains(ESP_STUB_GREETING)) {
+            mRunStub = true;
+            return true;
         }
     }
 
-    if(err) return QByteArray();
+    // An idle one answers the digest of a single sector. The ROM and the
+    // firmware drop the frames, they are too short to be commands
+    EspStubDigest probe(0, ESP_FLASH_SECTOR);
+    sendCommand(probe);
+    while(!probe.isFinished() && mEsp->readTimeout(ESP_STUB_PROBE_TIMEOUT)) {
+        probe.packet(mEsp->lastPacketReaded());
+    }
+    mRunStub = probe.phase() == EspStubCommand::Done;
+    if(!mRunStub) {
+        while(mEsp->readTimeout(ESP_STUB_PROBE_TIMEOUT)) {}
+    }
+    return mRunStub;
+}
 
-    err = true;
-    if(mEsp->readTimeout(1000)) {
-        QByteArray p = mEsp->mLastPacket;
-        if(p.size() == 16) {
-            QByteArray expectedDigest = QCryptographicHash::hash((memory),QCryptographicHash::Md5);
-            if(expectedDigest != mEsp->mLastPacket) {
-                setError(DigestMismatch, QString(ERR_DigestMismatch).arg(mEsp->lastPacketReaded().toHex().toUpper().constData()).arg(expectedDigest.toHex().toUpper().constData()));
-            } else {
-                err = false;
-            }
-        }
+QByteArray EspFlasher::flashRead(quint32 address, int size) {
+    QByteArray memory;
+    memory.reserve(size);
+    QBuffer buffer(&memory);
+    buffer.open(QIODevice::WriteOnly);
+    if(!flashRead(address, size, &buffer)) {
+        return QByteArray();
     }
+    return memory;
+}
 
+bool EspFlasher::flashRead(quint32 address, quint32 size, QIODevice *sink) {
+    qDebug("CesantaFlasher::flashRead addr:%d size:%d", address, size);
+    EspStubRead command(address, size);
+    sendCommand(command);
 
-    if(err) return QByteArray();
+    // Each block goes straight to the sink, only the running digest is kept
+    quint32 reported = 0;
+    uchar ack[4];
 
-    err = true;
-    if(mEsp->readTimeout(1000)) {
-        QByteArray p = mEsp->mLastPacket;
-        if(p.size() == 1) {
-            quint8 statusCode = (quint8)p.at(0);
-            if(statusCode == 0) {
-                return memory;
-            }
+    while(!command.isFinished()) {
+        if(!readReply(command)) {
+            return false;
+        }
+        if(!command.isBlock()) {
+            continue;
         }
-    }
 
-    return QByteArray();
+        const QByteArray &block = mEsp->lastPacketReaded();
+        if(sink->write(block) != block.size()) {
+            setError(SinkFailure, QString(ERR_SinkFailure).arg(sink->errorString()));
+            return false;
+        }
+        mEsp->mTelemetry->addPayload(block.size());
+
+        command.ack(ack);
+        mEsp->write((const char *)ack, sizeof(ack));
+
+        quint32 received = command.received();
+        if(received - reported >= ESP_READ_PROGRESS_STEP || received == size) {
+            reported = received;
+            emit progress(mProgressOffset + received);
+        }
+    }
+    return true;
 }
 
 bool EspFlasher::flashWrite(quint32 address, const QByteArray &data) {
-    if(address % ESP_FLASH_SECTOR != 0) {
+    EspImageSource source(data);
+    return flashWrite(address, source);
+}
+
+bool EspFlasher::flashWrite(quint32 address, EspImageSource &source, QList<QByteArray> *sectorDigests) {
+    return flashWriteRange(address, source, 0, source.size(), sectorDigests);
+}
+
+bool EspFlasher::flashWriteRange(quint32 address, EspImageSource &source, quint32 offset, quint32 size, QList<QByteArray> *sectorDigests) {
+    if(address % ESP_FLASH_SECTOR != 0 || offset % ESP_FLASH_SECTOR != 0 || size % ESP_FLASH_SECTOR != 0) {
         setError(WrongArguments, QString(ERR_WrongArgument).arg("Address must be sector aligned. Current size is"));
         return false;
     }
 
-    if(data.size() % ESP_FLASH_SECTOR) {
-        setError(WrongArguments, QString(ERR_WrongArgument).arg("Size must be sector aligned" + QString::number(data.size())));
+    if(!source.isValid()) {
+        setError(SourceFailure, QString(ERR_SourceFailure));
         return false;
     }
 
-    mEsp->write(QByteArray(1,CMD_FLASH_WRITE));
-    mEsp->write(address, data.size(), 1);
-
-    int numSent = 0;
-    int written = 0;
-
-    while(written < data.size()) {
-        if(mEsp->readTimeout(1000)) {
-            if(mEsp->mLastPacket.size() == 4) {
-                written = qFromLittleEndian(*(quint32 *)mEsp->mLastPacket.data());
-                emit progress(written);
-            } else if(mEsp->mLastPacket.size() == 1) {
-                mStatusCode = (quint8)mEsp->mLastPacket.at(0);
-                setError(WriteFailure, QString(ERR_WriteFailure).arg(mStatusCode));
-                return false;
-            } else {
-                setError(UnexpectedData, QString(ERR_UnexpectedData));
+    QElapsedTimer timer;
+    timer.start();
+    mWriteStats = EspWriteStats();
+    mAcked = offset;
+
+    EspStubWrite command(address + offset, size);
+    sendCommand(command);
+
+    // Data goes out of a fixed buffer, digests are updated as it is sent
+    char chunk[ESP_FLOW_MAX_CHUNK];
+    QCryptographicHash sectorMd5(QCryptographicHash::Md5);
+    if(sectorDigests) sectorDigests->clear();
+    EspFlowControl flow(mEsp->portBaudRate());
+
+    quint32 numSent = 0;
+
+    while(!command.isFinished()) {
+        // The window is refilled before waiting, the link never idles on an ack
+        // that is already on its way
+        while(command.isReady() && numSent < size && flow.sendable(numSent, command.written()) >= flow.chunkSize()) {
+            int len = source.read(offset + numSent, chunk, flow.chunkSize());
+            if(len != (int)flow.chunkSize()) {
+                setError(SourceFailure, QString(ERR_SourceFailure));
                 return false;
             }
-
-            while(numSent < data.size() && numSent - written < 2048) {
-                QByteArray portion = data.mid(numSent, 1024);
-                //qDebug("CesantaFlasher::flashWrite mEsp->write %d/%d,%d", numSent, written, portion.size());
-                mEsp->portWrite(portion);
-                numSent += 1024;
+            mEsp->portWrite(chunk, len);
+            command.sent(chunk, len);
+            if(sectorDigests) {
+                sectorMd5.addData(chunk, len);
+                if((numSent + len) % ESP_FLASH_SECTOR == 0) {
+                    sectorDigests->append(sectorMd5.result());
+                    sectorMd5.reset();
+                }
             }
+            numSent += len;
+            flow.sent(numSent);
         }
-    }
 
-    if(mEsp->readTimeout(1000)) {
-        if(mEsp->mLastPacket.size() == 16) {
-            QByteArray expectedDigest = QCryptographicHash::hash((data),QCryptographicHash::Md5);
-            if(expectedDigest != mEsp->mLastPacket) {
-                setError(DigestMismatch, QString(ERR_DigestMismatch).arg(mEsp->lastPacketReaded().toHex().toUpper().constData()).arg(expectedDigest.toHex().toUpper().constData()));
-                return false;
-            }
-        } else {
-            setError(ExpectedDigest, QString(ERR_ExpectedDigest).arg(mEsp->lastPacketReaded().toHex().toUpper().constData()));
+        quint32 written = command.written();
+        if(!readReply(command)) {
             return false;
         }
-    } else {
-        setError(ReadError, QString(ERR_ReadError));
+
+        if(command.isAck()) {
+            if(command.written() > written) mEsp->mTelemetry->addPayload(command.written() - written);
+            mAcked = offset + command.written();
+            qint64 rtt = flow.acked(command.written());
+            if(rtt >= 0) mEsp->mTelemetry->addAckRtt(rtt);
+            emit progress(mProgressOffset + offset + command.written());
+        }
+    }
+
+    mWriteStats.payloadBytes = mWriteStats.wireBytes = size;
+    mWriteStats.elapsedMs = timer.elapsed();
+    mWriteStats.window = flow.peakWindow();
+    mWriteStats.ackRttUs = flow.minRttUs();
+    mWriteStats.linkUtilisation = flow.utilisation(size, mWriteStats.elapsedMs);
+    qDebug("CesantaFlasher::flashWrite window %u rtt %lld us utilisation %.2f", mWriteStats.window, mWriteStats.ackRttUs, mWriteStats.linkUtilisation);
+    return true;
+}
+
+bool EspFlasher::flashWriteChanged(quint32 address, const QByteArray &data) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // Hash the image on the thread pool while the stub hashes the flash
+    QFuture<QList<QByteArray> > hostDigests = QtConcurrent::run(EspFlashPlan::blockDigests, data, ESP_FLASH_SECTOR);
+    QList<QByteArray> deviceDigests;
+    if(!flashDigest(deviceDigests, address, data.size(), ESP_FLASH_SECTOR)) {
         return false;
     }
 
-    if(mEsp->readTimeout(1000)) {
-        if(mEsp->mLastPacket.size() == 1) {
-            mStatusCode = (quint8)mEsp->mLastPacket.at(0);
-        } else {
-            setError(ExpectedStatusCode, QString(ERR_ExpectedStatusCode).arg(mEsp->lastPacketReaded().toHex().toUpper().constData()));
+    EspFlashRanges ranges = EspFlashPlan::changedRanges(hostDigests.result(), deviceDigests, ESP_FLASH_SECTOR, data.size());
+    quint32 changed = EspFlashPlan::rangesSize(ranges);
+    qDebug("CesantaFlasher::flashWriteChanged %d of %d bytes changed in %d ranges", changed, data.size(), ranges.size());
+
+    EspWriteStats stats;
+    stats.payloadBytes = data.size();
+
+    bool res = true;
+    for(int i=0; res && i<ranges.size(); i++) {
+        const EspFlashRange &range = ranges.at(i);
+        QByteArray portion = data.mid(range.offset, range.size);
+        mProgressOffset = range.offset;
+        res = flashWrite(address + range.offset, portion);
+        stats.wireBytes += mWriteStats.wireBytes;
+    }
+    mProgressOffset = 0;
+
+    if(res) emit progress(data.size());
+    stats.elapsedMs = timer.elapsed();
+    mWriteStats = stats;
+    return res;
+}
+
+bool EspFlasher::flashWriteSparse(quint32 address, EspImageSource &source, const EspFlashRanges &blank, const EspFlashRanges &erased, QList<QByteArray> *sectorDigests) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // Blank ranges already erased are skipped, the others are sent only
+    // where the flash under them is not blank yet
+    EspFlashRanges skip;
+    QByteArray blankDigest = EspFlashPlan::blankDigest(ESP_FLASH_SECTOR);
+    for(int i=0, e=0;i<blank.size();i++) {
+        const EspFlashRange &range = blank.at(i);
+        while(e < erased.size() && erased.at(e).offset < range.offset) e++;
+        if(e < erased.size() && erased.at(e).offset == range.offset) {
+            EspFlashPlan::addRange(skip, range.offset, range.size);
+            continue;
+        }
+
+        QList<QByteArray> deviceDigests;
+        if(!flashDigest(deviceDigests, address + range.offset, range.size, ESP_FLASH_SECTOR)) {
             return false;
         }
-    } else {
-        setError(ReadError, QString(ERR_ReadError));
-        return false;
+        for(int j=0;j<deviceDigests.size();j++) {
+            if(deviceDigests.at(j) == blankDigest) EspFlashPlan::addRange(skip, range.offset + j * ESP_FLASH_SECTOR, ESP_FLASH_SECTOR);
+        }
     }
 
-    return mStatusCode == 0;
+    EspFlashRanges ranges = EspFlashPlan::invertRanges(skip, source.size());
+    quint32 sent = EspFlashPlan::rangesSize(ranges);
+    qDebug("CesantaFlasher::flashWriteSparse %d of %d bytes sent in %d ranges", sent, source.size(), ranges.size());
+
+    // Skipped sectors end up blank, their reference digest is known
+    QVector<QByteArray> digests(source.size() / ESP_FLASH_SECTOR, blankDigest);
+
+    EspWriteStats stats;
+    stats.payloadBytes = source.size();
+    stats.skippedBytes = source.size() - sent;
+    double busyMs = 0.0;
+
+    bool res = true;
+    for(int i=0; res && i<ranges.size(); i++) {
+        const EspFlashRange &range = ranges.at(i);
+        QList<QByteArray> rangeDigests;
+        res = flashWriteRange(address, source, range.offset, range.size, sectorDigests ? &rangeDigests : 0);
+        for(int j=0;j<rangeDigests.size();j++) digests[range.offset / ESP_FLASH_SECTOR + j] = rangeDigests.at(j);
+
+        stats.wireBytes += mWriteStats.wireBytes;
+        stats.window = qMax(stats.window, mWriteStats.window);
+        if(mWriteStats.ackRttUs && (!stats.ackRttUs || mWriteStats.ackRttUs < stats.ackRttUs)) stats.ackRttUs = mWriteStats.ackRttUs;
+        stats.linkUtilisation += mWriteStats.linkUtilisation * mWriteStats.elapsedMs;
+        busyMs += mWriteStats.elapsedMs;
+    }
+
+    if(res) emit progress(mProgressOffset + source.size());
+    if(sectorDigests) *sectorDigests = digests.toList();
+    stats.linkUtilisation = busyMs > 0 ? stats.linkUtilisation / busyMs : 0.0;
+    stats.elapsedMs = timer.elapsed();
+    mWriteStats = stats;
+    return res;
 }
 
-bool EspFlasher::flashDigest(QList<QByteArray> digests, quint32 address, quint32 size, quint32 digestBlockSize) {
-    mEsp->write(CMD_FLASH_DIGEST);
-    mEsp->write(address, size, digestBlockSize);
+bool EspFlasher::flashVerify(quint32 address, quint32 size, const QList<QByteArray> &hostDigests, QList<quint32> &mismatches) {
+    QList<QByteArray> deviceDigests;
+    mismatches.clear();
+    if(!flashDigest(deviceDigests, address, size, ESP_FLASH_SECTOR)) {
+        return false;
+    }
 
-    while(true) {
-        if(mEsp->readTimeout(1000)) {
-            if(mEsp->lastPacketReaded().size() == 16) {
-                digests.append(mEsp->lastPacketReaded());
-            } else if(mEsp->lastPacketReaded().size() == 1) {
-                setError(ExpectedStatusCode, QString(ERR_ExpectedStatusCode).arg(mEsp->lastPacketReaded().toHex().toUpper().constData()));
-                mStatusCode = (quint8)mEsp->lastPacketReaded().at(0);
-                break;
-            } else {
-                return false;
-            }
-        } else {
-            setError(ReadError, QString(ERR_ReadError));
+    for(int i=0; i<hostDigests.size(); i++) {
+        if(i >= deviceDigests.size() || hostDigests.at(i) != deviceDigests.at(i)) {
+            mismatches.append(address + i * ESP_FLASH_SECTOR);
+        }
+    }
+
+    if(!mismatches.isEmpty()) {
+        setError(VerifyFailure, QString(ERR_VerifyFailure).arg(mismatches.size()).arg(mismatches.first(), 6, 16, QChar('0')));
+        return false;
+    }
+    return true;
+}
+
+bool EspFlasher::flashDigest(QList<QByteArray> &digests, quint32 address, quint32 size, quint32 digestBlockSize, QByteArray *regionDigest) {
+    EspStubDigest command(address, size, digestBlockSize);
+    sendCommand(command);
+    while(!command.isFinished()) {
+        if(!readReply(command)) {
             return false;
         }
     }
 
-    return mStatusCode == 0;
+    if(regionDigest) *regionDigest = command.regionDigest();
+    digests = command.blockDigests();
+    return true;
+}
+
+bool EspFlasher::flashId(quint32 &id) {
+    mEsp->write(CMD_FLASH_READ_CHIP_ID);
+    if(!mEsp->readTimeout(ESP_STUB_REPLY_TIMEOUT) || mEsp->lastPacketReaded().size() != 4) {
+        setError(UnexpectedData, QString(ERR_UnexpectedData));
+        return false;
+    }
+
+    id = qFromLittleEndian<quint32>((const uchar *)mEsp->lastPacketReaded().constData());
+    return readStatus(ESP_STUB_REPLY_TIMEOUT) && mStatusCode == 0;
+}
+
+bool EspFlasher::eraseChip() {
+    mEsp->write(CMD_FLASH_ERASE_CHIP);
+    if(!readStatus(ESP_ERASE_CHIP_TIMEOUT)) {
+        return false;
+    }
+
+    if(mStatusCode != 0) {
+        setError(WriteFailure, QString(ERR_WriteFailure).arg(mStatusCode));
+        return false;
+    }
+    return true;
+}
+
+bool EspFlasher::readStatus(int timeout) {
+    if(!mEsp->readTimeout(timeout)) {
+        setError(ReadError, QString(ERR_ReadError));
+        return false;
+    }
+
+    if(mEsp->lastPacketReaded().size() != 1) {
+        setError(ExpectedStatusCode, QString(ERR_ExpectedStatusCode).arg(mEsp->lastPacketReaded().toHex().toUpper().constData()));
+        return false;
+    }
+
+    mStatusCode = (quint8)mEsp->lastPacketReaded().at(0);
+    return true;
 }
 
 bool EspFlasher::bootFw() {
     mEsp->write(CMD_BOOT_FW);
-    if(mEsp->readTimeout(1000)) {
+    if(mEsp->readTimeout(ESP_STUB_REPLY_TIMEOUT)) {
         if(mEsp->lastPacketReaded().size() == 1) {
             mStatusCode = (quint8)mEsp->lastPacketReaded().at(0);
         } else {
@@ -249,8 +417,167 @@ bool EspFlasher::bootFw() {
     return mStatusCode == 0;
 }
 
+void EspFlasher::sendCommand(const EspStubCommand &command) {
+    mEsp->write(command.command());
+    mEsp->write(command.arguments());
+}
+
+bool EspFlasher::readReply(EspStubCommand &command) {
+    if(!mEsp->readTimeout(command.timeout())) {
+        setError(ReadError, QString(ERR_ReadError));
+        return false;
+    }
+
+    command.packet(mEsp->lastPacketReaded());
+    mStatusCode = command.statusCode();
+    if(command.isFailed()) {
+        setError(command.errorCode(), command.error());
+        return false;
+    }
+    return true;
+}
+
 void EspFlasher::setError(EspFlasher::Errors error, const QString &message) {
     mLastErrorCode = error;
     mLastErrorMessage = message;
+    if(error == ReadError) mEsp->mTelemetry->addTimeout();
     qDebug("CesantaFlasher::setError[%d] %s", error, message.toLatin1().constData());
 }
+
+EspStubCommand::EspStubCommand(quint8 cmd, quint32 arg1, quint32 arg2, quint32 arg3) : mPhase(Data), mStatusCode(0), mCommand(cmd), mArguments(12, '\0'), mErrorCode(EspFlasher::NoError) {
+    uchar *data = (uchar *)mArguments.data();
+    qToLittleEndian(arg1, data);
+    qToLittleEndian(arg2, data + 4);
+    qToLittleEndian(arg3, data + 8);
+}
+
+EspStubCommand::EspStubCommand(quint8 cmd, quint32 arg1, quint32 arg2, quint32 arg3, quint32 arg4) : mPhase(Data), mStatusCode(0), mCommand(cmd), mArguments(16, '\0'), mErrorCode(EspFlasher::NoError) {
+    uchar *data = (uchar *)mArguments.data();
+    qToLittleEndian(arg1, data);
+    qToLittleEndian(arg2, data + 4);
+    qToLittleEndian(arg3, data + 8);
+    qToLittleEndian(arg4, data + 12);
+}
+
+int EspStubCommand::timeout() const {
+    return ESP_STUB_REPLY_TIMEOUT;
+}
+
+void EspStubCommand::fail(EspFlasher::Errors error, const QString &message) {
+    mPhase = Failed;
+    mErrorCode = error;
+    mError = message;
+}
+
+void EspStubCommand::checkDigest(const QByteArray &packet, const QByteArray &expected) {
+    if(packet.size() != 16) {
+        fail(EspFlasher::ExpectedDigest, QString(ERR_ExpectedDigest).arg(packet.toHex().toUpper().constData()));
+    } else if(packet != expected) {
+        fail(EspFlasher::DigestMismatch, QString(ERR_DigestMismatch).arg(packet.toHex().toUpper().constData()).arg(expected.toHex().toUpper().constData()));
+    } else {
+        mPhase = Status;
+    }
+}
+
+void EspStubCommand::checkStatus(const QByteArray &packet, EspFlasher::Errors error, const char *message) {
+    if(packet.size() != 1) {
+        fail(EspFlasher::ExpectedStatusCode, QString(ERR_ExpectedStatusCode).arg(packet.toHex().toUpper().constData()));
+        return;
+    }
+
+    mStatusCode = (quint8)packet.at(0);
+    if(mStatusCode != 0) {
+        fail(error, QString(message).arg(mStatusCode));
+    } else {
+        mPhase = Done;
+    }
+}
+
+EspStubRead::EspStubRead(quint32 address, quint32 size) : EspStubCommand(CMD_FLASH_READ, address, size, ESP_READ_BLOCK, ESP_READ_IN_FLIGHT), mSize(size), mReceived(0), mBlock(false), mMd5(QCryptographicHash::Md5) {
+    if(size == 0) mPhase = Digest;
+}
+
+void EspStubRead::packet(const QByteArray &packet) {
+    mBlock = false;
+    switch(mPhase) {
+    case Data:
+        if(mReceived + packet.size() > mSize) {
+            fail(EspFlasher::UnexpectedData, QString(ERR_UnexpectedData));
+            break;
+        }
+        mMd5.addData(packet);
+        mReceived += packet.size();
+        mBlock = true;
+        if(mReceived == mSize) mPhase = Digest;
+        break;
+    case Digest:
+        checkDigest(packet, mMd5.result());
+        break;
+    case Status:
+        checkStatus(packet, EspFlasher::ExpectedStatusCode, ERR_StubStatus);
+        break;
+    default:
+        break;
+    }
+}
+
+void EspStubRead::ack(uchar *data) const {
+    qToLittleEndian(mReceived, data);
+}
+
+EspStubWrite::EspStubWrite(quint32 address, quint32 size) : EspStubCommand(CMD_FLASH_WRITE, address, size, 1), mSize(size), mWritten(0), mReady(false), mAck(false), mMd5(QCryptographicHash::Md5) {
+}
+
+int EspStubWrite::timeout() const {
+    return mPhase == Data ? ESP_WRITE_ACK_TIMEOUT : ESP_STUB_REPLY_TIMEOUT;
+}
+
+void EspStubWrite::packet(const QByteArray &packet) {
+    mAck = false;
+    switch(mPhase) {
+    case Data:
+        if(packet.size() == 1) {
+            mStatusCode = (quint8)packet.at(0);
+            fail(EspFlasher::WriteFailure, QString(ERR_WriteFailure).arg(mStatusCode));
+        } else if(packet.size() != 4) {
+            fail(EspFlasher::UnexpectedData, QString(ERR_UnexpectedData));
+        } else {
+            mWritten = qFromLittleEndian<quint32>((const uchar *)packet.constData());
+            mReady = mAck = true;
+            if(mWritten >= mSize) mPhase = Digest;
+        }
+        break;
+    case Digest:
+        checkDigest(packet, mMd5.result());
+        break;
+    case Status:
+        checkStatus(packet, EspFlasher::WriteFailure, ERR_WriteFailure);
+        break;
+    default:
+        break;
+    }
+}
+
+EspStubDigest::EspStubDigest(quint32 address, quint32 size, quint32 blockSize) : EspStubCommand(CMD_FLASH_DIGEST, address, size, blockSize) {
+}
+
+int EspStubDigest::timeout() const {
+    return ESP_DIGEST_TIMEOUT;
+}
+
+void EspStubDigest::packet(const QByteArray &packet) {
+    if(isFinished()) {
+        return;
+    }
+
+    // The stub sends the digest of every block, then the one of the whole region and a status
+    if(packet.size() == 16) {
+        mDigests.append(packet);
+    } else if(packet.size() == 1) {
+        mStatusCode = (quint8)packet.at(0);
+        if(mStatusCode != 0 || mDigests.isEmpty()) fail(EspFlasher::ExpectedDigest, QString(ERR_ExpectedDigest).arg(mStatusCode));
+        else mPhase = Done;
+    } else {
+        fail(EspFlasher::UnexpectedData, QString(ERR_UnexpectedData));
+    }
+}
@@ -26,19 +26,44 @@
 #define CESANTAFLASHER_H
 #include "esprom.h"
 
+#include <QList>
+#include <QVector>
+#include <QCryptographicHash>
+
+class QIODevice;
+class EspImageSource;
+class EspStubCommand;
+
 class EspFlasher : public QObject {
     Q_OBJECT
 public:
-    enum Errors { ReadError, UnexpectedData, ExpectedStatusCode, ExpectedDigest, DigestMismatch, WrongArguments, WriteFailure,  };
-    EspFlasher(EspRom *esp, quint32 baudRate=0);
+    enum Errors { NoError, ReadError, UnexpectedData, ExpectedStatusCode, ExpectedDigest, DigestMismatch, WrongArguments, WriteFailure, VerifyFailure, SinkFailure, SourceFailure };
+    EspFlasher(EspRom *esp, quint32 baudRate=0, bool upload=true);
+    static QVector<quint32> stubParams(quint32 baudRate);
+    bool ping();
     QString lastError() const { return mLastErrorMessage; }
+    Errors lastErrorCode() const { return mLastErrorCode; }
+    bool isStubRunning() const { return mRunStub; }
     QByteArray flashRead(quint32 address, int size);
+    bool flashRead(quint32 address, quint32 size, QIODevice *sink);
     bool flashWrite(quint32 address, const QByteArray &data);
-    bool flashDigest(QList<QByteArray> digests, quint32 address, quint32 size, quint32 digestBlockSize=0);
+    bool flashWrite(quint32 address, EspImageSource &source, QList<QByteArray> *sectorDigests=0);
+    bool flashWriteRange(quint32 address, EspImageSource &source, quint32 offset, quint32 size, QList<QByteArray> *sectorDigests=0);
+    bool flashWriteSparse(quint32 address, EspImageSource &source, const EspFlashRanges &blank, const EspFlashRanges &erased, QList<QByteArray> *sectorDigests=0);
+    bool flashWriteChanged(quint32 address, const QByteArray &data);
+    EspWriteStats writeStats() const { return mWriteStats; }
+    quint32 ackedBytes() const { return mAcked; }
+    bool flashVerify(quint32 address, quint32 size, const QList<QByteArray> &hostDigests, QList<quint32> &mismatches);
+    bool flashDigest(QList<QByteArray> &digests, quint32 address, quint32 size, quint32 digestBlockSize=0, QByteArray *regionDigest=0);
+    bool flashId(quint32 &id);
+    bool eraseChip();
     bool bootFw();
 
 private:
     void setError(Errors error, const QString &message);
+    bool readStatus(int timeout);
+    void sendCommand(const EspStubCommand &command);
+    bool readReply(EspStubCommand &command);
 private:
     EspRom *mEsp;
     bool mRunStub;
@@ -46,8 +71,98 @@ private:
     quint8 mStatusCode;
     Errors mLastErrorCode;
     QString mLastErrorMessage;
+    EspWriteStats mWriteStats;
+    quint32 mProgressOffset;
+    // Image offset acknowledged by the stub in the last plain write
+    quint32 mAcked;
 signals:
     void progress(int written);
 };
 
+// A flash command of the Cesanta stub: the frames to send and the checks
+// of the frames it answers with. EspFlasher waits for the replies and
+// EspAsyncRom is handed them by its event loop, both feed them to packet()
+// until the command is finished.
+class EspStubCommand {
+public:
+    enum Phase { Data, Digest, Status, Done, Failed };
+    EspStubCommand(quint8 cmd, quint32 arg1, quint32 arg2, quint32 arg3);
+    EspStubCommand(quint8 cmd, quint32 arg1, quint32 arg2, quint32 arg3, quint32 arg4);
+    virtual ~EspStubCommand() { }
+    // Sent as two frames, the command byte then its arguments
+    quint8 command() const { return mCommand; }
+    const QByteArray &arguments() const { return mArguments; }
+    Phase phase() const { return mPhase; }
+    bool isFinished() const { return mPhase == Done || mPhase == Failed; }
+    bool isFailed() const { return mPhase == Failed; }
+    EspFlasher::Errors errorCode() const { return mErrorCode; }
+    QString error() const { return mError; }
+    quint8 statusCode() const { return mStatusCode; }
+    // Time allowed to the stub to send the next frame
+    virtual int timeout() const;
+    virtual void packet(const QByteArray &packet) = 0;
+protected:
+    void fail(EspFlasher::Errors error, const QString &message);
+    void checkDigest(const QByteArray &packet, const QByteArray &expected);
+    void checkStatus(const QByteArray &packet, EspFlasher::Errors error, const char *message);
+protected:
+    Phase mPhase;
+    quint8 mStatusCode;
+private:
+    quint8 mCommand;
+    QByteArray mArguments;
+    EspFlasher::Errors mErrorCode;
+    QString mError;
+};
+
+// Flash read: data blocks, each to be acked, then their digest and a status
+class EspStubRead : public EspStubCommand {
+public:
+    EspStubRead(quint32 address, quint32 size);
+    virtual void packet(const QByteArray &packet);
+    // Set when the last frame was a data block, to be stored and acked
+    bool isBlock() const { return mBlock; }
+    quint32 received() const { return mReceived; }
+    // Ack of the bytes received so far, 4 bytes
+    void ack(uchar *data) const;
+private:
+    quint32 mSize;
+    quint32 mReceived;
+    bool mBlock;
+    QCryptographicHash mMd5;
+};
+
+// Flash write: acks of the bytes written, then the digest of the data and a status
+class EspStubWrite : public EspStubCommand {
+public:
+    EspStubWrite(quint32 address, quint32 size);
+    virtual int timeout() const;
+    virtual void packet(const QByteArray &packet);
+    // Data is hashed as it is sent, the stub answers with the digest of all of it
+    void sent(const char *data, int len) { mMd5.addData(data, len); }
+    // The first ack tells the stub is ready to receive
+    bool isReady() const { return mReady; }
+    // Set when the last frame was an ack
+    bool isAck() const { return mAck; }
+    quint32 written() const { return mWritten; }
+private:
+    quint32 mSize;
+    quint32 mWritten;
+    bool mReady;
+    bool mAck;
+    QCryptographicHash mMd5;
+};
+
+// Flash digest: the digest of every block, the one of the region and a status
+class EspStubDigest : public EspStubCommand {
+public:
+    EspStubDigest(quint32 address, quint32 size, quint32 blockSize=0);
+    virtual int timeout() const;
+    virtual void packet(const QByteArray &packet);
+    QList<QByteArray> blockDigests() const { return mDigests.mid(0, mDigests.size() - 1); }
+    QByteArray regionDigest() const { return mDigests.isEmpty() ? QByteArray() : mDigests.last(); }
+private:
+    QList<QByteArray> mDigests;
+};
+
 #endif // CESANTAFLASHER_H
@@ -0,0 +1,227 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espflashfarm.h"
+
+#include <QMutexLocker>
+#include <QDir>
+#include <QFileInfo>
+#include <QScopedPointer>
+
+#include "esptrace.h"
+
+#define ERR_FarmSync "Unable to sync with device on %1"
+
+EspFarmWorker::EspFarmWorker(EspFlashFarm *farm, int index) : QObject(0), mFarm(farm), mIndex(index) {
+    setAutoDelete(true);
+}
+
+void EspFarmWorker::run() {
+    QString port = mFarm->device(mIndex).port;
+    mFarm->setDeviceState(mIndex, EspFarmDevice::Connecting);
+
+    // One trace per station, named after its port. It outlives the session
+    QScopedPointer<EspTraceRecorder> trace;
+    if(!mFarm->mTraceDirectory.isEmpty()) {
+        trace.reset(new EspTraceRecorder(QDir(mFarm->mTraceDirectory).filePath(QFileInfo(port).fileName() + ".esptrace"), port));
+    }
+
+    // The session lives on the pool thread for the whole job
+    EspRom esp(port, mFarm->mBaud);
+    if(!esp.isPortOpen()) {
+        fail(esp.lastError());
+        return;
+    }
+
+    connect(&esp, SIGNAL(flasherProgress(int)), this, SLOT(onFlasherProgress(int)), Qt::DirectConnection);
+    esp.setTelemetry(mFarm->mTelemetry.at(mIndex));
+    esp.setTrace(trace.data());
+    esp.setAutoBaud(mFarm->mAutoBaud);
+    esp.setWriteOptions(mFarm->mWriteOptions);
+    // A station that failed picks up where it stopped on the next run, the
+    // journal is named after its port
+    if(!mFarm->mResumeDirectory.isEmpty()) {
+        esp.setResumeJournal(QDir(mFarm->mResumeDirectory).filePath(QFileInfo(port).fileName() + ".espresume"));
+        esp.setWriteOptions(mFarm->mWriteOptions | EspRom::WriteResume);
+    }
+
+    if(!esp.syncEsp()) {
+        fail(QString(ERR_FarmSync).arg(port));
+        return;
+    }
+
+    mFarm->setDeviceState(mIndex, EspFarmDevice::Writing);
+
+    // All the segments go in one stub session, the images are already prepared
+    bool written = esp.flashWriteBlob(mFarm->mBlob, mFarm->mReboot, mFarm->mMode, mFarm->mSize, mFarm->mFreq);
+    mFarm->setDeviceStats(mIndex, esp.lastWriteStats());
+    if(!written) {
+        fail(esp.lastError());
+        return;
+    }
+
+    mFarm->setDeviceState(mIndex, EspFarmDevice::Done);
+}
+
+void EspFarmWorker::onFlasherProgress(int written) {
+    mFarm->setDeviceProgress(mIndex, written);
+}
+
+void EspFarmWorker::fail(const QString &error) {
+    qDebug("EspFarmWorker::run device %d failed: %s", mIndex, error.toLatin1().constData());
+    mFarm->setDeviceState(mIndex, EspFarmDevice::Failed, error);
+}
+
+EspFlashFarm::EspFlashFarm(QObject *parent) : QObject(parent), mMode(EspRom::dio), mSize(EspRom::size32m), mFreq(EspRom::freq40m), mWriteOptions(EspRom::WriteDefault),
+    mAutoBaud(false), mReboot(true), mMaxConcurrent(0), mBaud(0), mRunning(0), mSucceeded(0), mFailed(0), mElapsedMs(0) {
+}
+
+EspFlashFarm::~EspFlashFarm() {
+    mPool.waitForDone();
+    qDeleteAll(mTelemetry);
+}
+
+void EspFlashFarm::setFlashParams(EspRom::FlashMode mode, EspRom::FlashSize size, EspRom::FlashSizeFreq freq) {
+    mMode = mode;
+    mSize = size;
+    mFreq = freq;
+}
+
+bool EspFlashFarm::start(const QStringList &ports, int baud) {
+    if(isRunning() || ports.isEmpty() || mBlob.isEmpty()) return false;
+
+    // Header patch and padding are done here once, the workers share the result
+    for(int i=0;i<mBlob.size();i++) EspRom::prepareImage(mBlob[i].first, mBlob[i].second, mMode, mSize, mFreq);
+
+    QMutexLocker locker(&mMutex);
+    mBaud = baud;
+    mDevices.clear();
+    foreach(const QString &port, ports) mDevices.append(EspFarmDevice(port));
+    qDeleteAll(mTelemetry);
+    mTelemetry.clear();
+    for(int i=0;i<ports.size();i++) mTelemetry.append(new EspTelemetry());
+    mRunning = mDevices.size();
+    mSucceeded = mFailed = 0;
+    mElapsedMs = 0;
+    mTimer.start();
+    locker.unlock();
+
+    // Sessions spend their time blocked on the serial ports, one thread each
+    mPool.setMaxThreadCount(mMaxConcurrent > 0 ? mMaxConcurrent : ports.size());
+    for(int i=0;i<ports.size();i++) mPool.start(new EspFarmWorker(this, i));
+    return true;
+}
+
+bool EspFlashFarm::isRunning() const {
+    QMutexLocker locker(&mMutex);
+    return mRunning > 0;
+}
+
+bool EspFlashFarm::waitForFinished(int msecs) {
+    return mPool.waitForDone(msecs);
+}
+
+int EspFlashFarm::deviceCount() const {
+    QMutexLocker locker(&mMutex);
+    return mDevices.size();
+}
+
+EspFarmDevice EspFlashFarm::device(int index) const {
+    QMutexLocker locker(&mMutex);
+    return mDevices.value(index);
+}
+
+EspTelemetrySnapshot EspFlashFarm::deviceTelemetry(int index) const {
+    // The counters are atomic, the lock only guards the list against a restart
+    QMutexLocker locker(&mMutex);
+    if(index < 0 || index >= mTelemetry.size()) return EspTelemetrySnapshot();
+    return mTelemetry.at(index)->snapshot();
+}
+
+quint64 EspFlashFarm::blobSize() const {
+    quint64 size = 0;
+    for(int i=0;i<mBlob.size();i++) size += mBlob.at(i).second.size();
+    return size;
+}
+
+quint64 EspFlashFarm::bytesWritten() const {
+    QMutexLocker locker(&mMutex);
+    quint64 written = 0;
+    for(int i=0;i<mDevices.size();i++) written += mDevices.at(i).written;
+    return written;
+}
+
+qint64 EspFlashFarm::elapsedMs() const {
+    QMutexLocker locker(&mMutex);
+    return mRunning > 0 ? mTimer.elapsed() : mElapsedMs;
+}
+
+double EspFlashFarm::throughput() const {
+    qint64 elapsed = elapsedMs();
+    return elapsed ? bytesWritten() * 1000.0 / elapsed : 0.0;
+}
+
+void EspFlashFarm::setDeviceState(int index, EspFarmDevice::State state, const QString &error) {
+    bool done = false;
+    int succeeded = 0, failed = 0;
+
+    mMutex.lock();
+    EspFarmDevice &dev = mDevices[index];
+    dev.state = state;
+    dev.error = error;
+    if(state == EspFarmDevice::Done || state == EspFarmDevice::Failed) {
+        dev.elapsedMs = mTimer.elapsed();
+        if(state == EspFarmDevice::Done) mSucceeded++; else mFailed++;
+        if(--mRunning == 0) {
+            mElapsedMs = mTimer.elapsed();
+            done = true;
+            succeeded = mSucceeded;
+            failed = mFailed;
+        }
+    }
+    mMutex.unlock();
+
+    emit deviceStateChanged(index, state);
+    if(done) {
+        qDebug("EspFlashFarm %d devices done, %d failed, %.1f kB/s aggregate", succeeded, failed, throughput() / 1024.0);
+        emit finished(succeeded, failed);
+    }
+}
+
+void EspFlashFarm::setDeviceProgress(int index, quint64 written) {
+    quint64 total = 0;
+
+    mMutex.lock();
+    mDevices[index].written = written;
+    for(int i=0;i<mDevices.size();i++) total += mDevices.at(i).written;
+    mMutex.unlock();
+
+    emit deviceProgress(index, (int)written);
+    emit progress(total, blobSize() * deviceCount());
+}
+
+void EspFlashFarm::setDeviceStats(int index, const EspWriteStats &stats) {
+    QMutexLocker locker(&mMutex);
+    mDevices[index].stats = stats;
+}
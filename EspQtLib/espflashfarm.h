@@ -0,0 +1,127 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPFLASHFARM_H
+#define ESPFLASHFARM_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QStringList>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include "esprom.h"
+
+// Status of one device of a flash farm
+class EspFarmDevice {
+public:
+    enum State { Waiting, Connecting, Writing, Done, Failed };
+    EspFarmDevice(const QString &p=QString()) : port(p), state(Waiting), written(0), elapsedMs(0) { }
+public:
+    QString port;
+    State state;
+    quint64 written;
+    qint64 elapsedMs;
+    QString error;
+    EspWriteStats stats;
+};
+
+class EspFlashFarm;
+class EspFarmWorker : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    EspFarmWorker(EspFlashFarm *farm, int index);
+    virtual void run();
+private slots:
+    void onFlasherProgress(int written);
+private:
+    void fail(const QString &error);
+private:
+    EspFlashFarm *mFarm;
+    int mIndex;
+};
+
+// Flashes the same set of images to many boards at once. Every port gets its
+// own EspRom session on a pooled thread, the images are prepared once and
+// shared read only by all of them.
+class EspFlashFarm : public QObject {
+    Q_OBJECT
+public:
+    friend class EspFarmWorker;
+    EspFlashFarm(QObject *parent=0);
+    ~EspFlashFarm();
+    void setBlob(const FlashBlob &blob) { mBlob = blob; }
+    void setFlashParams(EspRom::FlashMode mode, EspRom::FlashSize size, EspRom::FlashSizeFreq freq);
+    void setWriteOptions(EspRom::WriteOptions options) { mWriteOptions = options; }
+    void setAutoBaud(bool enable) { mAutoBaud = enable; }
+    void setReboot(bool reboot) { mReboot = reboot; }
+    void setMaxConcurrent(int count) { mMaxConcurrent = count; }
+    void setTraceDirectory(const QString &dir) { mTraceDirectory = dir; }
+    void setResumeDirectory(const QString &dir) { mResumeDirectory = dir; }
+    bool start(const QStringList &ports, int baud);
+    bool isRunning() const;
+    bool waitForFinished(int msecs=-1);
+    int deviceCount() const;
+    EspFarmDevice device(int index) const;
+    EspTelemetrySnapshot deviceTelemetry(int index) const;
+    quint64 blobSize() const;
+    quint64 bytesWritten() const;
+    qint64 elapsedMs() const;
+    double throughput() const;
+private:
+    void setDeviceState(int index, EspFarmDevice::State state, const QString &error=QString());
+    void setDeviceProgress(int index, quint64 written);
+    void setDeviceStats(int index, const EspWriteStats &stats);
+private:
+    FlashBlob mBlob;
+    EspRom::FlashMode mMode;
+    EspRom::FlashSize mSize;
+    EspRom::FlashSizeFreq mFreq;
+    EspRom::WriteOptions mWriteOptions;
+    bool mAutoBaud;
+    bool mReboot;
+    int mMaxConcurrent;
+    int mBaud;
+    QString mTraceDirectory;
+    QString mResumeDirectory;
+private:
+    QThreadPool mPool;
+    mutable QMutex mMutex;
+    QList<EspFarmDevice> mDevices;
+    // One per device, kept until the next start so the last run can be inspected
+    QList<EspTelemetry *> mTelemetry;
+    int mRunning;
+    int mSucceeded;
+    int mFailed;
+    QElapsedTimer mTimer;
+    qint64 mElapsedMs;
+signals:
+    void deviceStateChanged(int index, int state);
+    void deviceProgress(int index, int written);
+    void progress(quint64 written, quint64 total);
+    void finished(int succeeded, int failed);
+};
+
+#endif // ESPFLASHFARM_H
@@ -0,0 +1,144 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espflashplan.h"
+#include "espimage.h"
+
+#include <QCryptographicHash>
+#include <QtConcurrent>
+
+#include <string.h>
+
+// Largest block scanned for blank content in one read
+#define ESP_PLAN_SCAN_BLOCK 0x1000
+
+class DigestBlock {
+public:
+    DigestBlock(const QByteArray *s=0, int o=0, int l=0) : source(s), offset(o), length(l) { }
+public:
+    const QByteArray *source;
+    int offset;
+    int length;
+};
+
+static QByteArray digestBlock(const DigestBlock &block) {
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    md5.addData(block.source->constData() + block.offset, block.length);
+    return md5.result();
+}
+
+QList<QByteArray> EspFlashPlan::blockDigests(const QByteArray &data, int blockSize) {
+    QList<DigestBlock> blocks;
+    for(int offset=0; offset<data.size(); offset+=blockSize) {
+        blocks.append(DigestBlock(&data, offset, qMin(blockSize, data.size() - offset)));
+    }
+    return QtConcurrent::blockingMapped(blocks, digestBlock);
+}
+
+EspFlashRanges EspFlashPlan::changedRanges(const QList<QByteArray> &hostDigests, const QList<QByteArray> &deviceDigests, int blockSize, int dataSize) {
+    EspFlashRanges ranges;
+    for(int i=0; i<hostDigests.size(); i++) {
+        bool changed = i >= deviceDigests.size() || hostDigests.at(i) != deviceDigests.at(i);
+        if(!changed) continue;
+
+        quint32 offset = i * blockSize;
+        addRange(ranges, offset, qMin(blockSize, dataSize - (int)offset));
+    }
+    return ranges;
+}
+
+void EspFlashPlan::addRange(EspFlashRanges &ranges, quint32 offset, quint32 size) {
+    // Adjacent blocks are merged so each run costs one write
+    if(!ranges.isEmpty() && ranges.last().end() == offset) {
+        ranges.last().size += size;
+    } else {
+        ranges.append(EspFlashRange(offset, size));
+    }
+}
+
+quint32 EspFlashPlan::rangesSize(const EspFlashRanges &ranges) {
+    quint32 size = 0;
+    for(int i=0;i<ranges.size();i++) size += ranges.at(i).size;
+    return size;
+}
+
+bool EspFlashPlan::isBlank(const char *data, int len) {
+    // Erased flash reads as all ones, checked a word at a time
+    const quint64 ones = ~Q_UINT64_C(0);
+    int i = 0;
+    for(; i + 8 <= len; i += 8) {
+        quint64 w;
+        memcpy(&w, data + i, sizeof(w));
+        if(w != ones) return false;
+    }
+    for(; i < len; i++) {
+        if((quint8)data[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+QByteArray EspFlashPlan::blankDigest(int blockSize) {
+    return QCryptographicHash::hash(QByteArray(blockSize, (char)0xFF), QCryptographicHash::Md5);
+}
+
+bool EspFlashPlan::blankRanges(EspImageSource &source, EspFlashRanges &blank, int blockSize) {
+    blank.clear();
+    if(blockSize > ESP_PLAN_SCAN_BLOCK) return false;
+
+    char block[ESP_PLAN_SCAN_BLOCK];
+    for(quint32 offset=0; offset<source.size(); offset+=blockSize) {
+        int len = source.read(offset, block, blockSize);
+        if(len < 0) return false;
+        if(isBlank(block, len)) addRange(blank, offset, len);
+    }
+    return true;
+}
+
+bool EspFlashPlan::sourceDigests(EspImageSource &source, QList<QByteArray> &blockDigests, QByteArray &imageDigest, int blockSize) {
+    // One read of the image gives the digest of every block and of the whole
+    blockDigests.clear();
+    if(blockSize > ESP_PLAN_SCAN_BLOCK) return false;
+
+    char block[ESP_PLAN_SCAN_BLOCK];
+    QCryptographicHash image(QCryptographicHash::Md5);
+    for(quint32 offset=0; offset<source.size(); offset+=blockSize) {
+        int len = source.read(offset, block, blockSize);
+        if(len < 0) return false;
+        image.addData(block, len);
+        blockDigests.append(QCryptographicHash::hash(QByteArray::fromRawData(block, len), QCryptographicHash::Md5));
+    }
+    imageDigest = image.result();
+    return true;
+}
+
+EspFlashRanges EspFlashPlan::invertRanges(const EspFlashRanges &ranges, quint32 size) {
+    EspFlashRanges inverted;
+    quint32 offset = 0;
+    for(int i=0;i<ranges.size();i++) {
+        if(ranges.at(i).offset > offset) inverted.append(EspFlashRange(offset, ranges.at(i).offset - offset));
+        offset = ranges.at(i).end();
+    }
+    if(offset < size) inverted.append(EspFlashRange(offset, size - offset));
+    return inverted;
+}
@@ -0,0 +1,59 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPFLASHPLAN_H
+#define ESPFLASHPLAN_H
+
+#include <QByteArray>
+#include <QList>
+
+// A range of an image, offset relative to the start of the image
+class EspFlashRange {
+public:
+    EspFlashRange(quint32 o=0, quint32 s=0) : offset(o), size(s) { }
+    quint32 end() const { return offset + size; }
+public:
+    quint32 offset;
+    quint32 size;
+};
+
+typedef QList<EspFlashRange> EspFlashRanges;
+
+class EspImageSource;
+
+// Host side helpers used to decide which parts of an image must be sent
+class EspFlashPlan {
+public:
+    static QList<QByteArray> blockDigests(const QByteArray &data, int blockSize);
+    static EspFlashRanges changedRanges(const QList<QByteArray> &hostDigests, const QList<QByteArray> &deviceDigests, int blockSize, int dataSize);
+    static quint32 rangesSize(const EspFlashRanges &ranges);
+    static bool isBlank(const char *data, int len);
+    static QByteArray blankDigest(int blockSize);
+    static bool blankRanges(EspImageSource &source, EspFlashRanges &blank, int blockSize);
+    static bool sourceDigests(EspImageSource &source, QList<QByteArray> &blockDigests, QByteArray &imageDigest, int blockSize);
+    static EspFlashRanges invertRanges(const EspFlashRanges &ranges, quint32 size);
+    static void addRange(EspFlashRanges &ranges, quint32 offset, quint32 size);
+};
+
+#endif // ESPFLASHPLAN_H
@@ -0,0 +1,80 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espflowcontrol.h"
+
+#include <QtGlobal>
+
+// Start, stop and data bits of every byte on the wire
+#define ESP_UART_BITS_PER_BYTE 10
+
+EspFlowControl::EspFlowControl(quint32 baudRate, quint32 minWindow, quint32 maxWindow) : mBytesPerSecond(baudRate / ESP_UART_BITS_PER_BYTE), mMinWindow(minWindow), mMaxWindow(maxWindow),
+    mMinRttUs(0), mRttTotalUs(0), mRttSamples(0), mAckStep(0), mLastAck(0) {
+    mWindow = mPeakWindow = qBound(mMinWindow, (quint32)ESP_FLOW_INITIAL_WINDOW, mMaxWindow);
+    mClock.start();
+}
+
+quint32 EspFlowControl::chunkSize() const {
+    // Powers of two that divide a sector, at least two chunks per window
+    quint32 chunk = ESP_FLOW_MAX_CHUNK;
+    while(chunk > ESP_FLOW_MIN_CHUNK && chunk * 2 > mWindow) chunk /= 2;
+    return chunk;
+}
+
+void EspFlowControl::sent(quint32 offset) {
+    mMarks.enqueue(qMakePair(offset, mClock.nsecsElapsed() / 1000));
+}
+
+qint64 EspFlowControl::acked(quint32 offset) {
+    if(offset <= mLastAck) return -1;
+    mAckStep = qMax(mAckStep, offset - mLastAck);
+    mLastAck = offset;
+
+    // The newest chunk fully covered by the ack gives the sample
+    qint64 sentAt = -1;
+    while(!mMarks.isEmpty() && mMarks.head().first <= offset) sentAt = mMarks.dequeue().second;
+    if(sentAt < 0) return -1;
+
+    qint64 rtt = mClock.nsecsElapsed() / 1000 - sentAt;
+    if(mRttSamples == 0 || rtt < mMinRttUs) mMinRttUs = rtt;
+    mRttTotalUs += rtt;
+    mRttSamples++;
+    resize();
+    return rtt;
+}
+
+void EspFlowControl::resize() {
+    // Bytes the link carries in one round trip, plus one ack step since the
+    // stub only acknowledges whole blocks
+    quint64 bdp = (quint64)mBytesPerSecond * mMinRttUs / 1000000 + mAckStep;
+    quint32 window = (quint32)qBound<quint64>(mMinWindow, bdp, mMaxWindow);
+    mWindow = (window + ESP_FLOW_MIN_CHUNK - 1) / ESP_FLOW_MIN_CHUNK * ESP_FLOW_MIN_CHUNK;
+    mWindow = qMin(mWindow, mMaxWindow);
+    mPeakWindow = qMax(mPeakWindow, mWindow);
+}
+
+double EspFlowControl::utilisation(quint64 bytes, qint64 elapsedMs) const {
+    if(elapsedMs <= 0 || mBytesPerSecond == 0) return 0.0;
+    return qMin(1.0, bytes * 1000.0 / elapsedMs / mBytesPerSecond);
+}
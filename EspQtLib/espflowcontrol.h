@@ -0,0 +1,75 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPFLOWCONTROL_H
+#define ESPFLOWCONTROL_H
+
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QPair>
+
+// Bounds of the write window. The stub has no flow control of its own, the
+// bytes not yet acknowledged must fit in its receive buffer
+#define ESP_FLOW_MIN_WINDOW 0x400
+#define ESP_FLOW_MAX_WINDOW 0x3000
+// Window used until the first round trip has been measured
+#define ESP_FLOW_INITIAL_WINDOW 0x800
+// Largest and smallest chunk handed to the serial port
+#define ESP_FLOW_MAX_CHUNK 0x400
+#define ESP_FLOW_MIN_CHUNK 0x100
+
+// Sizes the in-flight window of a stub write from the bandwidth-delay
+// product of the link. The round trip of every acknowledged chunk is timed;
+// the minimum seen is taken as the delay of the link, since longer samples
+// only measure the queue the window itself builds up.
+class EspFlowControl {
+public:
+    EspFlowControl(quint32 baudRate, quint32 minWindow=ESP_FLOW_MIN_WINDOW, quint32 maxWindow=ESP_FLOW_MAX_WINDOW);
+    quint32 window() const { return mWindow; }
+    quint32 peakWindow() const { return mPeakWindow; }
+    quint32 chunkSize() const;
+    quint32 sendable(quint32 sent, quint32 acked) const { return sent - acked < mWindow ? mWindow - (sent - acked) : 0; }
+    void sent(quint32 offset);
+    qint64 acked(quint32 offset);
+    qint64 minRttUs() const { return mMinRttUs; }
+    qint64 avgRttUs() const { return mRttSamples ? mRttTotalUs / mRttSamples : 0; }
+    double utilisation(quint64 bytes, qint64 elapsedMs) const;
+private:
+    void resize();
+private:
+    QElapsedTimer mClock;
+    QQueue< QPair<quint32, qint64> > mMarks;
+    quint32 mBytesPerSecond;
+    quint32 mMinWindow;
+    quint32 mMaxWindow;
+    quint32 mWindow;
+    quint32 mPeakWindow;
+    qint64 mMinRttUs;
+    qint64 mRttTotalUs;
+    quint32 mRttSamples;
+    quint32 mAckStep;
+    quint32 mLastAck;
+};
+
+#endif // ESPFLOWCONTROL_H
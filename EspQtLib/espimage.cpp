@@ -0,0 +1,161 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espimage.h"
+#include "esprom.h"
+
+#include <QFile>
+
+#include <string.h>
+
+// Offset and value of the magic byte of the application image header
+#define ESP_IMAGE_MAGIC_OFFSET  0
+#define ESP_IMAGE_MAGIC         0xe9
+// Offset of the flash mode byte, the size/frequency byte follows it
+#define ESP_IMAGE_FLASH_MODE    2
+
+EspImageSource::EspImageSource(const QByteArray &data) : mData(data), mSpan(0), mDevice(0), mMappedFile(0), mMapped(0), mDeviceBase(0) {
+    mSpan = mData.constData();
+    init(mData.size());
+}
+
+EspImageSource::EspImageSource(const char *data, quint32 size) : mSpan(data), mDevice(0), mMappedFile(0), mMapped(0), mDeviceBase(0) {
+    init(size);
+}
+
+EspImageSource::EspImageSource(QIODevice *device) : mSpan(0), mDevice(0), mMappedFile(0), mMapped(0), mDeviceBase(0) {
+    // Files are mapped when possible, anything else is read in order from
+    // its current position
+    QFile *file = qobject_cast<QFile *>(device);
+    if(file && file->size() > file->pos()) mMapped = file->map(file->pos(), file->size() - file->pos());
+
+    if(mMapped) {
+        mMappedFile = file;
+        mSpan = (const char *)mMapped;
+        init(file->size() - file->pos());
+    } else if(!device->isSequential()) {
+        mDevice = device;
+        mDeviceBase = device->pos();
+        init(device->size() - device->pos());
+    } else {
+        // What a pipe or a socket has received so far is not the image size,
+        // the source stays invalid: the size must be given
+        init(0);
+    }
+}
+
+EspImageSource::EspImageSource(QIODevice *device, quint32 size) : mSpan(0), mDevice(device), mMappedFile(0), mMapped(0), mDeviceBase(device->isSequential() ? 0 : device->pos()) {
+    init(size);
+}
+
+EspImageSource::~EspImageSource() {
+    if(mMapped) mMappedFile->unmap(mMapped);
+}
+
+bool EspImageSource::isSequential() const {
+    // Only a sequential device can not be read out of order
+    return mDevice && mDevice->isSequential();
+}
+
+void EspImageSource::init(quint32 size) {
+    mSize = size;
+    mPaddedSize = (size + ESP_FLASH_SECTOR - 1) / ESP_FLASH_SECTOR * ESP_FLASH_SECTOR;
+    mDevicePos = 0;
+    mPatch = false;
+}
+
+void EspImageSource::patchHeader(quint8 flashMode, quint8 flashSizeFreq) {
+    char magic = 0;
+    if(mSpan && mSize > ESP_IMAGE_FLASH_MODE + 1) magic = mSpan[ESP_IMAGE_MAGIC_OFFSET];
+    else if(mDevice && mSize > ESP_IMAGE_FLASH_MODE + 1 && mDevicePos == 0) {
+        QByteArray head = mDevice->peek(1);
+        if(!head.isEmpty()) magic = head.at(0);
+    }
+
+    if((quint8)magic == ESP_IMAGE_MAGIC) {
+        mHeader[0] = (char)flashMode;
+        mHeader[1] = (char)flashSizeFreq;
+        // An image that already carries these values is left as it is
+        mPatch = !mSpan || memcmp(mSpan + ESP_IMAGE_FLASH_MODE, mHeader, 2) != 0;
+    }
+}
+
+int EspImageSource::read(quint32 offset, char *dst, int len) {
+    if(offset > mPaddedSize) return -1;
+    len = qMin<quint32>(len, mPaddedSize - offset);
+
+    int fromSource = offset < mSize ? qMin<quint32>(len, mSize - offset) : 0;
+    if(fromSource > 0) {
+        if(mSpan) {
+            memcpy(dst, mSpan + offset, fromSource);
+        } else if(!readDevice(offset, dst, fromSource)) {
+            return -1;
+        }
+    }
+
+    memset(dst + fromSource, 0xFF, len - fromSource);
+    applyPatch(offset, dst, len);
+    return len;
+}
+
+bool EspImageSource::readDevice(quint32 offset, char *dst, int len) {
+    if(offset != mDevicePos) {
+        if(mDevice->isSequential() || !mDevice->seek(mDeviceBase + offset)) return false;
+        mDevicePos = offset;
+    }
+
+    // Sequential devices may deliver the data in pieces
+    while(len > 0) {
+        qint64 got = mDevice->read(dst, len);
+        if(got < 0 || (got == 0 && !mDevice->waitForReadyRead(ESP_DEFAULT_TIMEOUT))) return false;
+        dst += got;
+        len -= got;
+        mDevicePos += got;
+    }
+    return true;
+}
+
+void EspImageSource::applyPatch(quint32 offset, char *dst, int len) const {
+    if(!mPatch) return;
+    for(int i=0;i<2;i++) {
+        quint32 pos = ESP_IMAGE_FLASH_MODE + i;
+        if(pos >= offset && pos < offset + len) dst[pos - offset] = mHeader[i];
+    }
+}
+
+bool EspImageSource::rewind() {
+    if(mSpan || mDevicePos == 0) return true;
+    if(mDevice->isSequential() || !mDevice->seek(mDeviceBase)) return false;
+    mDevicePos = 0;
+    return true;
+}
+
+QByteArray EspImageSource::readAll() {
+    // A shared array that needs neither patch nor padding is handed out as is
+    if(!mData.isNull() && !mPatch && mSize == mPaddedSize) return mData;
+
+    QByteArray data(mPaddedSize, '\0');
+    if(!rewind() || read(0, data.data(), mPaddedSize) != (int)mPaddedSize) return QByteArray();
+    return data;
+}
@@ -0,0 +1,73 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPIMAGE_H
+#define ESPIMAGE_H
+
+#include <QByteArray>
+
+class QIODevice;
+class QFile;
+
+// Read only view of an image to be written in flash. The source is a shared
+// QByteArray, a span of memory, a memory mapped file or a device read in
+// order. The flash header patch and the 0xFF padding up to the sector size
+// are applied on the fly, the source itself is never copied or modified.
+// A sequential device can not tell the image size, it has to be given.
+class EspImageSource {
+public:
+    EspImageSource(const QByteArray &data);
+    EspImageSource(const char *data, quint32 size);
+    EspImageSource(QIODevice *device);
+    EspImageSource(QIODevice *device, quint32 size);
+    ~EspImageSource();
+    bool isValid() const { return mSpan || mDevice; }
+    bool isSequential() const;
+    quint32 size() const { return mPaddedSize; }
+    quint32 sourceSize() const { return mSize; }
+    void patchHeader(quint8 flashMode, quint8 flashSizeFreq);
+    int read(quint32 offset, char *dst, int len);
+    bool rewind();
+    QByteArray readAll();
+private:
+    void init(quint32 size);
+    bool readDevice(quint32 offset, char *dst, int len);
+    void applyPatch(quint32 offset, char *dst, int len) const;
+private:
+    QByteArray mData;
+    const char *mSpan;
+    QIODevice *mDevice;
+    QFile *mMappedFile;
+    uchar *mMapped;
+    quint32 mSize;
+    quint32 mPaddedSize;
+    qint64 mDeviceBase;
+    quint32 mDevicePos;
+    bool mPatch;
+    char mHeader[2];
+private:
+    Q_DISABLE_COPY(EspImageSource)
+};
+
+#endif // ESPIMAGE_H
@@ -24,145 +24,272 @@
 
 #include "espinterface.h"
 
+#include <QFile>
+#include <QMutexLocker>
+
 #include "espflasher.h"
+#include "espimage.h"
 #include "esprom.h"
+#include "esptrace.h"
+
+#define ERR_NotRunning  "Interface thread not running"
+
+EspInterface::EspInterface(const QString &port, quint32 baud, QObject *parent) : EspInterface(port, baud, QString(), parent) {
+}
 
-EspInterface::EspInterface(const QString &port, quint32 baud, QObject *parent) : QThread(parent), mEsp(0) {
+EspInterface::EspInterface(const QString &port, quint32 baud, const QString &traceFile, QObject *parent) : QThread(parent), mEsp(0), mTrace(0), mWriteOptions(EspRom::WriteDefault), mAutoBaud(false) {
     mPort = port; mBaud = baud;
-    connect(this,SIGNAL(started()),this,SLOT(onThreadStarted()));
-    //connect(this,SIGNAL(finished()),this,SLOT(threadFinished()));
+    // Opened before the thread starts, the connection is traced as well
+    if(!traceFile.isEmpty()) {
+        mTrace = new EspTraceRecorder(traceFile, port);
+        if(!mTrace->isOpen()) setLastError(mTrace->errorString());
+    }
     start();
+    // Queued ahead of anything the caller asks, it runs as soon as the port is open
+    connectEsp();
 }
 
-void EspInterface::connectEsp() {
-    if(mEsp && mEsp->isPortOpen()) {
-        mArgs.clear();
-        startOperation(opConnect);
+EspInterface::~EspInterface() {
+    if(isRunning()) {
+        quitThread();
+        wait();
     }
+    cancelJobs();
+    delete mTrace;
 }
 
-void EspInterface::chipId() {
-    if(mEsp && mEsp->isPortOpen()) {
-        mArgs.clear();
-        startOperation(opChipId);
+template<typename T> QFuture<EspResult<T> > EspInterface::submit(EspOperations operation, const typename EspTypedJob<T>::Function &function) {
+    // Settings are taken when the job is queued, not when it runs
+    bool autoBaud = mAutoBaud;
+    QString resumeJournal = mResumeJournal;
+    EspTypedJob<T> *job = new EspTypedJob<T>(operation, [=](EspRom *esp, T &value) -> bool {
+        esp->setAutoBaud(autoBaud);
+        esp->setResumeJournal(resumeJournal);
+        return function(esp, value);
+    });
+    QFuture<EspResult<T> > future = job->future();
+
+    if(mStopped.loadAcquire()) {
+        job->cancel(ERR_NotRunning);
+        delete job;
+    } else {
+        mJobs.push(job);
+        mJobsPending.release();
+        // The worker may have stopped and drained the queue since the check,
+        // the job it missed is cancelled here
+        if(mStopped.loadAcquire()) cancelJobs();
     }
+    return future;
 }
 
-void EspInterface::flashId() {
-    if(mEsp && mEsp->isPortOpen()) {
-        mArgs.clear();
-        startOperation(opFlashId);
-    }
+QFuture<EspResult<bool> > EspInterface::connectEsp() {
+    return submit<bool>(opConnect, [](EspRom *esp, bool &connected) -> bool {
+        // Reuse a stub left running by the last connection before resetting to the ROM
+        connected = esp->attachStub() || esp->syncEsp();
+        return connected;
+    });
 }
 
-void EspInterface::readFlash(quint32 address, quint32 size) {
-    if(mEsp && mEsp->isPortOpen()) {
-        mArgs.clear();
-        mArgs.append(QVariant(address));
-        mArgs.append(QVariant(size));
-        startOperation(opReadFlash);
-    }
+QFuture<EspResult<quint32> > EspInterface::chipId() {
+    return submit<quint32>(opChipId, [this](EspRom *esp, quint32 &chipid) -> bool {
+        // Register reads are a ROM service, a stub session is ended for them
+        if(esp->hasStubSession() && !esp->syncEsp()) return false;
+        chipid = esp->chipId();
+        setOperationData(QVariant(chipid));
+        return chipid != 0;
+    });
 }
 
-void EspInterface::writeFlash(quint32 address, const QByteArray &data, bool reboot) {
-    if(mEsp && mEsp->isPortOpen()) {
-        mArgs.clear();
-        mArgs.append(QVariant(address));
-        mArgs.append(QVariant(data));
-        mArgs.append(QVariant(reboot));
-        startOperation(opWriteFlash);
-    }
+QFuture<EspResult<quint32> > EspInterface::flashId() {
+    return submit<quint32>(opFlashId, [this](EspRom *esp, quint32 &flashid) -> bool {
+        flashid = esp->flashId();
+        setOperationData(QVariant(flashid));
+        return flashid != 0;
+    });
 }
 
-void EspInterface::rebootFw() {
-    if(mEsp && mEsp->isPortOpen()) {
-        mArgs.clear();
-        startOperation(opRebootFw);
-    }
+QFuture<EspResult<EspInventory> > EspInterface::deviceInventory() {
+    return submit<EspInventory>(opInventory, [this](EspRom *esp, EspInventory &inventory) -> bool {
+        if(esp->hasStubSession() && !esp->syncEsp()) return false;
+        bool res = esp->deviceInventory(inventory);
+        QVariantMap result;
+        result.insert("macId", inventory.macId);
+        result.insert("chipId", inventory.chipId);
+        result.insert("flashId", inventory.flashId);
+        setOperationData(result);
+        return res;
+    });
 }
 
-void EspInterface::quitThread() {
-    if(mEsp && mEsp->isPortOpen()) {
-        mArgs.clear();
-        startOperation(opQuit);
-    }
+QFuture<EspResult<QByteArray> > EspInterface::readFlash(quint32 address, quint32 size) {
+    return submit<QByteArray>(opReadFlash, [this, address, size](EspRom *esp, QByteArray &data) -> bool {
+        data = esp->flashRead(address, size);
+        setOperationData(QVariant(data));
+        return !data.isNull();
+    });
+}
+
+QFuture<EspResult<bool> > EspInterface::readFlashFile(quint32 address, quint32 size, const QString &fileName) {
+    return submit<bool>(opReadFlash, [this, address, size, fileName](EspRom *esp, bool &res) -> bool {
+        // Streamed to the file as it arrives, the result data is the file name
+        QFile file(fileName);
+        if(file.open(QIODevice::WriteOnly)) {
+            res = esp->flashRead(address, size, &file);
+            setOperationData(QVariant(fileName));
+        } else {
+            esp->setLastError(QString("Unable to open %1").arg(fileName));
+            res = false;
+        }
+        return res;
+    });
+}
+
+QFuture<EspResult<EspWriteStats> > EspInterface::writeFlash(quint32 address, const QByteArray &data, bool reboot) {
+    EspRom::WriteOptions options = mWriteOptions;
+    return submit<EspWriteStats>(opWriteFlash, [this, address, data, reboot, options](EspRom *esp, EspWriteStats &stats) -> bool {
+        esp->setWriteOptions(options);
+        bool res = esp->flashWrite(address, data, reboot, EspRom::dio, EspRom::size32m, EspRom::freq40m);
+        stats = esp->lastWriteStats();
+        setWriteStats(stats);
+        return res;
+    });
+}
+
+QFuture<EspResult<EspWriteStats> > EspInterface::writeFlashFile(quint32 address, const QString &fileName, bool reboot) {
+    EspRom::WriteOptions options = mWriteOptions;
+    return submit<EspWriteStats>(opWriteFlash, [this, address, fileName, reboot, options](EspRom *esp, EspWriteStats &stats) -> bool {
+        // Streamed from the file, mapped in memory when possible
+        QFile file(fileName);
+        if(!file.open(QIODevice::ReadOnly)) {
+            esp->setLastError(QString("Unable to open %1").arg(fileName));
+            return false;
+        }
+
+        esp->setWriteOptions(options);
+        EspImageSource source(&file);
+        bool res = esp->flashWrite(address, source, reboot, EspRom::dio, EspRom::size32m, EspRom::freq40m);
+        stats = esp->lastWriteStats();
+        setWriteStats(stats);
+        return res;
+    });
+}
+
+QFuture<EspResult<EspWriteStats> > EspInterface::writeFlashBlob(const FlashBlob &blob, bool reboot) {
+    EspRom::WriteOptions options = mWriteOptions;
+    return submit<EspWriteStats>(opWriteBlob, [this, blob, reboot, options](EspRom *esp, EspWriteStats &stats) -> bool {
+        esp->setWriteOptions(options);
+        bool res = esp->flashWriteBlob(blob, reboot, EspRom::dio, EspRom::size32m, EspRom::freq40m);
+        stats = esp->lastWriteStats();
+        setWriteStats(stats);
+        return res;
+    });
+}
+
+QFuture<EspResult<bool> > EspInterface::rebootFw() {
+    return submit<bool>(opRebootFw, [](EspRom *esp, bool &res) -> bool {
+        res = esp->rebootFw();
+        return res;
+    });
+}
+
+QFuture<EspResult<bool> > EspInterface::quitThread() {
+    return submit<bool>(opQuit, [](EspRom *, bool &res) -> bool {
+        res = true;
+        return res;
+    });
 }
 
 void EspInterface::startOperation(EspInterface::EspOperations operation) {
-    mOperation = operation;
-    mMutex.lock();
-    mOperationPending.wakeAll();
-    mMutex.unlock();
+    // Operations that take no arguments
+    switch(operation) {
+    case opConnect: connectEsp(); break;
+    case opChipId: chipId(); break;
+    case opFlashId: flashId(); break;
+    case opInventory: deviceInventory(); break;
+    case opRebootFw: rebootFw(); break;
+    case opQuit: quitThread(); break;
+    default: qDebug("EspInterface::startOperation operation %d needs arguments", operation); break;
+    }
 }
 
 void EspInterface::run() {
     qDebug("EspInterface::run thread start %s@%d",mPort.toLatin1().constData(),mBaud);
     mEsp = new EspRom(mPort, mBaud, 0);
+    mEsp->setTelemetry(&mTelemetry);
+    mEsp->setTrace(mTrace);
     connect(mEsp,SIGNAL(flasherProgress(int)),this,SLOT(onFlasherProgress(int)));
 
     if(!mEsp->isPortOpen()) {
-        emit operationCompleted(opPortOpen, 0);
         setLastError(mEsp->lastError());
+        emit operationCompleted(opPortOpen, 0);
     } else {
-        while(mEsp->isPortOpen() && mOperation != opQuit) {
-            mMutex.lock();
-            mOperationPending.wait(&mMutex);
-            mMutex.unlock();
-
-            mOperationResult = false;
-            mOperationData.clear();
-
-            if(mOperation == opConnect) {
-                mOperationResult = mEsp->syncEsp();
-
-            } else if(mOperation == opChipId) {
-                quint32 chipid = mEsp->chipId();
-                mOperationData.fromValue(chipid);
-                mOperationResult = chipid != 0;
-
-            } else if(mOperation == opFlashId) {
-                quint32 flashid = mEsp->flashId();
-                mOperationData = QVariant(flashid);
-                mOperationResult = flashid != 0;
-
-            } else if(mOperation == opReadFlash) {
-                quint32 address = mArgs.at(0).toInt();
-                quint32 size = mArgs.at(1).toInt();
-                mOperationData = QVariant(mEsp->flashRead(address,size));
-                mOperationResult = !mOperationData.isNull();
-
-            } else if(mOperation == opWriteFlash) {
-                quint32 address = mArgs.at(0).toInt();
-                QByteArray data = mArgs.at(1).toByteArray();
-                bool reboot = mArgs.at(2).toBool();
-                mOperationResult = mEsp->flashWrite(address, data, reboot, EspRom::dio, EspRom::size32m, EspRom::freq40m);
-
-            } else if(mOperation == opRebootFw) {
-                mOperationResult = mEsp->rebootFw();
-
-            } else if(mOperation == opQuit) {
-                mOperationResult = true;
-            }
-
-            if(!mOperationResult) setLastError(mEsp->lastError());
-            if(mOperation != opQuit) emit operationCompleted(mOperation, mOperationResult);
-        }
+        while(mEsp->isPortOpen()) {
+            mJobsPending.acquire();
+            // The job is counted once its push completed, but an earlier
+            // push may still be linking it in
+            EspJob *job;
+            while(!(job = mJobs.pop())) QThread::yieldCurrentThread();
+
+            int operation = job->operation();
+            setOperationData(QVariant());
+            bool result = job->run(mEsp);
+            delete job;
 
-        delete mEsp;
+            if(!result) setLastError(mEsp->lastError());
+            if(operation == opQuit) break;
+            emit operationCompleted(operation, result);
+        }
     }
 
+    // Whatever is still queued will never run
+    mStopped.storeRelease(1);
+    cancelJobs();
+    delete mEsp;
+    mEsp = 0;
     emit operationCompleted(opQuit, true);
 }
 
-void EspInterface::onThreadStarted() {
-    qDebug("EspInterface::onThreadStarted");
-    // Dirty trick to wait that thread exec the first istructions
-    thread()->msleep(100);
-    // Connect with esp8266
-    startOperation(opConnect);
+void EspInterface::cancelJobs() {
+    QMutexLocker locker(&mCancelLock);
+    while(mJobsPending.tryAcquire()) {
+        EspJob *job;
+        while(!(job = mJobs.pop())) QThread::yieldCurrentThread();
+        QString error = lastError();
+        job->cancel(error.isEmpty() ? QString(ERR_NotRunning) : error);
+        delete job;
+    }
+}
+
+QVariant EspInterface::operationResultData() const {
+    QMutexLocker locker(&mStateLock);
+    return mOperationData;
+}
+
+EspWriteStats EspInterface::writeStats() const {
+    QMutexLocker locker(&mStateLock);
+    return mWriteStats;
+}
+
+QString EspInterface::lastError() const {
+    QMutexLocker locker(&mStateLock);
+    return mLastError;
+}
+
+void EspInterface::setLastError(const QString &error) {
+    QMutexLocker locker(&mStateLock);
+    mLastError = error;
+}
+
+void EspInterface::setOperationData(const QVariant &data) {
+    QMutexLocker locker(&mStateLock);
+    mOperationData = data;
+}
+
+void EspInterface::setWriteStats(const EspWriteStats &stats) {
+    QMutexLocker locker(&mStateLock);
+    mWriteStats = stats;
 }
 
 void EspInterface::onFlasherProgress(int written) {
     emit flasherProgress(written);
 }
-
@@ -28,46 +28,75 @@
 #include <QThread>
 #include <QList>
 #include <QPair>
-#include <QWaitCondition>
+#include <QSemaphore>
+#include <QAtomicInt>
 #include <QMutex>
 #include <QVariant>
 
-typedef QList< QPair<quint32, QByteArray> > FlashBlob;
+#include "esprom.h"
+#include "espjobqueue.h"
 
-class EspRom;
+// Runs the operations on an EspRom owned by a worker thread. Every request
+// is queued as a job and returns a future with its typed result; any number
+// of requests may be queued back to back, they run in order. Completion is
+// also signalled with operationCompleted() for callers driven by signals.
 class EspInterface : public QThread {
     Q_OBJECT
 public:
-    enum EspOperations {opPortOpen,opConnect,opChipId,opFlashId,opReadFlash,opWriteFlash, opRebootFw, opQuit};
+    enum EspOperations {opPortOpen,opConnect,opChipId,opFlashId,opReadFlash,opWriteFlash, opRebootFw, opInventory, opWriteBlob, opQuit};
     EspInterface(const QString &port, quint32 baud, QObject *parent=0);
-    QVariant operationResultData() const { return mOperationData; }
-    void connectEsp();
-    void chipId();
-    void flashId();
-    void readFlash(quint32 address, quint32 size);
-    void writeFlash(quint32 address, const QByteArray &data, bool reboot);
-    void rebootFw();
-    void quitThread();
+    EspInterface(const QString &port, quint32 baud, const QString &traceFile, QObject *parent=0);
+    ~EspInterface();
+    QVariant operationResultData() const;
+    QFuture<EspResult<bool> > connectEsp();
+    QFuture<EspResult<quint32> > chipId();
+    QFuture<EspResult<quint32> > flashId();
+    QFuture<EspResult<EspInventory> > deviceInventory();
+    QFuture<EspResult<QByteArray> > readFlash(quint32 address, quint32 size);
+    QFuture<EspResult<bool> > readFlashFile(quint32 address, quint32 size, const QString &fileName);
+    QFuture<EspResult<EspWriteStats> > writeFlash(quint32 address, const QByteArray &data, bool reboot);
+    QFuture<EspResult<EspWriteStats> > writeFlashFile(quint32 address, const QString &fileName, bool reboot);
+    QFuture<EspResult<EspWriteStats> > writeFlashBlob(const FlashBlob &blob, bool reboot);
+    QFuture<EspResult<bool> > rebootFw();
+    QFuture<EspResult<bool> > quitThread();
     void startOperation(EspOperations operation);
-    QString lastError() const { return mLastError; }
-    void setLastError(const QString &error) { mLastError = error; }
+    void setWriteOptions(EspRom::WriteOptions options) { mWriteOptions = options; }
+    EspWriteStats writeStats() const;
+    void setAutoBaud(bool enable) { mAutoBaud = enable; }
+    void setResumeJournal(const QString &fileName) { mResumeJournal = fileName; }
+    QString lastError() const;
+    EspTelemetrySnapshot telemetry() const { return mTelemetry.snapshot(); }
+    void setLastError(const QString &error);
 protected:
     virtual void run();
 private slots:
-    void onThreadStarted();
     void onFlasherProgress(int written);
+private:
+    template<typename T> QFuture<EspResult<T> > submit(EspOperations operation, const typename EspTypedJob<T>::Function &function);
+    void cancelJobs();
+    void setOperationData(const QVariant &data);
+    void setWriteStats(const EspWriteStats &stats);
 private:
     QString mPort;
     int mBaud;
 private:
-    QMutex mMutex;
-    QWaitCondition mOperationPending;
-    EspOperations mOperation;
-    QList<QVariant> mArgs;
-    bool mOperationResult;
+    EspJobQueue mJobs;
+    QSemaphore mJobsPending;
+    QAtomicInt mStopped;
+    // The queue has a single consumer, jobs are cancelled one caller at a time
+    QMutex mCancelLock;
+    // Results are written by the worker and read from any thread
+    mutable QMutex mStateLock;
     QVariant mOperationData;
     EspRom *mEsp;
+    // Outlives the session of the worker thread, readable from any thread
+    EspTelemetry mTelemetry;
+    EspTraceRecorder *mTrace;
     QString mLastError;
+    EspRom::WriteOptions mWriteOptions;
+    bool mAutoBaud;
+    QString mResumeJournal;
+    EspWriteStats mWriteStats;
 signals:
     void operationCompleted(int operation, bool result);
     void flasherProgress(int written);
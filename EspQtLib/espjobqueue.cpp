@@ -0,0 +1,70 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espjobqueue.h"
+
+EspJobQueue::EspJobQueue() : mHead(&mStub), mTail(&mStub) {
+}
+
+EspJobQueue::~EspJobQueue() {
+    EspJob *job;
+    while((job = pop())) {
+        job->cancel(QString());
+        delete job;
+    }
+}
+
+void EspJobQueue::push(EspJob *job) {
+    job->mNext.storeRelease(0);
+    EspJob *prev = mHead.fetchAndStoreOrdered(job);
+    prev->mNext.storeRelease(job);
+}
+
+EspJob *EspJobQueue::pop() {
+    EspJob *tail = mTail;
+    EspJob *next = tail->mNext.loadAcquire();
+
+    // The stub node keeps the list non empty, it is skipped on the way out
+    if(tail == &mStub) {
+        if(!next) return 0;
+        mTail = next;
+        tail = next;
+        next = next->mNext.loadAcquire();
+    }
+
+    if(next) {
+        mTail = next;
+        return tail;
+    }
+
+    // Last job in the list: put the stub back behind it before taking it
+    if(tail != mHead.loadAcquire()) return 0;
+    push(&mStub);
+    next = tail->mNext.loadAcquire();
+    if(next) {
+        mTail = next;
+        return tail;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPJOBQUEUE_H
+#define ESPJOBQUEUE_H
+
+#include <QAtomicPointer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QString>
+
+#include <functional>
+
+#include "esprom.h"
+
+// Outcome of an operation run by EspInterface: a typed value, or the reason
+// it failed
+template<typename T> class EspResult {
+public:
+    EspResult() : ok(false), value() { }
+    EspResult(bool o, const T &v, const QString &e=QString()) : ok(o), value(v), error(e) { }
+public:
+    bool ok;
+    T value;
+    QString error;
+};
+
+// An operation waiting in the queue of EspInterface. Jobs are linked
+// intrusively, queueing never allocates beyond the job itself.
+class EspJob {
+public:
+    EspJob(int operation) : mOperation(operation), mNext(0) { }
+    virtual ~EspJob() { }
+    int operation() const { return mOperation; }
+    virtual bool run(EspRom *esp) = 0;
+    virtual void cancel(const QString &error) = 0;
+private:
+    friend class EspJobQueue;
+    int mOperation;
+    QAtomicPointer<EspJob> mNext;
+};
+
+// A job whose function fills a value of type T, delivered through a future
+template<typename T> class EspTypedJob : public EspJob {
+public:
+    typedef std::function<bool(EspRom *, T &)> Function;
+    EspTypedJob(int operation, const Function &function) : EspJob(operation), mFunction(function) { mInterface.reportStarted(); }
+    ~EspTypedJob() { if(!mInterface.isFinished()) cancel(QString()); }
+    QFuture<EspResult<T> > future() { return mInterface.future(); }
+    virtual bool run(EspRom *esp);
+    virtual void cancel(const QString &error) { finish(EspResult<T>(false, T(), error)); }
+private:
+    void finish(const EspResult<T> &result) { mInterface.reportResult(result); mInterface.reportFinished(); }
+private:
+    Function mFunction;
+    QFutureInterface<EspResult<T> > mInterface;
+};
+
+// Lock free multiple producer, single consumer queue of jobs. Any thread may
+// push, only the worker pops. A push is two atomic stores, pop() may briefly
+// see an empty queue while a concurrent push is between them.
+class EspJobQueue {
+public:
+    EspJobQueue();
+    ~EspJobQueue();
+    void push(EspJob *job);
+    EspJob *pop();
+private:
+    class StubJob : public EspJob {
+    public:
+        StubJob() : EspJob(-1) { }
+        virtual bool run(EspRom *) { return false; }
+        virtual void cancel(const QString &) { }
+    };
+    QAtomicPointer<EspJob> mHead;
+    EspJob *mTail;
+    StubJob mStub;
+private:
+    Q_DISABLE_COPY(EspJobQueue)
+};
+
+template<typename T> bool EspTypedJob<T>::run(EspRom *esp) {
+    T value = T();
+    bool ok = mFunction(esp, value);
+    finish(EspResult<T>(ok, value, ok ? QString() : esp->lastError()));
+    return ok;
+}
+
+// Calls callback with the result of future once it is ready, in the thread of
+// context. Qt 5 futures have no continuations, this is how multi-step flows
+// are chained: each step queues the next from the callback of the previous.
+template<typename T, typename F> void espThen(const QFuture<T> &future, QObject *context, F callback) {
+    QFutureWatcher<T> *watcher = new QFutureWatcher<T>(context);
+    QObject::connect(watcher, &QFutureWatcherBase::finished, context, [watcher, callback]() {
+        callback(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(future);
+}
+
+#endif // ESPJOBQUEUE_H
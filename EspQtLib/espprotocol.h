@@ -0,0 +1,92 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPPROTOCOL_H
+#define ESPPROTOCOL_H
+
+// Wire protocol shared by EspRom, EspFlasher and EspAsyncRom: one set of
+// opcodes, timeouts and error messages for the blocking and the event
+// driven engine.
+
+// These are the currently known commands supported by the ROM
+#define ESP_NULL        0x00
+#define ESP_FLASH_BEGIN 0x02
+#define ESP_FLASH_DATA  0x03
+#define ESP_FLASH_END   0x04
+#define ESP_MEM_BEGIN   0x05
+#define ESP_MEM_END     0x06
+#define ESP_MEM_DATA    0x07
+#define ESP_SYNC        0x08
+#define ESP_WRITE_REG   0x09
+#define ESP_READ_REG    0x0a
+
+// Commands of the Cesanta flasher stub
+#define CMD_FLASH_WRITE 1
+#define CMD_FLASH_READ 2
+#define CMD_FLASH_DIGEST 3
+#define CMD_FLASH_READ_CHIP_ID 4
+#define CMD_FLASH_ERASE_CHIP 5
+#define CMD_BOOT_FW 6
+
+// Greeting the stub sends once it runs
+#define ESP_STUB_GREETING "OHAI"
+
+// Default baudrate. The ROM auto-bauds, so we can use more or less whatever we want.
+#define ESP_ROM_BAUD    115200
+
+// Time each reset line is held
+#define ESP_RESET_PULSE     50
+// Reply timeout of a sync attempt and time the extra sync replies are drained for
+#define ESP_SYNC_TIMEOUT    100
+// Sync attempts before giving up
+#define ESP_SYNC_ATTEMPTS   7
+
+// Time allowed to the stub to start and send its greeting
+#define ESP_STUB_GREETING_TIMEOUT 200
+// Time allowed to the stub to send the next read block, digest or status
+#define ESP_STUB_REPLY_TIMEOUT 1000
+// Longest wait for a write ack, the erase of a 64 KB block may hold one back
+#define ESP_WRITE_ACK_TIMEOUT 5000
+// Time allowed to the stub to hash the next digest block
+#define ESP_DIGEST_TIMEOUT 3000
+
+// Read block size and bytes in flight: small enough for the FIFO of the
+// USB serial adapter, the transfer has no flow control
+#define ESP_READ_BLOCK 32
+#define ESP_READ_IN_FLIGHT 64
+// Read progress is reported every this many bytes
+#define ESP_READ_PROGRESS_STEP 0x1000
+
+#define ERR_PortOpen    "%1 Port open failed"
+#define ERR_NotSynced   "Connect to device failed"
+#define ERR_StubNotRunning  "Flasher stub not responding"
+#define ERR_ReadError  "Read error"
+#define ERR_ExpectedStatusCode  "Expected status, got %1"
+#define ERR_ExpectedDigest "Expected digest, got: %1"
+#define ERR_DigestMismatch "Digest mismatch got:%1 expected:%2"
+#define ERR_WrongArgument "Wrong argument: %1"
+#define ERR_WriteFailure "Write failure, status: %1"
+#define ERR_UnexpectedData "Unexpected data received"
+
+#endif // ESPPROTOCOL_H
@@ -0,0 +1,190 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espreplay.h"
+#include "espslip.h"
+
+#include <QFile>
+#include <QThread>
+#include <QtEndian>
+
+#include <string.h>
+
+// Replies released and not read yet, kept allocated for the whole replay
+#define ESP_REPLAY_READ_BUFFER  0x4000
+
+#define ERR_ReplayOpen  "Unable to open trace file %1"
+
+bool EspReplayScript::load(const QString &fileName) {
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)) {
+        mErrorString = QString(ERR_ReplayOpen).arg(fileName);
+        return false;
+    }
+
+    EspTraceReader reader(&file);
+    if(!reader.readHeader()) {
+        mErrorString = reader.errorString();
+        return false;
+    }
+    label = reader.label();
+
+    // Frames were recorded decoded, they are framed again as they were on the wire
+    EspSlipEncoder encoder;
+    EspTraceRecord record;
+    quint64 previousUs = 0;
+    // Start of the raw data run the host is sending, -1 between frames
+    int rawStart = -1;
+    sent.clear();
+    replies.clear();
+    baudRate = 0;
+    while(reader.next(record)) {
+        switch(record.type) {
+        case EspTraceRecord::FrameSent:
+            encoder.encode(record.data);
+            sent.append(encoder.data(), encoder.size());
+            rawStart = -1;
+            break;
+        case EspTraceRecord::RawSent:
+            if(rawStart < 0) rawStart = sent.size();
+            sent.append(record.data);
+            break;
+        case EspTraceRecord::FrameReceived: {
+            EspReplayStep step;
+            step.gate = sent.size();
+            // The acks of a stub write count the bytes received. The host
+            // sizes its window on the round trips it measures, which differ
+            // from run to run, so an ack waits for the bytes it counts rather
+            // than for what the host had sent when it was recorded.
+            if(rawStart >= 0 && record.data.size() == 4) {
+                quint32 acked = qFromLittleEndian<quint32>((const uchar *)record.data.constData());
+                step.gate = qMin<quint64>(step.gate, rawStart + acked);
+            }
+            // Replies are played in order
+            if(!replies.isEmpty()) step.gate = qMax(step.gate, replies.last().gate);
+            step.delayUs = record.timeUs - previousUs;
+            encoder.encode(record.data);
+            step.data = QByteArray(encoder.data(), encoder.size());
+            replies.append(step);
+            break;
+        }
+        case EspTraceRecord::BaudRate:
+            if(baudRate == 0 && record.data.size() == 4) baudRate = qFromLittleEndian<quint32>((const uchar *)record.data.constData());
+            break;
+        default:
+            break;
+        }
+        previousUs = record.timeUs;
+    }
+    durationUs = previousUs;
+
+    // A trace cut short still replays up to the cut
+    mErrorString = reader.errorString();
+    return true;
+}
+
+EspReplayDevice::EspReplayDevice(const EspReplayScript &script, double timeScale, QObject *parent) : QIODevice(parent), mScript(script), mTimeScale(timeScale), mNowUs(0), mWritten(0), mDivergence(-1),
+    mGateUs(script.replies.size(), 0), mGated(0), mNext(0), mLastReplyUs(0), mReadPos(0) {
+    mReadBuffer.reserve(ESP_REPLAY_READ_BUFFER);
+    open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    unlock();
+}
+
+qint64 EspReplayDevice::bytesAvailable() const {
+    pump();
+    return mReadBuffer.size() - mReadPos + QIODevice::bytesAvailable();
+}
+
+bool EspReplayDevice::waitForReadyRead(int msecs) {
+    if(bytesAvailable() > 0) return true;
+
+    qint64 next = nextReplyUs();
+    if(next >= 0 && (msecs < 0 || next - mNowUs <= (qint64)msecs * 1000)) {
+        if(mTimeScale > 0) QThread::usleep((next - mNowUs) * mTimeScale);
+        mNowUs = next;
+        return bytesAvailable() > 0;
+    }
+
+    // The device stays silent for the whole wait, as it did when recorded
+    if(msecs > 0) {
+        if(mTimeScale > 0) QThread::usleep((qint64)msecs * 1000 * mTimeScale);
+        mNowUs += (qint64)msecs * 1000;
+    }
+    return false;
+}
+
+qint64 EspReplayDevice::readData(char *data, qint64 maxSize) {
+    pump();
+    int len = qMin<qint64>(maxSize, mReadBuffer.size() - mReadPos);
+    memcpy(data, mReadBuffer.constData() + mReadPos, len);
+    mReadPos += len;
+    if(mReadPos == mReadBuffer.size()) {
+        // The reserved capacity is kept, reading does not allocate
+        mReadBuffer.resize(0);
+        mReadPos = 0;
+    }
+    return len;
+}
+
+qint64 EspReplayDevice::writeData(const char *data, qint64 size) {
+    if(mDivergence < 0) {
+        qint64 expected = qMin<qint64>(size, mScript.sent.size() - mWritten);
+        const char *recorded = mScript.sent.constData() + mWritten;
+        if(memcmp(data, recorded, expected) != 0) {
+            qint64 i = 0;
+            while(data[i] == recorded[i]) i++;
+            mDivergence = mWritten + i;
+        } else if(size > expected) {
+            mDivergence = mScript.sent.size();
+        }
+        if(mDivergence >= 0) qDebug("EspReplayDevice host output diverges from the recording at byte %lld", mDivergence);
+    }
+
+    mWritten += size;
+    unlock();
+    return size;
+}
+
+void EspReplayDevice::unlock() {
+    while(mGated < mScript.replies.size() && mScript.replies.at(mGated).gate <= mWritten) {
+        mGateUs[mGated++] = mNowUs;
+    }
+}
+
+void EspReplayDevice::pump() const {
+    while(mNext < mGated) {
+        const EspReplayStep &step = mScript.replies.at(mNext);
+        qint64 available = qMax(mGateUs.at(mNext), mLastReplyUs) + step.delayUs;
+        if(available > mNowUs) break;
+        mReadBuffer.append(step.data);
+        mLastReplyUs = available;
+        mNext++;
+    }
+}
+
+qint64 EspReplayDevice::nextReplyUs() const {
+    // Replies still waiting for the host to send more never come
+    if(mNext >= mGated) return -1;
+    return qMax(mGateUs.at(mNext), mLastReplyUs) + mScript.replies.at(mNext).delayUs;
+}
@@ -0,0 +1,111 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPREPLAY_H
+#define ESPREPLAY_H
+
+#include <QIODevice>
+#include <QVector>
+#include <QString>
+
+#include "esptrace.h"
+
+// One reply of a recorded device, ready to be fed back
+class EspReplayStep {
+public:
+    EspReplayStep() : gate(0), delayUs(0) { }
+public:
+    // Host bytes sent before the reply in the recording
+    quint64 gate;
+    // Time from the previous record to the reply
+    quint64 delayUs;
+    // The reply, SLIP framed as it came on the wire
+    QByteArray data;
+};
+
+// A recorded session turned into the exact byte stream the host sent and the
+// replies of the device. Built once from a trace, shared by any number of
+// replays.
+class EspReplayScript {
+public:
+    EspReplayScript() : baudRate(0), durationUs(0) { }
+    bool load(const QString &fileName);
+    QString errorString() const { return mErrorString; }
+public:
+    QByteArray sent;
+    QVector<EspReplayStep> replies;
+    // First rate of the recording, the one the ROM was talked to at
+    int baudRate;
+    quint64 durationUs;
+    QString label;
+private:
+    QString mErrorString;
+};
+
+// Plays the device side of a recorded session to an EspRom. Each reply is
+// released once the host has sent everything that came before it in the
+// recording, and the recorded delay has passed. Time is virtual: it only
+// moves while the host waits for data, so a timeout in the recording is a
+// timeout in the replay and every run takes the same path, however fast the
+// host is. Waits sleep for their virtual length scaled by timeScale: 1 keeps
+// the original timing, 0 runs as fast as the host can.
+// What the host writes is compared with the recording byte by byte, the
+// first difference is reported by divergenceOffset().
+class EspReplayDevice : public QIODevice {
+    Q_OBJECT
+public:
+    EspReplayDevice(const EspReplayScript &script, double timeScale=0.0, QObject *parent=0);
+    virtual bool isSequential() const { return true; }
+    virtual qint64 bytesAvailable() const;
+    virtual bool waitForReadyRead(int msecs);
+    virtual bool waitForBytesWritten(int) { return true; }
+    bool isComplete() const { return mNext == mScript.replies.size() && mWritten == (quint64)mScript.sent.size(); }
+    qint64 divergenceOffset() const { return mDivergence; }
+    quint64 bytesWritten() const { return mWritten; }
+    int repliesPlayed() const { return mNext; }
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 size);
+private:
+    void pump() const;
+    void unlock();
+    qint64 nextReplyUs() const;
+private:
+    const EspReplayScript &mScript;
+    double mTimeScale;
+    qint64 mNowUs;
+    quint64 mWritten;
+    qint64 mDivergence;
+    // Virtual time each reply was unlocked by the host
+    QVector<qint64> mGateUs;
+    int mGated;
+    // Released replies are appended here, pump() runs from const readers.
+    // mLastReplyUs is the virtual time the last one became available.
+    mutable int mNext;
+    mutable qint64 mLastReplyUs;
+    mutable QByteArray mReadBuffer;
+    mutable int mReadPos;
+};
+
+#endif // ESPREPLAY_H
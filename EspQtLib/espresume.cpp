@@ -0,0 +1,142 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espresume.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#define ESP_RESUME_VERSION  1
+
+#define ERR_ResumeRead  "Unable to read resume journal %1"
+#define ERR_ResumeWrite "Unable to write resume journal %1"
+
+void EspResumeJournal::setFileName(const QString &fileName) {
+    if(fileName == mFileName) return;
+    mFileName = fileName;
+    mLoaded = false;
+}
+
+quint32 EspResumeJournal::acked(quint32 address, quint32 size, const QByteArray &digest) {
+    load();
+    int index = indexOf(address);
+    if(index < 0) return 0;
+
+    const EspResumeEntry &entry = mEntries.at(index);
+    if(entry.size != size || entry.digest != digest) return 0;
+    return qMin(entry.acked, size);
+}
+
+void EspResumeJournal::setAcked(quint32 address, quint32 size, const QByteArray &digest, quint32 acked) {
+    load();
+    int index = indexOf(address);
+    if(index < 0) {
+        index = mEntries.size();
+        mEntries.append(EspResumeEntry());
+    }
+
+    EspResumeEntry &entry = mEntries[index];
+    entry.address = address;
+    entry.size = size;
+    entry.digest = digest;
+    entry.acked = acked;
+}
+
+void EspResumeJournal::remove(quint32 address) {
+    load();
+    int index = indexOf(address);
+    if(index >= 0) mEntries.removeAt(index);
+}
+
+bool EspResumeJournal::save() {
+    if(mFileName.isEmpty()) return true;
+
+    // Nothing left to resume, the journal goes away
+    if(mEntries.isEmpty()) {
+        if(QFile::exists(mFileName) && !QFile::remove(mFileName)) {
+            mErrorString = QString(ERR_ResumeWrite).arg(mFileName);
+            return false;
+        }
+        return true;
+    }
+
+    QJsonArray writes;
+    foreach(const EspResumeEntry &entry, mEntries) {
+        QJsonObject item;
+        item.insert("address", (double)entry.address);
+        item.insert("size", (double)entry.size);
+        item.insert("md5", QString(entry.digest.toHex()));
+        item.insert("acked", (double)entry.acked);
+        writes.append(item);
+    }
+    QJsonObject root;
+    root.insert("version", ESP_RESUME_VERSION);
+    root.insert("writes", writes);
+
+    // Replaced in one step, a crash while saving leaves the previous journal
+    QSaveFile file(mFileName);
+    if(!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson()) < 0 || !file.commit()) {
+        mErrorString = QString(ERR_ResumeWrite).arg(mFileName);
+        return false;
+    }
+    return true;
+}
+
+void EspResumeJournal::load() {
+    if(mLoaded) return;
+    mLoaded = true;
+    if(mFileName.isEmpty() || !QFile::exists(mFileName)) return;
+
+    QFile file(mFileName);
+    QJsonObject root;
+    if(file.open(QIODevice::ReadOnly)) root = QJsonDocument::fromJson(file.readAll()).object();
+    if(root.value("version").toInt() != ESP_RESUME_VERSION) {
+        // A journal that can not be trusted only costs a full write
+        mErrorString = QString(ERR_ResumeRead).arg(mFileName);
+        qDebug("EspResumeJournal::load %s", mErrorString.toLatin1().constData());
+        return;
+    }
+
+    mEntries.clear();
+    QJsonArray writes = root.value("writes").toArray();
+    for(int i=0;i<writes.size();i++) {
+        QJsonObject item = writes.at(i).toObject();
+        EspResumeEntry entry;
+        entry.address = (quint32)item.value("address").toDouble();
+        entry.size = (quint32)item.value("size").toDouble();
+        entry.digest = QByteArray::fromHex(item.value("md5").toString().toLatin1());
+        entry.acked = (quint32)item.value("acked").toDouble();
+        mEntries.append(entry);
+    }
+}
+
+int EspResumeJournal::indexOf(quint32 address) const {
+    for(int i=0;i<mEntries.size();i++) {
+        if(mEntries.at(i).address == address) return i;
+    }
+    return -1;
+}
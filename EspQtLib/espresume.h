@@ -0,0 +1,68 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPRESUME_H
+#define ESPRESUME_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// How far an interrupted flash write went
+class EspResumeEntry {
+public:
+    EspResumeEntry() : address(0), size(0), acked(0) { }
+public:
+    quint32 address;
+    quint32 size;
+    // MD5 of the whole image, the entry only applies to the same image
+    QByteArray digest;
+    // Image bytes acknowledged by the stub, not necessarily in flash yet
+    quint32 acked;
+};
+
+// Progress of the writes that did not complete, one entry per flash address.
+// Kept in memory for the session and, when a file is set, saved as JSON so
+// that the write can be resumed by another process after a restart.
+class EspResumeJournal {
+public:
+    EspResumeJournal() : mLoaded(false) { }
+    void setFileName(const QString &fileName);
+    QString fileName() const { return mFileName; }
+    quint32 acked(quint32 address, quint32 size, const QByteArray &digest);
+    void setAcked(quint32 address, quint32 size, const QByteArray &digest, quint32 acked);
+    void remove(quint32 address);
+    bool save();
+    QString errorString() const { return mErrorString; }
+private:
+    void load();
+    int indexOf(quint32 address) const;
+private:
+    QString mFileName;
+    bool mLoaded;
+    QList<EspResumeEntry> mEntries;
+    QString mErrorString;
+};
+
+#endif // ESPRESUME_H
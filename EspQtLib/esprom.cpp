@@ -23,35 +23,35 @@
  */
 
 #include "esprom.h"
-#include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QElapsedTimer>
 #include <QSerialPort>
+#include <QSerialPortInfo>
+#include <QSettings>
 #include <QThread>
 #include <QVector>
 #include <QtEndian>
+#include <QtConcurrent>
 #include <QDebug>
 
-#include "espflasher.h"
+#include <string.h>
+#include <algorithm>
 
-// These are the currently known commands supported by the ROM
-#define ESP_NULL        0x00
-#define ESP_FLASH_BEGIN 0x02
-#define ESP_FLASH_DATA  0x03
-#define ESP_FLASH_END   0x04
-#define ESP_MEM_BEGIN   0x05
-#define ESP_MEM_END     0x06
-#define ESP_MEM_DATA    0x07
-#define ESP_SYNC        0x08
-#define ESP_WRITE_REG   0x09
-#define ESP_READ_REG    0x0a
+#include "espprotocol.h"
+#include "espflasher.h"
+#include "espimage.h"
+#include "espflashplan.h"
+#include "espstub.h"
+#include "esptrace.h"
 
 // Maximum block sized for RAM and Flash writes, respectively.
 #define ESP_RAM_BLOCK   0x1800
 #define ESP_FLASH_BLOCK 0x400
 
-// Default baudrate. The ROM auto-bauds, so we can use more or less whatever we want.
-#define ESP_ROM_BAUD    115200
+// Response timeouts in milliseconds
+#define ESP_ERASE_TIMEOUT_PER_MB    30000
+
+// Commands sent ahead of their replies by commandPipeline()
+#define ESP_PIPELINE_DEPTH          4
 
 // First byte of the application image
 #define ESP_IMAGE_MAGIC 0xe9
@@ -61,36 +61,52 @@
 #define ESP_OTP_MAC1    0x3ff00054
 #define ESP_OTP_MAC3    0x3ff0005c
 
-#define ERR_PortOpen    "%1 Port open failed"
-#define ERR_NotSynced   "Connect to device failed"
+// Rates tried by the baud rate negotiation, fastest first
+#define ESP_BAUD_LADDER     (QList<int>() << 2000000 << 1500000 << 921600 << 460800 << 230400 << ESP_ROM_BAUD)
+// Flash read used to confirm a rate: data both ways plus an MD5 check
+#define ESP_BAUD_PROBE_SIZE 0x400
 
-typedef struct {
-    quint8 resp;
-    quint8 op_ret;
-    quint16 len_ret;
-    quint32 val;
-} RetCmdStruct;
+// Acknowledged bytes between two saves of the resume journal
+#define ESP_RESUME_SAVE_STEP    0x10000
+
+#define ERR_ImageRead   "Unable to read image data"
+#define ERR_BlobOverlap "Segments at 0x%1 and 0x%2 overlap"
+#define ERR_StubSession "Register access needs the ROM, end the flasher stub session first"
 
-EspRom::EspRom(const QString &port, int baud, QObject *parent) : QObject(parent), mIsSynced(false), mPort(0), mBaudRate(baud), mPartialPacket(false),mEspFlasher(NULL) {
-    mPort = new QSerialPort(port, this);
-    mPort->setBaudRate(baud);
+EspRom::EspRom(const QString &port, int baud, QObject *parent) : EspRom(new QSerialPort(port), baud, parent) {
+    mPort->setParent(this);
     if(!mPort->open(QIODevice::ReadWrite)) {
         setLastError(QString(ERR_PortOpen).arg(port));
     }
 }
 
+EspRom::EspRom(QIODevice *device, int baud, QObject *parent) : QObject(parent), mIsSynced(false), mDevice(device), mPort(qobject_cast<QSerialPort *>(device)), mLinkBaudRate(0), mBaudRate(baud), mRomBaudRate(baud), mAutoBaud(false), mBaudNegotiated(false), mBaudLadder(ESP_BAUD_LADDER), mEspFlasher(NULL), mWriteOptions(WriteDefault), mProgressBase(0), mTelemetry(&mOwnTelemetry), mTrace(0) {
+    mCommandBuffer.reserve(ESP_RAM_BLOCK + 24);
+    mClock.start();
+    setBaudRate(baud);
+}
+
 bool EspRom::syncEsp() {
-    if(mPort->isOpen()) {
+    if(mDevice->isOpen()) {
         qDebug("EspRom::connect");
-        mPort->setDataTerminalReady(false);
-        mPort->setRequestToSend(true);
-        thread()->msleep(50);
-        mPort->setDataTerminalReady(true);
-        mPort->setRequestToSend(false);
-        thread()->msleep(50);
-        mPort->setDataTerminalReady(false);
-
-        mPort->flush();
+        // The reset below ends any stub session
+        clearFlasher();
+        mIsSynced = false;
+        // A stub may have moved the link to another rate, the ROM listens on the initial one
+        setBaudRate(mRomBaudRate);
+        mDecoder.reset();
+        // Only a serial port has reset lines, on other links the chip must
+        // already be in the bootloader
+        if(mPort) {
+            mPort->setDataTerminalReady(false);
+            mPort->setRequestToSend(true);
+            thread()->msleep(ESP_RESET_PULSE);
+            mPort->setDataTerminalReady(true);
+            mPort->setRequestToSend(false);
+            thread()->msleep(ESP_RESET_PULSE);
+            mPort->setDataTerminalReady(false);
+            mPort->flush();
+        }
         if(sync()) {
             return true;
         } else {
@@ -101,32 +117,147 @@ bool EspRom::syncEsp() {
     return false;
 }
 
+bool EspRom::attachStub() {
+    if(mEspFlasher) {
+        return true;
+    }
+
+    // A stub left running by a previous connection keeps the rate it was started at
+    QList<int> rates;
+    QString key = adapterKey();
+    if(!key.isEmpty()) {
+        int cached = QSettings("EspQtLib", "EspQtLib").value(key, 0).toInt();
+        if(cached > 0 && cached != mBaudRate) rates << cached;
+    }
+    rates << mBaudRate;
+
+    foreach(int rate, rates) {
+        setBaudRate(rate);
+        mDecoder.reset();
+        EspFlasher *flasher = new EspFlasher(this, rate, false);
+        if(flasher->ping()) {
+            qDebug("EspRom::attachStub stub already running at %d baud", rate);
+            mBaudRate = rate;
+            mBaudNegotiated = mAutoBaud;
+            mEspFlasher = flasher;
+            connect(mEspFlasher, SIGNAL(progress(int)), this ,SLOT(onFlasherProgress(int)));
+            return true;
+        }
+        delete flasher;
+    }
+
+    setBaudRate(mRomBaudRate);
+    return false;
+}
+
 bool EspRom::isPortOpen() {
-    return mPort->isOpen();
+    return mDevice->isOpen();
 }
 
 void EspRom::waitForReadyRead(int ms) {
-    mPort->waitForBytesWritten(ms);
+    mDevice->waitForBytesWritten(ms);
 }
 
 quint32 EspRom::portBaudRate() {
-    return mPort->baudRate();
+    return mPort ? mPort->baudRate() : mLinkBaudRate;
 }
 
 void EspRom::setBaudRate(int baudRate) {
-    mPort->setBaudRate(baudRate);
+    if(mPort) mPort->setBaudRate(baudRate);
+    mLinkBaudRate = baudRate;
+    mTelemetry->setBaudRate(baudRate);
+    if(mTrace) mTrace->baudRate(baudRate);
+}
+
+void EspRom::setTelemetry(EspTelemetry *telemetry) {
+    mTelemetry = telemetry ? telemetry : &mOwnTelemetry;
+    mTelemetry->setBaudRate(portBaudRate());
+}
+
+void EspRom::setTrace(EspTraceRecorder *trace) {
+    // Tracing costs a pointer test per frame while it is off
+    mTrace = trace;
+    if(mTrace) mTrace->baudRate(portBaudRate());
 }
 
 quint64 EspRom::portWrite(const QByteArray &data) {
-    //qDebug("EspRom::portWrite size:%d",data.size());
-    return mPort->isOpen() ? mPort->write(data) : 0;
+    return portWrite(data.constData(), data.size());
+}
+
+quint64 EspRom::portWrite(const char *data, int len) {
+    if(!mDevice->isOpen()) return 0;
+    mTelemetry->addRaw(len);
+    if(mTrace) mTrace->record(EspTraceRecord::RawSent, data, len);
+    return mDevice->write(data, len);
 }
 
 QByteArray EspRom::macId() {
-    quint32 mac0 = readReg(ESP_OTP_MAC0);
-    quint32 mac1 = readReg(ESP_OTP_MAC1);
-    quint32 mac3 = readReg(ESP_OTP_MAC3);
+    EspRegBatch regs;
+    regs << EspRegOp(EspRegOp::Read, ESP_OTP_MAC0) << EspRegOp(EspRegOp::Read, ESP_OTP_MAC1) << EspRegOp(EspRegOp::Read, ESP_OTP_MAC3);
+    regBatch(regs);
+    return macFromOtp(regs.at(0).value, regs.at(1).value, regs.at(2).value);
+}
+
+quint32 EspRom::chipId() {
+    EspRegBatch regs;
+    regs << EspRegOp(EspRegOp::Read, ESP_OTP_MAC0) << EspRegOp(EspRegOp::Read, ESP_OTP_MAC1);
+    regBatch(regs);
+    return chipIdFromOtp(regs.at(0).value, regs.at(1).value);
+}
+
+quint32 EspRom::flashId() {
+    // The stub reads the id itself, no need to go back to the ROM
+    quint32 id;
+    if(mEspFlasher && mEspFlasher->flashId(id)) {
+        return id;
+    }
+
+    if(!ensureRom()) return 0;
+    QList<PipelinedCommand> cmds;
+    cmds << PipelinedCommand(ESP_FLASH_BEGIN, flashBeginData(0, 0));
+    appendFlashIdCommands(cmds);
+    cmds << PipelinedCommand(ESP_FLASH_END, flashFinishData(false));
+    commandPipeline(cmds);
+    return cmds.at(3).val;
+}
+
+bool EspRom::regBatch(EspRegBatch &regs) {
+    if(!ensureRom()) return false;
+    QList<PipelinedCommand> cmds;
+    for(int i=0;i<regs.size();i++) {
+        const EspRegOp &reg = regs.at(i);
+        if(reg.type == EspRegOp::Read) cmds << PipelinedCommand(ESP_READ_REG, readRegData(reg.address));
+        else cmds << PipelinedCommand(ESP_WRITE_REG, writeRegData(reg.address, reg.value, reg.mask, reg.delayUs));
+    }
+
+    bool res = commandPipeline(cmds);
+    for(int i=0;i<regs.size();i++) {
+        regs[i].ok = cmds.at(i).ok;
+        if(regs.at(i).type == EspRegOp::Read) regs[i].value = cmds.at(i).ok ? cmds.at(i).val : 0;
+    }
+    return res;
+}
+
+bool EspRom::deviceInventory(EspInventory &inventory) {
+    if(!ensureRom()) return false;
+
+    // OTP reads, then the flash id sequence of flashId(), all in one burst
+    QList<PipelinedCommand> cmds;
+    cmds << PipelinedCommand(ESP_READ_REG, readRegData(ESP_OTP_MAC0));
+    cmds << PipelinedCommand(ESP_READ_REG, readRegData(ESP_OTP_MAC1));
+    cmds << PipelinedCommand(ESP_READ_REG, readRegData(ESP_OTP_MAC3));
+    cmds << PipelinedCommand(ESP_FLASH_BEGIN, flashBeginData(0, 0));
+    appendFlashIdCommands(cmds);
+    cmds << PipelinedCommand(ESP_FLASH_END, flashFinishData(false));
+
+    bool res = commandPipeline(cmds);
+    inventory.macId = macFromOtp(cmds.at(0).val, cmds.at(1).val, cmds.at(2).val);
+    inventory.chipId = chipIdFromOtp(cmds.at(0).val, cmds.at(1).val);
+    inventory.flashId = cmds.at(6).val;
+    return res;
+}
 
+QByteArray EspRom::macFromOtp(quint32 mac0, quint32 mac1, quint32 mac3) {
     QByteArray oui(6,'\0');
     if(mac3 != 0) {
         oui[0] = (mac3 >> 16) & 0xFF;
@@ -151,163 +282,457 @@ QByteArray EspRom::macId() {
     return oui;
 }
 
-quint32 EspRom::chipId() {
-    quint32 id0 = readReg(ESP_OTP_MAC0);
-    quint32 id1 = readReg(ESP_OTP_MAC1);
-    return (id0 >> 24) | ((id1 & 0xFFFFFF) << 8);
+quint32 EspRom::chipIdFromOtp(quint32 mac0, quint32 mac1) {
+    return (mac0 >> 24) | ((mac1 & 0xFFFFFF) << 8);
 }
 
-quint32 EspRom::flashId() {
-    flashBegin(0,0);
-    writeReg(0x60000240, 0x0, 0xFFFFFFFF);
-    writeReg(0x60000200, 0x10000000, 0xFFFFFFFF);
-    quint32 flashId = readReg(0x60000240);
-    flashFinish(false);
-    return flashId;
+void EspRom::appendFlashIdCommands(QList<PipelinedCommand> &cmds) {
+    cmds << PipelinedCommand(ESP_WRITE_REG, writeRegData(0x60000240, 0x0, 0xFFFFFFFF));
+    cmds << PipelinedCommand(ESP_WRITE_REG, writeRegData(0x60000200, 0x10000000, 0xFFFFFFFF));
+    cmds << PipelinedCommand(ESP_READ_REG, readRegData(0x60000240));
 }
 
 QByteArray EspRom::flashRead(quint32 address, int size) {
-    EspFlasher flasher(this, mBaudRate);
-    return flasher.flashRead(address, size);
+    if(!createFlasher()) return QByteArray();
+
+    QByteArray data = mEspFlasher->flashRead(address, size);
+    if(data.isEmpty()) setLastError(mEspFlasher->lastError());
+    return data;
+}
+
+bool EspRom::flashRead(quint32 address, quint32 size, QIODevice *sink) {
+    if(!createFlasher()) return false;
+
+    if(!mEspFlasher->flashRead(address, size, sink)) {
+        setLastError(mEspFlasher->lastError());
+        return false;
+    }
+    return true;
+}
+
+bool EspRom::flashDigest(quint32 address, quint32 size, QByteArray &digest) {
+    if(!createFlasher()) return false;
+
+    QList<QByteArray> blocks;
+    if(!mEspFlasher->flashDigest(blocks, address, size, 0, &digest)) {
+        setLastError(mEspFlasher->lastError());
+        return false;
+    }
+    return true;
 }
 
-bool EspRom::flashWrite(quint32 address, QByteArray &data, bool reboot, FlashMode mode, FlashSize size, FlashSizeFreq freq) {
-    createFlasher();
+bool EspRom::eraseFlash() {
+    if(!createFlasher()) return false;
 
-    if(address == 0 && (quint8)data.at(0) == 0xE9) {
-        data[2] = (quint8)mode;
-        data[3] = (quint8)size + (quint8)freq;
+    if(!mEspFlasher->eraseChip()) {
+        setLastError(mEspFlasher->lastError());
+        return false;
+    }
+    return true;
+}
+
+void EspRom::prepareImage(quint32 address, QByteArray &data, FlashMode mode, FlashSize size, FlashSizeFreq freq) {
+    // Only touch the array when something changes, a prepared image shared
+    // between several writers is never detached
+    if(address == 0 && data.size() >= 4 && (quint8)data.at(0) == 0xE9) {
+        char flashMode = (char)mode;
+        char flashSizeFreq = (char)((quint8)size + (quint8)freq);
+        if(data.at(2) != flashMode) data[2] = flashMode;
+        if(data.at(3) != flashSizeFreq) data[3] = flashSizeFreq;
     }
 
     if(data.size() % ESP_FLASH_SECTOR != 0) {
         data.append(QByteArray(ESP_FLASH_SECTOR - (data.size() % ESP_FLASH_SECTOR), (char)0xFF));
-        qDebug("EspRom::flashWrite data expanded to size %d", data.size());
+        qDebug("EspRom::prepareImage data expanded to size %d", data.size());
     }
+}
 
-    if(!mEspFlasher->flashWrite(address, data)) {
-        qDebug("EspRom::flashWrite %s", mEspFlasher->lastError().toLatin1().constData());
-        clearFlasher();
-    } else {
-        if(reboot) {
-            thread()->msleep(100);
-            bool res = mEspFlasher->bootFw();
+void EspWriteStats::add(const EspWriteStats &other) {
+    // Flow figures are weighted by the time each write took
+    qint64 busy = elapsedMs + other.elapsedMs;
+    linkUtilisation = busy ? (linkUtilisation * elapsedMs + other.linkUtilisation * other.elapsedMs) / busy : 0.0;
+    if(other.ackRttUs && (!ackRttUs || other.ackRttUs < ackRttUs)) ackRttUs = other.ackRttUs;
+    window = qMax(window, other.window);
+
+    payloadBytes += other.payloadBytes;
+    wireBytes += other.wireBytes;
+    skippedBytes += other.skippedBytes;
+    resumedBytes += other.resumedBytes;
+    elapsedMs = busy;
+    verified = verified && other.verified;
+    mismatchedBlocks += other.mismatchedBlocks;
+}
+
+bool EspRom::flashWrite(quint32 address, const QByteArray &data, bool reboot, FlashMode mode, FlashSize size, FlashSizeFreq freq) {
+    EspImageSource source(data);
+    return flashWrite(address, source, reboot, mode, size, freq);
+}
+
+bool EspRom::flashWrite(quint32 address, EspImageSource &source, bool reboot, FlashMode mode, FlashSize size, FlashSizeFreq freq) {
+    QList<quint32> addresses;
+    QList<EspImageSource *> sources;
+    addresses << address;
+    sources << &source;
+    return writeSegments(addresses, sources, reboot, mode, size, freq);
+}
+
+static bool segmentBefore(const QPair<quint32, QByteArray> &a, const QPair<quint32, QByteArray> &b) {
+    return a.first < b.first;
+}
+
+bool EspRom::flashWriteBlob(const FlashBlob &blob, bool reboot, FlashMode mode, FlashSize size, FlashSizeFreq freq) {
+    // Segments are written in address order and must not overlap once padded
+    FlashBlob sorted = blob;
+    std::stable_sort(sorted.begin(), sorted.end(), segmentBefore);
+    QList<quint32> addresses;
+    QList<EspImageSource *> sources;
+    for(int i=0;i<sorted.size();i++) {
+        addresses << sorted.at(i).first;
+        sources << new EspImageSource(sorted.at(i).second);
+        if(i > 0 && addresses.at(i - 1) + sources.at(i - 1)->size() > addresses.at(i)) {
+            setLastError(QString(ERR_BlobOverlap).arg(addresses.at(i - 1), 6, 16, QChar('0')).arg(addresses.at(i), 6, 16, QChar('0')));
+            qDeleteAll(sources);
+            return false;
+        }
+    }
+
+    bool res = writeSegments(addresses, sources, reboot, mode, size, freq);
+    qDeleteAll(sources);
+    return res;
+}
+
+bool EspRom::writeSegments(const QList<quint32> &addresses, const QList<EspImageSource *> &sources, bool reboot, FlashMode mode, FlashSize size, FlashSizeFreq freq) {
+    // Blank sectors of plain writes are planned before the stub is started,
+    // while the ROM can still erase them without any data on the link
+    QVector<EspFlashRanges> blank(sources.size()), erased(sources.size());
+    bool planBlank = (mWriteOptions & WriteSkipBlank) && !(mWriteOptions & WriteDifferential);
+    bool anyBlank = false;
+    for(int i=0;i<sources.size();i++) {
+        EspImageSource &source = *sources.at(i);
+        if(addresses.at(i) == 0) source.patchHeader((quint8)mode, (quint8)size + (quint8)freq);
+        if(!planBlank || source.isSequential()) continue;
+
+        if(!EspFlashPlan::blankRanges(source, blank[i], ESP_FLASH_SECTOR) || !source.rewind()) {
+            setLastError(ERR_ImageRead);
+            return false;
+        }
+        anyBlank = anyBlank || !blank.at(i).isEmpty();
+    }
+
+    if(anyBlank && !mEspFlasher && (mIsSynced || syncEsp())) {
+        for(int i=0;i<sources.size();i++) {
+            if(!blank.at(i).isEmpty()) erased[i] = eraseBlank(addresses.at(i), blank.at(i), sources.at(i)->size());
+        }
+    }
+
+    // One stub session for all the segments, progress counts across them
+    if(!createFlasher()) return false;
+
+    EspWriteStats total;
+    mProgressBase = 0;
+    for(int i=0;i<sources.size();i++) {
+        quint32 address = addresses.at(i);
+        EspImageSource &source = *sources.at(i);
+
+        bool written = writeImage(address, source, blank.at(i), erased.at(i));
+        QString error = written ? QString() : mEspFlasher->lastError();
+        // A link that turns out to be unstable under load is retried one rate
+        // lower. The error is kept aside, a failed re-sync leaves no flasher
+        while(!written && mAutoBaud && mEspFlasher && mEspFlasher->lastErrorCode() != EspFlasher::WrongArguments) {
+            if(!source.rewind() || !stepDownBaudRate()) break;
+            qDebug("EspRom::flashWrite retrying at %d baud", mBaudRate);
+            mTelemetry->addRetry();
+            written = writeImage(address, source, blank.at(i), erased.at(i));
+            if(!written) error = mEspFlasher->lastError();
+        }
+
+        if(i == 0) total = mWriteStats;
+        else total.add(mWriteStats);
+
+        if(!written) {
+            qDebug("EspRom::flashWrite %s", error.toLatin1().constData());
+            setLastError(error);
+            mWriteStats = total;
+            mProgressBase = 0;
             clearFlasher();
-            return res;
-        } else {
-            return true;
+            return false;
         }
+        mProgressBase += source.size();
     }
+    mWriteStats = total;
+    mProgressBase = 0;
 
-    return false;
+    if(reboot) {
+        thread()->msleep(100);
+        bool res = mEspFlasher->bootFw();
+        clearFlasher();
+        return res;
+    }
+    return true;
+}
+
+EspFlashRanges EspRom::eraseBlank(quint32 address, const EspFlashRanges &blank, quint32 imageSize) {
+    EspFlashRanges erased;
+    for(int i=0;i<blank.size();i++) {
+        const EspFlashRange &range = blank.at(i);
+        // The erase size of flashBegin works around the ROM erase bug, which
+        // rounds a short odd run up by one sector. That is only harmless when
+        // the next sector is image data, erased again when it is written
+        quint32 sector = (address + range.offset) / ESP_FLASH_SECTOR;
+        quint32 sectors = range.size / ESP_FLASH_SECTOR;
+        quint32 head = qMin(16 - sector % 16, sectors);
+        bool exact = sectors >= 2 * head || sectors % 2 == 0;
+        if(!exact && range.end() >= imageSize) continue;
+
+        if(!flashBegin(range.size, address + range.offset)) {
+            qDebug("EspRom::eraseBlank erase of 0x%06X failed", address + range.offset);
+            break;
+        }
+        erased.append(range);
+    }
+
+    qDebug("EspRom::eraseBlank %d of %d blank bytes erased by the ROM", EspFlashPlan::rangesSize(erased), EspFlashPlan::rangesSize(blank));
+    return erased;
+}
+
+bool EspRom::writeImage(quint32 address, EspImageSource &source, const EspFlashRanges &blank, const EspFlashRanges &erased) {
+    bool written;
+    quint32 resumed = 0;
+
+    // Plain writes stream from the source and hash each sector on the way,
+    // the differential plan needs the whole image at hand.
+    // Only plain writes are resumed, a differential one skips what is
+    // already in flash anyway
+    QList<QByteArray> hostDigests;
+    if(mWriteOptions & WriteDifferential) {
+        QByteArray data = source.readAll();
+        if(data.isEmpty()) {
+            setLastError(ERR_ImageRead);
+            return false;
+        }
+
+        QFuture<QList<QByteArray> > digests;
+        if(mWriteOptions & WriteVerify) digests = QtConcurrent::run(EspFlashPlan::blockDigests, data, ESP_FLASH_SECTOR);
+
+        written = mEspFlasher->flashWriteChanged(address, data);
+        if(mWriteOptions & WriteVerify) hostDigests = digests.result();
+    } else if(!blank.isEmpty()) {
+        written = mEspFlasher->flashWriteSparse(address, source, blank, erased, (mWriteOptions & WriteVerify) ? &hostDigests : 0);
+    } else if((mWriteOptions & WriteResume) || mAutoBaud) {
+        // An auto-baud step down restarts the stub, the retry goes on from
+        // what the failed attempt had acknowledged
+        written = writeResumable(address, source, (mWriteOptions & WriteVerify) ? &hostDigests : 0, resumed);
+    } else {
+        written = mEspFlasher->flashWrite(address, source, (mWriteOptions & WriteVerify) ? &hostDigests : 0);
+    }
+    mWriteStats = mEspFlasher->writeStats();
+    mWriteStats.resumedBytes = resumed;
+
+    if(written && (mWriteOptions & WriteVerify)) {
+        written = mEspFlasher->flashVerify(address, source.size(), hostDigests, mWriteStats.mismatchedBlocks);
+        mWriteStats.verified = true;
+    }
+    return written;
 }
 
 bool EspRom::rebootFw() {
-    createFlasher();
+    if(!createFlasher()) return false;
     bool res = mEspFlasher->bootFw();
     clearFlasher();
     return res;
 }
 
+bool EspRom::writeResumable(quint32 address, EspImageSource &source, QList<QByteArray> *sectorDigests, quint32 &resumed) {
+    resumed = 0;
+    QList<QByteArray> hostDigests;
+    QByteArray imageDigest;
+    if(source.isSequential() || !EspFlashPlan::sourceDigests(source, hostDigests, imageDigest, ESP_FLASH_SECTOR)) {
+        qDebug("EspRom::flashWrite image can not be read twice, not resumable");
+        return mEspFlasher->flashWrite(address, source, sectorDigests);
+    }
+
+    // The stub acknowledges what it received, not what is in flash: the
+    // prefix of an earlier attempt is checked sector by sector
+    quint32 acked = mResume.acked(address, source.size(), imageDigest) / ESP_FLASH_SECTOR * ESP_FLASH_SECTOR;
+    if(acked) {
+        QList<QByteArray> deviceDigests;
+        if(mEspFlasher->flashDigest(deviceDigests, address, acked, ESP_FLASH_SECTOR)) {
+            int sectors = 0;
+            while(sectors < deviceDigests.size() && deviceDigests.at(sectors) == hostDigests.at(sectors)) sectors++;
+            resumed = sectors * ESP_FLASH_SECTOR;
+        }
+        qDebug("EspRom::flashWrite resuming at 0x%06X, %u of %u acknowledged bytes in flash", address + resumed, resumed, acked);
+    }
+
+    mResumeWrite.address = address;
+    mResumeWrite.size = source.size();
+    mResumeWrite.digest = imageDigest;
+    mResumeWrite.acked = resumed;
+    mResume.setAcked(address, source.size(), imageDigest, resumed);
+    saveResumeJournal();
+
+    bool written = mEspFlasher->flashWriteRange(address, source, resumed, source.size() - resumed, sectorDigests);
+    if(written) {
+        mResume.remove(address);
+        // The digests of the resumed sectors were computed above
+        if(sectorDigests) *sectorDigests = hostDigests;
+    } else {
+        mResume.setAcked(address, source.size(), imageDigest, qMax(resumed, mEspFlasher->ackedBytes()));
+    }
+    mResumeWrite = EspResumeEntry();
+    saveResumeJournal();
+    return written;
+}
+
+void EspRom::saveResumeJournal() {
+    // The write goes on without it, but it can no longer be resumed by another process
+    if(!mResume.save()) qDebug("EspRom::flashWrite %s", mResume.errorString().toLatin1().constData());
+}
+
 void EspRom::onFlasherProgress(int written) {
-    emit flasherProgress(written);
+    // A resumable write is journaled now and then, a process that dies
+    // without failing cleanly still finds most of its progress
+    if(mResumeWrite.size && (quint32)written >= mResumeWrite.acked + ESP_RESUME_SAVE_STEP) {
+        mResumeWrite.acked = written;
+        mResume.setAcked(mResumeWrite.address, mResumeWrite.size, mResumeWrite.digest, written);
+        saveResumeJournal();
+    }
+    emit flasherProgress(mProgressBase + written);
 }
 
-bool EspRom::command(quint8 op,const QByteArray &data, quint32 chk) {
+bool EspRom::command(quint8 op,const QByteArray &data, quint32 chk, int timeout) {
     if(op) {
-        quint8 i = 0;
-        quint16 size = data.size();
-        QByteArray pkt(size+8, 0);
-
-        mLastReturnVal = 0;
-        mLastRetData.clear();
-
-        pkt[i++] = 0x00;
-        pkt[i++] = op;
-        pkt[i++] = (size & 0x00FF);
-        pkt[i++] = (size & 0xFF00) >> 8;
-        pkt[i++] = (chk & 0x000000FF);
-        pkt[i++] = (chk & 0x0000FF00) >> 8;
-        pkt[i++] = (chk & 0x00FF0000) >> 16;
-        pkt[i++] = (chk & 0xFF000000) >> 24;
-        for(int i=0;i<data.size();i++) pkt[8+i] = data.at(i);
-        write(pkt);
-
-    }
-
-    for(int i=0; i<100; i++) {
-        mPort->waitForReadyRead(10);
-        if(read()) {
-            if(mLastPacket.size() < 8) continue;
-            RetCmdStruct *retdata = (RetCmdStruct *)(mLastPacket.constData());
-            //qDebug("EspRom::command %d",retdata->op_ret);
-            if(!op || op == retdata->op_ret) {
-                mLastReturnVal = retdata->val;
-                mLastRetData = mLastPacket.mid(8);
-                return true;
-            }
-        }
+        sendCommand(op, data, chk);
+        return waitResponse(op, timeout);
     }
 
+    // No command: just wait for the next response of any kind
+    QElapsedTimer timer;
+    timer.start();
+    quint8 replyOp;
+    while(readTimeout(timeout - timer.elapsed())) {
+        if(!parseResponse(mLastPacket, replyOp, mLastReturnVal)) continue;
+        mLastRetData = mLastPacket.mid(8);
+        return true;
+    }
     return false;
 }
 
-bool EspRom::readTimeout(int timeout) {
-    timeout = timeout<10 ? 1 : timeout / 10;
-    for(int i=0;i<100;i++) {
-        waitForReadyRead(10);
-        if(read()) {
+void EspRom::buildCommand(QByteArray &packet, quint8 op, const QByteArray &data, quint32 chk) {
+    quint16 size = data.size();
+    packet.resize(size + 8);
+    uchar *pkt = (uchar *)packet.data();
+
+    pkt[0] = 0x00;
+    pkt[1] = op;
+    qToLittleEndian(size, pkt + 2);
+    qToLittleEndian(chk, pkt + 4);
+    memcpy(pkt + 8, data.constData(), size);
+}
+
+void EspRom::sendCommand(quint8 op, const QByteArray &data, quint32 chk) {
+    buildCommand(mCommandBuffer, op, data, chk);
+    mLastReturnVal = 0;
+    mLastRetData.clear();
+    mPendingOps.append(qMakePair(op, mClock.nsecsElapsed()));
+    write(mCommandBuffer);
+}
+
+bool EspRom::waitResponse(quint8 op, int timeout) {
+    QElapsedTimer timer;
+    timer.start();
+
+    quint8 replyOp;
+    quint32 val;
+    while(readTimeout(timeout - timer.elapsed())) {
+        if(!parseResponse(mLastPacket, replyOp, val)) continue;
+
+        // Replies nobody is waiting for (e.g. to a command that timed out) are dropped
+        int pending = pendingIndex(replyOp);
+        if(pending < 0) {
+            qDebug("EspRom::waitResponse unexpected reply to op %02X", replyOp);
+            continue;
+        }
+        // The round trip runs from the send, pipelined commands wait in line
+        // before their reply is looked at
+        qint64 sentNs = mPendingOps.takeAt(pending).second;
+
+        if(replyOp == op) {
+            mTelemetry->addCommandRtt((mClock.nsecsElapsed() - sentNs) / 1000);
+            mLastReturnVal = val;
+            mLastRetData = mLastPacket.mid(8);
             return true;
         }
     }
+
+    int pending = pendingIndex(op);
+    if(pending >= 0) mPendingOps.removeAt(pending);
+    mTelemetry->addTimeout();
     return false;
 }
 
-bool EspRom::read() {
-    mInputBuffer.append(mPort->readAll());
-    if(mInputBuffer.length() == 0) {
-        return false;
+int EspRom::pendingIndex(quint8 op) const {
+    for(int i=0;i<mPendingOps.size();i++) {
+        if(mPendingOps.at(i).first == op) return i;
     }
+    return -1;
+}
 
-    bool endOfPacket = false;
-    bool in_escape = false;
-
-    int i;
-    for(i=0;i<mInputBuffer.length();i++) {
-        quint8 byte = mInputBuffer.at(i);
-        if(!mPartialPacket) {
-            if(byte == 0xC0) {
-                //qDebug("EspRom::read packet start");
-                mLastPacket.clear();
-                mPartialPacket = true;
-            }
-        } else if(in_escape) {
-            in_escape = false;
-            if(byte == 0xDC) {
-                mLastPacket.append(0xC0);
-            } else if(byte == 0xDD) {
-                mLastPacket.append(0xDB);
-            } else {
-                qDebug("EspRom::read invalid escape squence %02X", byte);
-            }
-        } else if(byte == 0xDB) {
-            in_escape = true;
-        } else if(byte == 0xC0) {
-            //qDebug("EspRom::read packet end");
-            mPartialPacket = false;
-            endOfPacket = true;
-            //qDebug("EspRom::read packet:%s", mLastPacket.toHex().toUpper().constData());
-            break;
-        } else {
-            mLastPacket.append(byte);
+bool EspRom::commandPipeline(QList<PipelinedCommand> &cmds) {
+    // Keep a few commands in flight, the ROM answers them in order
+    int sent = 0;
+    bool res = true;
+    for(int done=0; done<cmds.size(); done++) {
+        while(res && sent < cmds.size() && sent - done < ESP_PIPELINE_DEPTH) {
+            sendCommand(cmds.at(sent).op, cmds.at(sent).data);
+            sent++;
+        }
+
+        PipelinedCommand &cmd = cmds[done];
+        cmd.ok = done < sent && waitResponse(cmd.op, ESP_DEFAULT_TIMEOUT);
+        cmd.ok = cmd.ok && isStatusOk(mLastRetData);
+        if(cmd.ok) {
+            cmd.val = mLastReturnVal;
+        } else if(res) {
+            qDebug("EspRom::commandPipeline command %d op %02X failed", done, cmd.op);
+            res = false;
         }
     }
 
-    if(i>0) {
-        mInputBuffer = mInputBuffer.mid(i+1);
+    if(!res) {
+        // Replies may now be out of step with the commands, start clean
+        while(readTimeout(ESP_SYNC_TIMEOUT)) {}
+        mPendingOps.clear();
     }
+    return res;
+}
 
-    //if(endOfPacket) qDebug("EspRom::read input:%s", mLastPacket.toHex().toUpper().constData());
-    return endOfPacket;
+bool EspRom::readTimeout(int timeout) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // Wake as soon as a byte arrives instead of sleeping on a fixed poll period
+    while(!read()) {
+        qint64 remaining = timeout - timer.elapsed();
+        if(remaining <= 0 || !mDevice->waitForReadyRead(remaining)) {
+            return read();
+        }
+    }
+    return true;
+}
+
+bool EspRom::read() {
+    if(!mDecoder.hasPacket()) {
+        int received = mDecoder.readFrom(mDevice);
+        if(received) mTelemetry->addReceived(received);
+        if(!mDecoder.hasPacket()) {
+            return false;
+        }
+    }
+
+    mLastPacket = mDecoder.takePacket();
+    if(mTrace) mTrace->record(EspTraceRecord::FrameReceived, mLastPacket);
+    return true;
 }
 
 const QByteArray &EspRom::lastPacketReaded() const {
@@ -315,107 +740,104 @@ const QByteArray &EspRom::lastPacketReaded() const {
 }
 
 void EspRom::write(quint8 arg1) {
-    QByteArray data(1, (char)arg1);
-    write(data);
+    char data = (char)arg1;
+    write(&data, 1);
 }
 
-void EspRom::write(quint32 arg1, quint32 arg2, quint32 arg3) {
-    QByteArray data(12,'\0');
-    uchar *ptrdata = (uchar *)data.data();
-
-    qToLittleEndian(arg1, ptrdata);
-    ptrdata += 4;
-    qToLittleEndian(arg2, ptrdata);
-    ptrdata += 4;
-    qToLittleEndian(arg3, ptrdata);
-    ptrdata += 4;
-
-    write(data);
+void EspRom::write(const QByteArray &packet) {
+    write(packet.constData(), packet.size());
 }
 
-void EspRom::write(quint32 arg1, quint32 arg2, quint32 arg3, quint32 arg4) {
-    QByteArray data(16,'\0');
-    uchar *ptrdata = (uchar *)data.data();
-
-    qToLittleEndian(arg1, ptrdata);
-    ptrdata += 4;
-    qToLittleEndian(arg2, ptrdata);
-    ptrdata += 4;
-    qToLittleEndian(arg3, ptrdata);
-    ptrdata += 4;
-    qToLittleEndian(arg4, ptrdata);
-    ptrdata += 4;
+void EspRom::write(const char *data, int len) {
+    mEncoder.encode(data, len);
+    mTelemetry->addFrame(len, mEncoder.size());
+    if(mTrace) mTrace->record(EspTraceRecord::FrameSent, data, len);
+    mDevice->write(mEncoder.data(), mEncoder.size());
+}
 
-    write(data);
+quint8 EspRom::checksum(const QByteArray &data, quint8 state) {
+    return EspChecksum::compute(data.constData(), data.size(), state);
 }
 
-void EspRom::write(const QByteArray &packet) {
-    int count = 2;
-    for(int i=0;i<packet.length();i++) {
-        quint8 byte = packet.at(i);
-        if(byte == 0xDB || byte == 0xC0) count++;
-    }
-
-    QByteArray output(packet.length()+count, 0x0);
-
-    int j = 0;
-    output[j++] = 0xC0;
-    for(int i=0; i<packet.size(); i++) {
-        quint8 byte = packet.at(i);
-        if(byte == 0xDB) {
-            output[j++] = 0xDB;
-            output[j++] = 0xDD;
-        } else if(byte == 0xC0) {
-            output[j++] = 0xDB;
-            output[j++] = 0xDC;
-        } else {
-            output[j++] = byte;
-        }
+bool EspRom::parseResponse(const QByteArray &packet, quint8 &op, quint32 &val) {
+    // Response header: direction, op, body length, value
+    if(packet.size() < 8 || (quint8)packet.at(0) != 0x01) {
+        return false;
     }
-
-    output[j++] = 0xC0;
-    if(output.size() < 64) qDebug("EspRom::write packet:%d %s", output.size(), output.toHex().toUpper().constData());
-    mPort->write(output);
+    op = (quint8)packet.at(1);
+    val = qFromLittleEndian<quint32>((const uchar *)packet.constData() + 4);
+    return true;
 }
 
-quint8 EspRom::checksum(const QByteArray &data, quint8 state) const {
-    for(int i=0;i<data.size();i++) {
-        quint8 b = (quint8)data.at(i);
-        state ^= b;
-    }
-    return state;
+bool EspRom::isStatusOk(const QByteArray &retData) {
+    return retData.size() == 2 && retData.at(0) == 0;
 }
 
 bool EspRom::sync() {
-    QByteArray data(36,0x55);
-    data[0] = 0x07;
-    data[1] = 0x07;
-    data[2] = 0x12;
-    data[3] = 0x20;
-
-    for(int i=0;i<7;i++) {
-        if(command(ESP_SYNC, data)) {
+    QByteArray data = syncData();
+    for(int i=0;i<ESP_SYNC_ATTEMPTS && !mIsSynced;i++) {
+        if(i > 0) mTelemetry->addRetry();
+        if(command(ESP_SYNC, data, 0, ESP_SYNC_TIMEOUT)) {
             mIsSynced = true;
         }
     }
 
-    while(mInputBuffer.size()>0) {
-        command();
-    }
+    // The ROM answers a single sync with several replies, drop the others
+    while(readTimeout(ESP_SYNC_TIMEOUT)) {}
+    mPendingOps.clear();
 
     return mIsSynced;
 }
 
 quint32 EspRom::readReg(quint32 addr) {
-    quint32 myaddr = qToLittleEndian(addr);
-    QByteArray data((const char *)&myaddr, sizeof(myaddr));
-    if(command(ESP_READ_REG, data)) {
+    if(command(ESP_READ_REG, readRegData(addr))) {
         return mLastReturnVal;
     }
     return 0;
 }
 
 bool EspRom::writeReg(quint32 addr, quint32 value, quint32 mask, quint32 delayUs) {
+    bool res = command(ESP_WRITE_REG, writeRegData(addr, value, mask, delayUs));
+    res = res && mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
+    if(!res) qDebug("Failed to write target memory");
+    return res;
+}
+
+bool EspRom::flashBegin(quint32 size, quint32 offset) {
+    quint32 erase_size;
+    QByteArray data = flashBeginData(size, offset, &erase_size);
+
+    int timeout = qMax<qint64>(ESP_DEFAULT_TIMEOUT, (qint64)ESP_ERASE_TIMEOUT_PER_MB * erase_size / 0x100000);
+    bool res = command(ESP_FLASH_BEGIN, data, 0, timeout);
+    res = res && mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
+
+    if(res)qDebug("EspRom::flashBegin %d %s", mLastReturnVal, mLastRetData.toHex().toUpper().constData());
+    return res;
+}
+
+bool EspRom::flashFinish(bool reboot) {
+    bool res = command(ESP_FLASH_END, flashFinishData(reboot));
+    res = res && mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
+    if(!res) qDebug("Failed to leave Flash mode");
+    return res;
+}
+
+QByteArray EspRom::syncData() {
+    QByteArray data(36,0x55);
+    data[0] = 0x07;
+    data[1] = 0x07;
+    data[2] = 0x12;
+    data[3] = 0x20;
+    return data;
+}
+
+QByteArray EspRom::readRegData(quint32 addr) {
+    QByteArray data(4,'\0');
+    qToLittleEndian(addr, (uchar *)data.data());
+    return data;
+}
+
+QByteArray EspRom::writeRegData(quint32 addr, quint32 value, quint32 mask, quint32 delayUs) {
     QByteArray data(16,'\0');
     uchar *ptrdata = (uchar *)data.data();
     qToLittleEndian(addr, ptrdata);
@@ -426,14 +848,10 @@ bool EspRom::writeReg(quint32 addr, quint32 value, quint32 mask, quint32 delayUs
     ptrdata += 4;
     qToLittleEndian(delayUs, ptrdata);
     ptrdata += 4;
-
-    bool res = command(ESP_WRITE_REG, data);
-    res = res && mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
-    if(!res) qDebug("Failed to write target memory");
-    return res;
+    return data;
 }
 
-bool EspRom::flashBegin(quint32 size, quint32 offset) {
+QByteArray EspRom::flashBeginData(quint32 size, quint32 offset, quint32 *eraseSize) {
     quint32 num_blocks = (size + ESP_FLASH_BLOCK - 1) / ESP_FLASH_BLOCK;
     quint32 sectors_per_block = 16;
     quint32 sector_size = ESP_FLASH_SECTOR;
@@ -442,6 +860,7 @@ bool EspRom::flashBegin(quint32 size, quint32 offset) {
     quint32 head_sectors = sectors_per_block - (start_sector % sectors_per_block);
     if(num_sectors < head_sectors) head_sectors = num_sectors;
     quint32 erase_size = num_sectors < 2 * head_sectors ? (num_sectors + 1) / 2 * sector_size : (num_sectors - head_sectors) * sector_size;
+    if(eraseSize) *eraseSize = erase_size;
 
     QByteArray data(16,'\0');
     uchar *ptrdata = (uchar *)data.data();
@@ -453,28 +872,16 @@ bool EspRom::flashBegin(quint32 size, quint32 offset) {
     ptrdata += 4;
     qToLittleEndian(offset, ptrdata);
     ptrdata += 4;
-
-    bool res = command(ESP_FLASH_BEGIN, data);
-    res =  mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
-
-    if(res)qDebug("EspRom::flashBegin %d %s", mLastReturnVal, mLastRetData.toHex().toUpper().constData());
-    return res;
+    return data;
 }
 
-bool EspRom::flashFinish(bool reboot) {
+QByteArray EspRom::flashFinishData(bool reboot) {
     QByteArray data(4,'\0');
-    uchar *ptrdata = (uchar *)data.data();
-    qToLittleEndian((int)(!reboot), ptrdata);
-
-    bool res = command(ESP_FLASH_END, data);
-    res = res && mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
-    if(!res) qDebug("Failed to leave Flash mode");
-    return res;
+    qToLittleEndian((quint32)(!reboot), (uchar *)data.data());
+    return data;
 }
 
-bool EspRom::memBegin(quint32 size,quint32  blocks,quint32  blocksize,quint32  offset) {
-    qDebug("EspRom::memBegin size:%d blocks:%d blocksize:%d offset:%d", size, blocks, blocksize, offset);
-
+QByteArray EspRom::memBeginData(quint32 size, quint32 blocks, quint32 blocksize, quint32 offset) {
     QByteArray data(16,'\0');
     uchar *ptrdata = (uchar *)data.data();
     qToLittleEndian(size, ptrdata);
@@ -485,17 +892,10 @@ bool EspRom::memBegin(quint32 size,quint32  blocks,quint32  blocksize,quint32  o
     ptrdata += 4;
     qToLittleEndian(offset, ptrdata);
     ptrdata += 4;
-
-    bool res = command(ESP_MEM_BEGIN, data);
-    res =  mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
-
-    if(!res) qDebug("EspRom::memBegin Failed to enter RAM download mode");
-    return res;
+    return data;
 }
 
-bool EspRom::memBlock(const QByteArray &block, quint32 seq) {
-    qDebug("EspRom::memBlock block size:%d seq:%d checksum:%d", block.size(), seq, checksum(block));
-
+QByteArray EspRom::memBlockData(const QByteArray &block, quint32 seq) {
     QByteArray data(16,'\0');
     uchar *ptrdata = (uchar *)data.data();
     qToLittleEndian(block.size(), ptrdata);
@@ -508,97 +908,115 @@ bool EspRom::memBlock(const QByteArray &block, quint32 seq) {
     ptrdata += 4;
 
     data.append(block);
-    bool res = command(ESP_MEM_DATA, data, checksum(block));
-    res =  mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
-
-    if(!res) qDebug("EspRom::memBlock Failed to write to target RAM");
-    return res;
+    return data;
 }
 
-bool EspRom::memFinish(quint32 entrypoint) {
+QByteArray EspRom::memFinishData(quint32 entrypoint) {
     QByteArray data(8,'\0');
     uchar *ptrdata = (uchar *)data.data();
     qToLittleEndian((int)(entrypoint == 0), ptrdata);
     ptrdata += 4;
     qToLittleEndian(entrypoint, ptrdata);
     ptrdata += 4;
+    return data;
+}
 
-    bool res = command(ESP_MEM_END, data);
-    res =  mLastRetData.size() == 2 && mLastRetData.at(0) == 0 && mLastRetData.at(1) == 0;
+bool EspRom::runStub(const EspStub &stub, QVector<quint32> params, bool readOutput) {
+    if(params.size()>0) qDebug("EspRom::runStub param1:%d", params.at(0));
 
-    if(!res) qDebug("EspRom::memFinish Failed to write to target RAM");
-    return res;
-}
+    if(!stub.isValid()) {
+        return false;
+    }
 
+    qDebug("EspRom::runStub code size:%d start:%d data size:%d start:%d entry:%d", stub.code.size(), stub.codeStart, stub.data.size(), stub.dataStart, stub.entry);
 
-bool EspRom::runStub(QString fileStub, QVector<quint32> params, bool readOutput) {
+    if(stub.numParams != params.size()) {
+        qDebug("Stub requires %d params, %d provided", stub.numParams, params.size());
+        return false;
+    }
+
+    // One command at a time, the entry point must not run after a failed download
+    QList<PipelinedCommand> upload = stubUpload(stub, params);
     bool res = true;
-    qDebug("EspRom::runStub file %s", fileStub.toLatin1().constData());
-    if(params.size()>0) qDebug("EspRom::runStub param1:%d", params.at(0));
+    for(int i=0; res && i<upload.size(); i++) {
+        const PipelinedCommand &cmd = upload.at(i);
+        res = command(cmd.op, cmd.data, cmd.chk) && isStatusOk(mLastRetData);
+        if(!res) qDebug("EspRom::runStub op %02X failed, unable to write to target RAM", cmd.op);
+    }
 
-    QFile file(fileStub);
-    if(file.open(QIODevice::ReadOnly)) {
-        QString val = file.readAll();
-        val.replace("\\\n","");
-        qDebug("EspRom::runStub file size:%d", val.size());
-
-        QJsonDocument d = QJsonDocument::fromJson(val.toUtf8());
-        QJsonObject stub = d.object();
-        QByteArray stubCode = QByteArray::fromHex(stub.value("code").toString("").toLatin1());
-        qDebug("EspRom::runStub stubCode size:%d", stubCode.size());
-        quint32 stubCodeStart = (quint32)(quint32)stub.value("code_start").toInt();
-        qDebug("EspRom::runStub stubCodeStart:%d", stubCodeStart);
-        QByteArray stubData = QByteArray::fromHex(stub.value("data").toString("").toLatin1());
-        qDebug("EspRom::runStub stubData ize:%d", stubData.size());
-        quint32 stubDataStart = stub.value("data_start").toInt();
-        qDebug("EspRom::runStub stubDataStart:%d", stubDataStart);
-        int stubNumParams = stub.value("num_params").toInt();
-        qDebug("EspRom::runStub stubNumParams:%d", stubNumParams);
-        quint32 paramsStart = (quint32)stub.value("params_start").toInt();
-        qDebug("EspRom::runStub paramsStart:%d", paramsStart);
-        quint32 stubEntry = (quint32)stub.value("entry").toInt();
-        qDebug("EspRom::runStub stubEntry:%d", stubEntry);
-
-        if(stubNumParams != params.size()) {
-            qDebug("Stub requires %d params, %d provided", stubNumParams, params.size());
-            return false;
+    if(readOutput) {
+        qDebug("Stub executed, reading response:");
+        while(readTimeout(100)) {
+            qDebug("EspRom::runStub output:%s", mLastPacket.toHex().toUpper().constData());
         }
+    }
 
-        QByteArray data(sizeof(quint32)*stubNumParams, '\0');
-        qDebug("EspRom::runStub params buffer size:%d", data.size());
-        uchar *ptrdata = (uchar *)data.data();
-        for(int i=0; i<stubNumParams; i++) {
-            qToLittleEndian(params.at(i), ptrdata);
-            ptrdata += sizeof(quint32);
-        }
+    return res;
+}
 
-        data.append(stubCode);
-        res &= memBegin(data.size(), 1, data.size(), paramsStart);
-        res &= memBlock(data, 0);
-        if(stubData.size() > 0) {
-            res &= memBegin(stubData.size(), 1, stubData.size(), stubDataStart);
-            res &= memBlock(stubData, 0);
-        }
+QList<EspRom::PipelinedCommand> EspRom::stubUpload(const EspStub &stub, const QVector<quint32> &params) {
+    QList<PipelinedCommand> upload;
+    if(!stub.isValid() || stub.numParams != params.size()) {
+        return upload;
+    }
 
-        res &= memFinish(stubEntry);
-        if(readOutput) {
-            qDebug("Stub executed, reading response:");
-            while(readTimeout(100)) {
-                qDebug("AAAAAAAAAAAAAAA");
-            }
-        }
-    } else {
-        res = false;
+    // The parameters are loaded in front of the code
+    QByteArray code(sizeof(quint32)*stub.numParams, '\0');
+    uchar *ptrdata = (uchar *)code.data();
+    for(int i=0; i<stub.numParams; i++) {
+        qToLittleEndian(params.at(i), ptrdata);
+        ptrdata += sizeof(quint32);
     }
+    code.append(stub.code);
 
-    return res;
+    upload << PipelinedCommand(ESP_MEM_BEGIN, memBeginData(code.size(), 1, code.size(), stub.paramsStart));
+    upload << PipelinedCommand(ESP_MEM_DATA, memBlockData(code, 0), checksum(code));
+    if(stub.data.size() > 0) {
+        upload << PipelinedCommand(ESP_MEM_BEGIN, memBeginData(stub.data.size(), 1, stub.data.size(), stub.dataStart));
+        upload << PipelinedCommand(ESP_MEM_DATA, memBlockData(stub.data, 0), checksum(stub.data));
+    }
+    upload << PipelinedCommand(ESP_MEM_END, memFinishData(stub.entry));
+    return upload;
 }
 
-void EspRom::createFlasher() {
-    if(!mEspFlasher) {
-        mEspFlasher = new EspFlasher(this, mBaudRate);
-        connect(mEspFlasher, SIGNAL(progress(int)), this ,SLOT(onFlasherProgress(int)));
+bool EspRom::createFlasher() {
+    // The stub stays loaded for the whole connection, only the first operation uploads it
+    if(mEspFlasher) {
+        return true;
+    }
+
+    // The ROM is needed for the upload, after a reboot or a failed session it must be reset
+    if(!mIsSynced && !syncEsp()) {
+        return false;
+    }
+
+    if(mAutoBaud && !mBaudNegotiated) negotiateBaudRate();
+    else startFlasher(mBaudRate);
+
+    if(!mEspFlasher->isStubRunning()) {
+        setLastError(mEspFlasher->lastErrorCode() == EspFlasher::WrongArguments ? mEspFlasher->lastError() : QString(ERR_StubNotRunning));
+        clearFlasher();
+        return false;
     }
+    return true;
+}
+
+bool EspRom::ensureRom() {
+    // Register access is a ROM service. Leaving the stub takes a reset,
+    // which is the caller's decision: the session is kept and the call fails
+    if(mEspFlasher) {
+        setLastError(ERR_StubSession);
+        return false;
+    }
+    return true;
+}
+
+void EspRom::startFlasher(int baudRate) {
+    clearFlasher();
+    mEspFlasher = new EspFlasher(this, baudRate);
+    connect(mEspFlasher, SIGNAL(progress(int)), this ,SLOT(onFlasherProgress(int)));
+    // Once the stub is started the ROM no longer listens
+    mIsSynced = false;
 }
 
 void EspRom::clearFlasher() {
@@ -607,3 +1025,73 @@ void EspRom::clearFlasher() {
         mEspFlasher = NULL;
     }
 }
+
+bool EspRom::negotiateBaudRate() {
+    // Start from the rate that last worked with this adapter, if any
+    int start = 0;
+    QString key = adapterKey();
+    if(!key.isEmpty()) {
+        QSettings settings("EspQtLib", "EspQtLib");
+        int cached = settings.value(key, 0).toInt();
+        if(mBaudLadder.contains(cached)) start = mBaudLadder.indexOf(cached);
+    }
+
+    for(int i=start; i<mBaudLadder.size(); i++) {
+        if(tryBaudRate(mBaudLadder.at(i))) {
+            // At or below the ROM rate the stub keeps the one the ROM was synced at
+            mBaudRate = portBaudRate();
+            mBaudNegotiated = true;
+            if(!key.isEmpty()) QSettings("EspQtLib", "EspQtLib").setValue(key, mBaudRate);
+            qDebug("EspRom::negotiateBaudRate using %d baud", mBaudRate);
+            return true;
+        }
+
+        // The stub is running at an unusable rate, go back to the ROM
+        clearFlasher();
+        if(!syncEsp()) break;
+    }
+
+    qDebug("EspRom::negotiateBaudRate no stable rate found");
+    if(!mEspFlasher) startFlasher(mRomBaudRate);
+    return false;
+}
+
+bool EspRom::tryBaudRate(int baudRate) {
+    qDebug("EspRom::tryBaudRate %d", baudRate);
+    startFlasher(baudRate);
+    if(!mEspFlasher->isStubRunning()) {
+        return false;
+    }
+
+    QByteArray probe = mEspFlasher->flashRead(0, ESP_BAUD_PROBE_SIZE);
+    return probe.size() == ESP_BAUD_PROBE_SIZE;
+}
+
+bool EspRom::stepDownBaudRate() {
+    int index = mBaudLadder.indexOf(mBaudRate);
+    if(index < 0 || index + 1 >= mBaudLadder.size()) {
+        return false;
+    }
+
+    clearFlasher();
+    if(!syncEsp()) {
+        return false;
+    }
+
+    startFlasher(mBaudLadder.at(index + 1));
+    // At or below the ROM rate the stub keeps the one the ROM was synced at
+    mBaudRate = portBaudRate();
+
+    QString key = adapterKey();
+    if(!key.isEmpty()) QSettings("EspQtLib", "EspQtLib").setValue(key, mBaudRate);
+    return mEspFlasher->isStubRunning();
+}
+
+QString EspRom::adapterKey() const {
+    if(!mPort) return QString();
+    QSerialPortInfo info(*mPort);
+    if(!info.hasVendorIdentifier() || !info.hasProductIdentifier()) {
+        return QString();
+    }
+    return QString("baud/%1_%2").arg(info.vendorIdentifier(), 4, 16, QChar('0')).arg(info.productIdentifier(), 4, 16, QChar('0'));
+}
@@ -27,73 +27,223 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QElapsedTimer>
+
+#include "espslip.h"
+#include "espchecksum.h"
+#include "espflashplan.h"
+#include "esptelemetry.h"
+#include "espresume.h"
 
 // Flash sector size, minimum unit of erase.
 #define ESP_FLASH_SECTOR 0x1000
 
-// Initial state for the checksum routine
-#define ESP_CHECKSUM_MAGIC 0xef
+// Default response timeout for ROM commands, in milliseconds
+#define ESP_DEFAULT_TIMEOUT 3000
+
+// One register access of a batch run by EspRom::regBatch()
+class EspRegOp {
+public:
+    enum Type { Read, Write };
+    EspRegOp(Type t, quint32 addr, quint32 val=0, quint32 msk=0xFFFFFFFF, quint32 delay=0) : type(t), address(addr), value(val), mask(msk), delayUs(delay), ok(false) { }
+public:
+    Type type;
+    quint32 address;
+    quint32 value;
+    quint32 mask;
+    quint32 delayUs;
+    bool ok;
+};
+
+typedef QList<EspRegOp> EspRegBatch;
+
+// Board identification collected by EspRom::deviceInventory()
+class EspInventory {
+public:
+    EspInventory() : chipId(0), flashId(0) { }
+public:
+    QByteArray macId;
+    quint32 chipId;
+    quint32 flashId;
+};
+
+// Statistics of the last flash write
+class EspWriteStats {
+public:
+    EspWriteStats() : payloadBytes(0), wireBytes(0), elapsedMs(0), verified(false), window(0), ackRttUs(0), linkUtilisation(0.0), skippedBytes(0), resumedBytes(0) { }
+    double throughput() const { return elapsedMs ? payloadBytes * 1000.0 / elapsedMs : 0.0; }
+    void add(const EspWriteStats &other);
+public:
+    quint64 payloadBytes;
+    quint64 wireBytes;
+    qint64 elapsedMs;
+    bool verified;
+    QList<quint32> mismatchedBlocks;
+    // Flow control of plain writes: largest window used, shortest ack round
+    // trip and share of the link bandwidth carrying payload
+    quint32 window;
+    qint64 ackRttUs;
+    double linkUtilisation;
+    // Blank bytes of the image that were never sent
+    quint64 skippedBytes;
+    // Bytes of an interrupted write found in flash and not sent again
+    quint64 resumedBytes;
+};
+
+// Images to write as (flash address, data) pairs
+typedef QList< QPair<quint32, QByteArray> > FlashBlob;
 
 class EspFlasher;
+class EspStub;
+class EspImageSource;
+class EspTraceRecorder;
 class QSerialPort;
+class QIODevice;
 class EspRom : public QObject {
     Q_OBJECT
 public:
     friend class EspFlasher;
+    friend class EspAsyncRom;
 
     enum FlashMode {qio=0, qout=1, dio=2, dout=3};
     enum FlashSize {size4m=0x00, size2m=0x10, size8m=0x20, size16m=0x30, size32m=0x40, size16m_c1=0x50, size32m_c1=0x60, size32m_c2=0x70};
     enum FlashSizeFreq {freq40m=0, freq26m=1, freq20m=2, freq80m=0xf};
+    enum WriteOption {WriteDefault=0x00, WriteDifferential=0x02, WriteVerify=0x04, WriteSkipBlank=0x08, WriteResume=0x10};
+    Q_DECLARE_FLAGS(WriteOptions, WriteOption)
+    // A ROM command with its reply, see commandPipeline() and stubUpload()
+    class PipelinedCommand {
+    public:
+        PipelinedCommand(quint8 o, const QByteArray &d, quint32 c=0) : op(o), data(d), chk(c), val(0), ok(false) { }
+    public:
+        quint8 op;
+        QByteArray data;
+        quint32 chk;
+        quint32 val;
+        bool ok;
+    };
 public:
     void setLastError(const QString &error) { mLastError = error; }
     QString lastError() const { return mLastError; }
 public:
-    EspRom(const QString &port, int baud, QObject *parent = 0);    
+    EspRom(const QString &port, int baud, QObject *parent = 0);
+    EspRom(QIODevice *device, int baud, QObject *parent = 0);
     bool syncEsp();
+    bool attachStub();
+    bool hasStubSession() const { return mEspFlasher != NULL; }
     bool isPortOpen();
     void waitForReadyRead(int ms);
     quint32 portBaudRate();
     void setBaudRate(int baudRate);
     quint64 portWrite(const QByteArray &data);
+    quint64 portWrite(const char *data, int len);
     bool isSynced() { return mIsSynced; }
     QByteArray macId();
     quint32 chipId();
     quint32 flashId();
+    bool regBatch(EspRegBatch &regs);
+    bool deviceInventory(EspInventory &inventory);
     QByteArray flashRead(quint32 address, int size);
-    bool flashWrite(quint32 address, QByteArray &data, bool reboot, FlashMode mode=qio, FlashSize size=size4m, FlashSizeFreq freq=freq40m);
+    bool flashRead(quint32 address, quint32 size, QIODevice *sink);
+    bool flashDigest(quint32 address, quint32 size, QByteArray &digest);
+    bool eraseFlash();
+    bool flashWrite(quint32 address, const QByteArray &data, bool reboot, FlashMode mode=qio, FlashSize size=size4m, FlashSizeFreq freq=freq40m);
+    bool flashWrite(quint32 address, EspImageSource &source, bool reboot, FlashMode mode=qio, FlashSize size=size4m, FlashSizeFreq freq=freq40m);
+    bool flashWriteBlob(const FlashBlob &blob, bool reboot, FlashMode mode=qio, FlashSize size=size4m, FlashSizeFreq freq=freq40m);
     bool rebootFw();
+    static void buildCommand(QByteArray &packet, quint8 op, const QByteArray &data, quint32 chk=0);
+    static quint8 checksum(const QByteArray &data, quint8 state=ESP_CHECKSUM_MAGIC);
+    static bool parseResponse(const QByteArray &packet, quint8 &op, quint32 &val);
+    static bool isStatusOk(const QByteArray &retData);
+    static QByteArray syncData();
+    static QList<PipelinedCommand> stubUpload(const EspStub &stub, const QVector<quint32> &params);
+    static void prepareImage(quint32 address, QByteArray &data, FlashMode mode=qio, FlashSize size=size4m, FlashSizeFreq freq=freq40m);
+    void setWriteOptions(WriteOptions options) { mWriteOptions = options; }
+    WriteOptions writeOptions() const { return mWriteOptions; }
+    void setStubFile(const QString &file) { mStubFile = file; }
+    EspWriteStats lastWriteStats() const { return mWriteStats; }
+    void setAutoBaud(bool enable) { mAutoBaud = enable; }
+    void setBaudLadder(const QList<int> &ladder) { mBaudLadder = ladder; }
+    int negotiatedBaudRate() const { return mBaudNegotiated ? mBaudRate : 0; }
+    EspTelemetry *telemetry() const { return mTelemetry; }
+    void setTelemetry(EspTelemetry *telemetry);
+    void setTrace(EspTraceRecorder *trace);
+    void setResumeJournal(const QString &fileName) { mResume.setFileName(fileName); }
 private slots:
     void onFlasherProgress(int written);
 private:
-    bool command(quint8 op=0, const QByteArray &data=0, quint32 chk=0);
+    bool commandPipeline(QList<PipelinedCommand> &cmds);
+    static QByteArray readRegData(quint32 addr);
+    static QByteArray writeRegData(quint32 addr, quint32 value, quint32 mask, quint32 delayUs=0);
+    static QByteArray flashBeginData(quint32 size, quint32 offset, quint32 *eraseSize=0);
+    static QByteArray flashFinishData(bool reboot);
+    static QByteArray memBeginData(quint32 size, quint32 blocks, quint32 blocksize, quint32 offset);
+    static QByteArray memBlockData(const QByteArray &block, quint32 seq);
+    static QByteArray memFinishData(quint32 entrypoint);
+    static QByteArray macFromOtp(quint32 mac0, quint32 mac1, quint32 mac3);
+    static quint32 chipIdFromOtp(quint32 mac0, quint32 mac1);
+    static void appendFlashIdCommands(QList<PipelinedCommand> &cmds);
+private:
+    bool command(quint8 op=0, const QByteArray &data=0, quint32 chk=0, int timeout=ESP_DEFAULT_TIMEOUT);
+    void sendCommand(quint8 op, const QByteArray &data, quint32 chk=0);
+    bool waitResponse(quint8 op, int timeout);
+    int pendingIndex(quint8 op) const;
     bool readTimeout(int timeout);
     bool read();
     const QByteArray &lastPacketReaded() const;
     void write(quint8 arg1);
-    void write(quint32 arg1, quint32 arg2, quint32 arg3);
-    void write(quint32 arg1, quint32 arg2, quint32 arg3, quint32 arg4);
     void write(const QByteArray &packet);
-    quint8 checksum(const QByteArray &data, quint8 state=ESP_CHECKSUM_MAGIC) const;
+    void write(const char *data, int len);
 private:
     bool sync();
     quint32 readReg(quint32 addr);
     bool writeReg(quint32 addr,quint32 value,quint32 mask,quint32 delayUs=0);
     bool flashBegin(quint32 size, quint32 offset);
     bool flashFinish(bool reboot=false);
-    bool memBegin(quint32 size, quint32 blocks, quint32 blocksize, quint32 offset);
-    bool memBlock(const QByteArray &block, quint32 seq);
-    bool memFinish(quint32 entrypoint=0);
-    bool runStub(QString fileStub, QVector<quint32> params, bool readOutput=true);
-    void createFlasher();
+    bool runStub(const EspStub &stub, QVector<quint32> params, bool readOutput=true);
+    bool createFlasher();
+    bool ensureRom();
+    void startFlasher(int baudRate);
     void clearFlasher();
+    bool writeSegments(const QList<quint32> &addresses, const QList<EspImageSource *> &sources, bool reboot, FlashMode mode, FlashSize size, FlashSizeFreq freq);
+    bool writeImage(quint32 address, EspImageSource &source, const EspFlashRanges &blank, const EspFlashRanges &erased);
+    bool writeResumable(quint32 address, EspImageSource &source, QList<QByteArray> *sectorDigests, quint32 &resumed);
+    void saveResumeJournal();
+    EspFlashRanges eraseBlank(quint32 address, const EspFlashRanges &blank, quint32 imageSize);
+    bool negotiateBaudRate();
+    bool tryBaudRate(int baudRate);
+    bool stepDownBaudRate();
+    QString adapterKey() const;
 private:
     bool mIsSynced;
+    // The link, mPort is set when it is a serial port
+    QIODevice *mDevice;
     QSerialPort *mPort;
+    int mLinkBaudRate;
     int mBaudRate;
-    bool mPartialPacket;
+    int mRomBaudRate;
+    bool mAutoBaud;
+    bool mBaudNegotiated;
+    QList<int> mBaudLadder;
     EspFlasher *mEspFlasher;
     QByteArray mLastPacket;
-    QByteArray mInputBuffer;
+    EspSlipDecoder mDecoder;
+    EspSlipEncoder mEncoder;
+    QByteArray mCommandBuffer;
+    // Commands waiting for a reply, with the time they were sent on mClock
+    QList< QPair<quint8, qint64> > mPendingOps;
+    QElapsedTimer mClock;
+    WriteOptions mWriteOptions;
+    QString mStubFile;
+    EspWriteStats mWriteStats;
+    quint64 mProgressBase;
+    EspTelemetry mOwnTelemetry;
+    EspTelemetry *mTelemetry;
+    EspTraceRecorder *mTrace;
+    EspResumeJournal mResume;
+    // The resumable write in progress, size is 0 when there is none
+    EspResumeEntry mResumeWrite;
 private:
     quint32 mLastReturnVal;
     QByteArray mLastRetData;
@@ -103,4 +253,6 @@ signals:
     void flasherProgress(int written);
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(EspRom::WriteOptions)
+
 #endif // ESPROM_H
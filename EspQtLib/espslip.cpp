@@ -0,0 +1,191 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espslip.h"
+
+#include <QIODevice>
+#include <QDebug>
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Returns the first SLIP_END or SLIP_ESC byte in [data,end) or end if none
+static inline const quint8 *slipFindSpecial(const quint8 *data, const quint8 *end) {
+#if defined(__SSE2__)
+    const __m128i slipEnd = _mm_set1_epi8((char)SLIP_END);
+    const __m128i slipEsc = _mm_set1_epi8((char)SLIP_ESC);
+    while(end - data >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)data);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, slipEnd), _mm_cmpeq_epi8(v, slipEsc)));
+        if(mask) return data + __builtin_ctz(mask);
+        data += 16;
+    }
+#else
+    // Eight bytes at a time, a zero byte in w^pattern flags a match
+    const quint64 ones = Q_UINT64_C(0x0101010101010101);
+    const quint64 highs = Q_UINT64_C(0x8080808080808080);
+    while(end - data >= 8) {
+        quint64 w;
+        memcpy(&w, data, sizeof(w));
+        quint64 a = w ^ (ones * SLIP_END);
+        quint64 b = w ^ (ones * SLIP_ESC);
+        if(((a - ones) & ~a & highs) | ((b - ones) & ~b & highs)) break;
+        data += 8;
+    }
+#endif
+    while(data < end && *data != SLIP_END && *data != SLIP_ESC) data++;
+    return data;
+}
+
+EspSlipDecoder::EspSlipDecoder(int maxFrameSize) : mRingRead(0), mRingWrite(0), mFrameLen(0), mMaxFrameSize(maxFrameSize), mInFrame(false), mInEscape(false), mOverflow(false) {
+    mFrame.resize(maxFrameSize);
+}
+
+void EspSlipDecoder::reset() {
+    mRingRead = mRingWrite = 0;
+    mFrameLen = 0;
+    mInFrame = mInEscape = mOverflow = false;
+    mPackets.clear();
+}
+
+int EspSlipDecoder::readFrom(QIODevice *device) {
+    int total = 0;
+    while(device->bytesAvailable() > 0) {
+        quint32 offset = mRingWrite & (SLIP_RING_SIZE - 1);
+        quint32 space = qMin<quint32>(SLIP_RING_SIZE - (mRingWrite - mRingRead), SLIP_RING_SIZE - offset);
+        qint64 len = device->read(mRing + offset, space);
+        if(len <= 0) break;
+        mRingWrite += len;
+        total += len;
+        decodeRing();
+    }
+    return total;
+}
+
+int EspSlipDecoder::decode(const char *data, int len) {
+    int count = mPackets.size();
+    decodeSpan((const quint8 *)data, len);
+    return mPackets.size() - count;
+}
+
+void EspSlipDecoder::decodeRing() {
+    while(mRingRead != mRingWrite) {
+        quint32 offset = mRingRead & (SLIP_RING_SIZE - 1);
+        quint32 len = qMin<quint32>(mRingWrite - mRingRead, SLIP_RING_SIZE - offset);
+        decodeSpan((const quint8 *)mRing + offset, len);
+        mRingRead += len;
+    }
+}
+
+void EspSlipDecoder::decodeSpan(const quint8 *data, int len) {
+    const quint8 *end = data + len;
+
+    while(data < end) {
+        if(!mInFrame) {
+            // Anything outside a frame (boot messages, line noise) is skipped
+            data = (const quint8 *)memchr(data, SLIP_END, end - data);
+            if(!data) return;
+            data++;
+            mInFrame = true;
+            mFrameLen = 0;
+            continue;
+        }
+
+        if(mInEscape) {
+            mInEscape = false;
+            quint8 byte = *data++;
+            if(byte == SLIP_ESC_END || byte == SLIP_ESC_ESC) {
+                if(mFrameLen < mMaxFrameSize) mFrame.data()[mFrameLen++] = byte == SLIP_ESC_END ? (char)SLIP_END : (char)SLIP_ESC;
+                else mOverflow = true;
+            } else {
+                qDebug("EspSlipDecoder::decode invalid escape squence %02X", byte);
+                if(byte == SLIP_END) frameEnd();
+            }
+            continue;
+        }
+
+        const quint8 *run = data;
+        data = slipFindSpecial(data, end);
+        int runLen = data - run;
+        if(runLen > 0) {
+            if(mFrameLen + runLen <= mMaxFrameSize) {
+                memcpy(mFrame.data() + mFrameLen, run, runLen);
+                mFrameLen += runLen;
+            } else {
+                mOverflow = true;
+            }
+        }
+
+        if(data < end) {
+            if(*data++ == SLIP_ESC) mInEscape = true;
+            else frameEnd();
+        }
+    }
+}
+
+void EspSlipDecoder::frameEnd() {
+    if(mOverflow) {
+        qDebug("EspSlipDecoder::decode frame exceeds %d bytes, dropped", mMaxFrameSize);
+        mOverflow = false;
+        mInFrame = false;
+    } else if(mFrameLen > 0) {
+        mPackets.enqueue(QByteArray(mFrame.constData(), mFrameLen));
+        mInFrame = false;
+    }
+    // An empty frame is a start marker seen after a lost end marker: stay in frame
+    mFrameLen = 0;
+}
+
+EspSlipEncoder::EspSlipEncoder() : mSize(0) {
+}
+
+int EspSlipEncoder::encode(const char *data, int len) {
+    // Worst case every byte is escaped, the buffer only ever grows
+    if(mBuffer.size() < 2 * len + 2) mBuffer.resize(2 * len + 2);
+
+    const quint8 *src = (const quint8 *)data;
+    const quint8 *end = src + len;
+    quint8 *out = (quint8 *)mBuffer.data();
+    quint8 *dst = out;
+
+    *dst++ = SLIP_END;
+    while(src < end) {
+        const quint8 *special = slipFindSpecial(src, end);
+        int run = special - src;
+        if(run > 0) {
+            memcpy(dst, src, run);
+            dst += run;
+        }
+        if(special == end) break;
+        *dst++ = SLIP_ESC;
+        *dst++ = *special == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+        src = special + 1;
+    }
+    *dst++ = SLIP_END;
+
+    mSize = dst - out;
+    return mSize;
+}
@@ -0,0 +1,90 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPSLIP_H
+#define ESPSLIP_H
+
+#include <QByteArray>
+#include <QQueue>
+
+// SLIP framing bytes
+#define SLIP_END        0xC0
+#define SLIP_ESC        0xDB
+#define SLIP_ESC_END    0xDC
+#define SLIP_ESC_ESC    0xDD
+
+// Size of the receive ring buffer, must be a power of two
+#define SLIP_RING_SIZE  0x1000
+// Largest decoded frame accepted, bigger frames are dropped
+#define SLIP_MAX_FRAME  0x4400
+
+class QIODevice;
+
+// Streaming SLIP decoder. Bytes are read from the device into a fixed ring
+// buffer and decoded in place; the framing state survives between calls, so
+// a frame or an escape sequence may be split across any number of reads.
+class EspSlipDecoder {
+public:
+    EspSlipDecoder(int maxFrameSize=SLIP_MAX_FRAME);
+    void reset();
+    int readFrom(QIODevice *device);
+    int decode(const char *data, int len);
+    bool hasPacket() const { return !mPackets.isEmpty(); }
+    int packetCount() const { return mPackets.size(); }
+    QByteArray takePacket() { return mPackets.dequeue(); }
+    void clearPackets() { mPackets.clear(); }
+private:
+    void decodeRing();
+    void decodeSpan(const quint8 *data, int len);
+    void frameEnd();
+private:
+    char mRing[SLIP_RING_SIZE];
+    quint32 mRingRead;
+    quint32 mRingWrite;
+private:
+    QByteArray mFrame;
+    int mFrameLen;
+    int mMaxFrameSize;
+    bool mInFrame;
+    bool mInEscape;
+    bool mOverflow;
+    QQueue<QByteArray> mPackets;
+};
+
+// Single pass SLIP encoder. The encoded frame is built in a buffer owned by
+// the encoder and reused by every call, so steady state encoding does not
+// allocate; the runs between bytes that need escaping are copied in bulk.
+class EspSlipEncoder {
+public:
+    EspSlipEncoder();
+    int encode(const char *data, int len);
+    int encode(const QByteArray &packet) { return encode(packet.constData(), packet.size()); }
+    const char *data() const { return mBuffer.constData(); }
+    int size() const { return mSize; }
+private:
+    QByteArray mBuffer;
+    int mSize;
+};
+
+#endif // ESPSLIP_H
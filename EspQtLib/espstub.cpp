@@ -0,0 +1,101 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "espstub.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "espstubdata.h"
+
+// Stubs loaded from files, keyed by file name with the modification time they were read at
+class EspStubCacheEntry {
+public:
+    QDateTime modified;
+    EspStub stub;
+};
+
+static QMutex gStubCacheMutex;
+static QHash<QString, EspStubCacheEntry> gStubCache;
+
+EspStub EspStub::fromJson(const QByteArray &json) {
+    // Hex strings may be split over lines with a trailing backslash
+    QByteArray text = json;
+    text.replace("\\\n", "");
+
+    QJsonObject object = QJsonDocument::fromJson(text).object();
+    EspStub stub;
+    stub.code = QByteArray::fromHex(object.value("code").toString("").toLatin1());
+    stub.codeStart = (quint32)object.value("code_start").toDouble();
+    stub.data = QByteArray::fromHex(object.value("data").toString("").toLatin1());
+    stub.dataStart = (quint32)object.value("data_start").toDouble();
+    stub.numParams = object.value("num_params").toInt();
+    stub.paramsStart = (quint32)object.value("params_start").toDouble();
+    stub.entry = (quint32)object.value("entry").toDouble();
+    return stub;
+}
+
+EspStub EspStub::load(const QString &fileName) {
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)) {
+        qDebug("EspStub::load unable to open %s", fileName.toLatin1().constData());
+        return EspStub();
+    }
+    return fromJson(file.readAll());
+}
+
+EspStub EspStub::cached(const QString &fileName) {
+    QDateTime modified = QFileInfo(fileName).lastModified();
+
+    QMutexLocker locker(&gStubCacheMutex);
+    QHash<QString, EspStubCacheEntry>::const_iterator it = gStubCache.constFind(fileName);
+    if(it != gStubCache.constEnd() && it.value().modified == modified) {
+        return it.value().stub;
+    }
+
+    EspStubCacheEntry entry;
+    entry.modified = modified;
+    entry.stub = load(fileName);
+    if(entry.stub.isValid()) gStubCache.insert(fileName, entry);
+    return entry.stub;
+}
+
+EspStub EspStub::builtin() {
+    // The arrays are never freed, the image refers to them without a copy
+    EspStub stub;
+    stub.code = QByteArray::fromRawData((const char *)espStubCode, ESP_STUB_CODE_SIZE);
+    stub.data = QByteArray::fromRawData((const char *)espStubData, ESP_STUB_DATA_SIZE);
+    stub.codeStart = ESP_STUB_CODE_START;
+    stub.dataStart = ESP_STUB_DATA_START;
+    stub.paramsStart = ESP_STUB_PARAMS_START;
+    stub.entry = ESP_STUB_ENTRY;
+    stub.numParams = ESP_STUB_NUM_PARAMS;
+    return stub;
+}
@@ -0,0 +1,52 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPSTUB_H
+#define ESPSTUB_H
+
+#include <QByteArray>
+#include <QString>
+
+// A flasher stub image ready to be uploaded in RAM by EspRom::runStub(). The
+// built in stub is compiled in the library, stubs given at run time are
+// parsed once and kept in memory.
+class EspStub {
+public:
+    EspStub() : codeStart(0), dataStart(0), paramsStart(0), entry(0), numParams(0) { }
+    bool isValid() const { return !code.isEmpty() && entry != 0; }
+    static EspStub fromJson(const QByteArray &json);
+    static EspStub load(const QString &fileName);
+    static EspStub cached(const QString &fileName);
+    static EspStub builtin();
+public:
+    QByteArray code;
+    QByteArray data;
+    quint32 codeStart;
+    quint32 dataStart;
+    quint32 paramsStart;
+    quint32 entry;
+    int numParams;
+};
+
+#endif // ESPSTUB_H
@@ -0,0 +1,154 @@
+// Generated by res/stub2header.py from stub_flasher.json, do not edit
+
+#ifndef ESPSTUBDATA_H
+#define ESPSTUBDATA_H
+
+#define ESP_STUB_CODE_START   0x40100004
+#define ESP_STUB_DATA_START   0x3ffe8000
+#define ESP_STUB_PARAMS_START 0x40100000
+#define ESP_STUB_ENTRY        0x401006f4
+#define ESP_STUB_NUM_PARAMS   1
+#define ESP_STUB_CODE_SIZE    2100
+#define ESP_STUB_DATA_SIZE    32
+
+static const unsigned char espStubCode[] = {
+    0x08, 0x00, 0x00, 0x60, 0x1c, 0x00, 0x00, 0x60, 0x00, 0x00, 0x00, 0x60, 0x10, 0x00, 0x00, 0x60,
+    0x31, 0xfc, 0xff, 0x71, 0xfc, 0xff, 0x81, 0xfc, 0xff, 0xc0, 0x20, 0x00, 0x68, 0x03, 0x32, 0xd2,
+    0x18, 0xc0, 0x20, 0x00, 0x48, 0x07, 0x40, 0x40, 0x74, 0xdc, 0xc4, 0x86, 0x08, 0x00, 0x58, 0x23,
+    0xc0, 0x20, 0x00, 0x98, 0x08, 0x1b, 0xa5, 0xa9, 0x23, 0x92, 0x45, 0x00, 0x58, 0x03, 0x1b, 0x55,
+    0x59, 0x03, 0x58, 0x23, 0x37, 0x35, 0x01, 0x29, 0x23, 0x0b, 0x44, 0x66, 0x04, 0xdf, 0xc6, 0xf3,
+    0xff, 0x21, 0xee, 0xff, 0xc0, 0x20, 0x00, 0x69, 0x02, 0x0d, 0xf0, 0x00, 0x00, 0x00, 0x01, 0x00,
+    0x78, 0x48, 0x00, 0x40, 0x00, 0x4a, 0x00, 0x40, 0xb4, 0x49, 0x00, 0x40, 0x12, 0xc1, 0xf0, 0xc9,
+    0x21, 0xd9, 0x11, 0xe9, 0x01, 0xdd, 0x02, 0x09, 0x31, 0x20, 0x20, 0xb4, 0xed, 0x03, 0x3c, 0x2c,
+    0x56, 0xc2, 0x07, 0x30, 0x20, 0xb4, 0x3c, 0x3c, 0x56, 0x42, 0x07, 0x01, 0xf5, 0xff, 0xc0, 0x00,
+    0x00, 0x3c, 0x4c, 0x56, 0x92, 0x06, 0xcd, 0x0e, 0xea, 0xdd, 0x86, 0x03, 0x00, 0x20, 0x2c, 0x41,
+    0x01, 0xf1, 0xff, 0xc0, 0x00, 0x00, 0x56, 0xa2, 0x04, 0xc2, 0xdc, 0xf0, 0xc0, 0x2d, 0xc0, 0xcc,
+    0x6c, 0xca, 0xe2, 0xd1, 0xea, 0xff, 0x06, 0x06, 0x00, 0x20, 0x30, 0xf4, 0x56, 0xd3, 0xfd, 0x86,
+    0xfb, 0xff, 0x00, 0x00, 0x20, 0x20, 0xf5, 0x01, 0xe8, 0xff, 0xc0, 0x00, 0x00, 0xec, 0x82, 0xd0,
+    0xcc, 0xc0, 0xc0, 0x2e, 0xc0, 0xc7, 0x3d, 0xeb, 0x2a, 0xdc, 0x46, 0x03, 0x00, 0x20, 0x2c, 0x41,
+    0x01, 0xe1, 0xff, 0xc0, 0x00, 0x00, 0xdc, 0x42, 0xc2, 0xdc, 0xf0, 0xc0, 0x2d, 0xc0, 0x56, 0xbc,
+    0xfe, 0xc6, 0x02, 0x00, 0x3c, 0x5c, 0x86, 0x01, 0x00, 0x3c, 0x6c, 0x46, 0x00, 0x00, 0x3c, 0x7c,
+    0x08, 0x31, 0x2d, 0x0c, 0xd8, 0x11, 0xc8, 0x21, 0xe8, 0x01, 0x12, 0xc1, 0x10, 0x0d, 0xf0, 0x00,
+    0x0c, 0x18, 0x00, 0x00, 0x14, 0x00, 0x10, 0x40, 0x0c, 0x00, 0x00, 0x60, 0x74, 0x18, 0x00, 0x00,
+    0x64, 0x18, 0x00, 0x00, 0x80, 0x18, 0x00, 0x00, 0x8c, 0x18, 0x00, 0x00, 0x84, 0x18, 0x00, 0x00,
+    0x88, 0x18, 0x00, 0x00, 0x90, 0x18, 0x00, 0x00, 0x18, 0x98, 0x00, 0x40, 0x88, 0x0f, 0x00, 0x40,
+    0xa8, 0x0f, 0x00, 0x40, 0x34, 0x98, 0x00, 0x40, 0x4c, 0x4a, 0x00, 0x40, 0x74, 0x0f, 0x00, 0x40,
+    0x80, 0x0f, 0x00, 0x40, 0x98, 0x0f, 0x00, 0x40, 0x00, 0x99, 0x00, 0x40, 0x12, 0xc1, 0xe0, 0x91,
+    0xf5, 0xff, 0xc9, 0x61, 0xcd, 0x02, 0x21, 0xef, 0xff, 0xe9, 0x41, 0xf9, 0x31, 0x09, 0x71, 0xd9,
+    0x51, 0x90, 0x11, 0xc0, 0x1a, 0x22, 0x39, 0x02, 0xe2, 0xd1, 0x18, 0x0c, 0x02, 0x22, 0x6e, 0x1d,
+    0x21, 0xe4, 0xff, 0x31, 0xe9, 0xff, 0x2a, 0xf1, 0x1a, 0x33, 0x2d, 0x0f, 0x42, 0x63, 0x00, 0x01,
+    0xea, 0xff, 0xc0, 0x00, 0x00, 0xc0, 0x30, 0xb4, 0x3c, 0x22, 0x56, 0xa3, 0x16, 0x21, 0xe1, 0xff,
+    0x1a, 0x22, 0x28, 0x02, 0x20, 0x30, 0xb4, 0x3c, 0x32, 0x56, 0xb3, 0x15, 0x01, 0xad, 0xff, 0xc0,
+    0x00, 0x00, 0xdd, 0x02, 0x3c, 0x42, 0x56, 0xed, 0x14, 0x31, 0xd6, 0xff, 0x4d, 0x01, 0x0c, 0x52,
+    0xd9, 0x0e, 0x19, 0x2e, 0x12, 0x6e, 0x01, 0x01, 0xdd, 0xff, 0xc0, 0x00, 0x00, 0x21, 0xd2, 0xff,
+    0x32, 0xa1, 0x01, 0xc0, 0x20, 0x00, 0x48, 0x02, 0x30, 0x34, 0x20, 0xc0, 0x20, 0x00, 0x39, 0x02,
+    0x2c, 0x02, 0x01, 0xd7, 0xff, 0xc0, 0x00, 0x00, 0x46, 0x33, 0x00, 0x00, 0x00, 0x31, 0xcd, 0xff,
+    0x1a, 0x33, 0x38, 0x03, 0xd0, 0x23, 0xc0, 0x31, 0x99, 0xff, 0x27, 0xb3, 0x1a, 0xdc, 0x7f, 0x31,
+    0xcb, 0xff, 0x1a, 0x33, 0x28, 0x03, 0x01, 0x98, 0xff, 0xc0, 0x00, 0x00, 0x56, 0xc2, 0x0e, 0x21,
+    0x93, 0xff, 0x2a, 0xdd, 0x06, 0x0e, 0x00, 0x00, 0x31, 0xc6, 0xff, 0x1a, 0x33, 0x28, 0x03, 0x01,
+    0x91, 0xff, 0xc0, 0x00, 0x00, 0x56, 0x82, 0x0d, 0xd2, 0xdd, 0x10, 0x46, 0x08, 0x00, 0x00, 0x00,
+    0x21, 0xbe, 0xff, 0x1a, 0x22, 0x28, 0x02, 0x9c, 0xe2, 0x31, 0xbc, 0xff, 0xc0, 0x20, 0xf5, 0x1a,
+    0x33, 0x29, 0x03, 0x31, 0xbb, 0xff, 0xc0, 0x2c, 0x41, 0x1a, 0x33, 0x29, 0x03, 0xc0, 0xf0, 0xf4,
+    0x22, 0x2e, 0x1d, 0x22, 0xd2, 0x04, 0x27, 0x3d, 0x93, 0x32, 0xa3, 0xff, 0xc0, 0x20, 0x00, 0x28,
+    0x0e, 0x27, 0xb3, 0xf7, 0x21, 0xab, 0xff, 0x38, 0x1e, 0x1a, 0x22, 0x42, 0xa4, 0x00, 0x01, 0xb5,
+    0xff, 0xc0, 0x00, 0x00, 0x38, 0x1e, 0x2d, 0x0c, 0x42, 0xa4, 0x00, 0x01, 0xb3, 0xff, 0xc0, 0x00,
+    0x00, 0x56, 0x12, 0x08, 0x01, 0xb2, 0xff, 0xc0, 0x00, 0x00, 0xc0, 0x20, 0x00, 0x28, 0x0e, 0xc2,
+    0xdc, 0x04, 0x22, 0xd2, 0xfc, 0xc0, 0x20, 0x00, 0x29, 0x0e, 0x01, 0xad, 0xff, 0xc0, 0x00, 0x00,
+    0x22, 0x2e, 0x1d, 0x22, 0xd2, 0x04, 0x22, 0x6e, 0x1d, 0x28, 0x1e, 0x22, 0xd2, 0x04, 0xe7, 0xb2,
+    0x04, 0x29, 0x1e, 0x86, 0x00, 0x00, 0x12, 0x6e, 0x01, 0x21, 0x98, 0xff, 0x32, 0xa0, 0x04, 0x2a,
+    0x21, 0xc5, 0x4c, 0x00, 0x31, 0x98, 0xff, 0x22, 0x2e, 0x1d, 0x1a, 0x33, 0x38, 0x03, 0x37, 0xb2,
+    0x02, 0xc6, 0xd6, 0xff, 0x2c, 0x02, 0x01, 0x9f, 0xff, 0xc0, 0x00, 0x00, 0x21, 0x91, 0xff, 0x31,
+    0x8c, 0xff, 0x1a, 0x22, 0x3a, 0x31, 0x01, 0x9c, 0xff, 0xc0, 0x00, 0x00, 0x21, 0x8d, 0xff, 0x1c,
+    0x03, 0x1a, 0x22, 0xc5, 0x49, 0x00, 0x0c, 0x02, 0x06, 0x03, 0x00, 0x00, 0x3c, 0x52, 0x86, 0x01,
+    0x00, 0x3c, 0x62, 0x46, 0x00, 0x00, 0x3c, 0x72, 0x91, 0x8b, 0xff, 0x9a, 0x11, 0x08, 0x71, 0xc8,
+    0x61, 0xd8, 0x51, 0xe8, 0x41, 0xf8, 0x31, 0x12, 0xc1, 0x20, 0x0d, 0xf0, 0x00, 0x10, 0x00, 0x00,
+    0x68, 0x10, 0x00, 0x00, 0x58, 0x10, 0x00, 0x00, 0x70, 0x10, 0x00, 0x00, 0x74, 0x10, 0x00, 0x00,
+    0x78, 0x10, 0x00, 0x00, 0x7c, 0x10, 0x00, 0x00, 0x80, 0x10, 0x00, 0x00, 0x1c, 0x4b, 0x00, 0x40,
+    0x80, 0x3c, 0x00, 0x40, 0x91, 0xfd, 0xff, 0x12, 0xc1, 0xe0, 0x61, 0xf7, 0xff, 0xc9, 0x61, 0xe9,
+    0x41, 0xf9, 0x31, 0x09, 0x71, 0xd9, 0x51, 0x90, 0x11, 0xc0, 0x1a, 0x66, 0x29, 0x06, 0x21, 0xf3,
+    0xff, 0xc2, 0xd1, 0x10, 0x1a, 0x22, 0x39, 0x02, 0x31, 0xf2, 0xff, 0x0c, 0x0f, 0x1a, 0x33, 0x59,
+    0x03, 0x31, 0xea, 0xff, 0xf2, 0x6c, 0x1a, 0xed, 0x04, 0x5c, 0x22, 0x47, 0xb3, 0x02, 0x86, 0x36,
+    0x00, 0x2d, 0x0c, 0x01, 0x6d, 0xff, 0xc0, 0x00, 0x00, 0x21, 0xe5, 0xff, 0x41, 0xea, 0xff, 0x2a,
+    0x61, 0x1a, 0x44, 0x69, 0x04, 0x06, 0x22, 0x00, 0x00, 0x21, 0xe4, 0xff, 0x1a, 0x22, 0x28, 0x02,
+    0xf0, 0xd2, 0xc0, 0xd7, 0xbe, 0x01, 0xdd, 0x0e, 0x31, 0xe0, 0xff, 0x4d, 0x0d, 0x1a, 0x33, 0x28,
+    0x03, 0x3d, 0x01, 0x01, 0xe2, 0xff, 0xc0, 0x00, 0x00, 0x56, 0x12, 0x09, 0xd0, 0x3d, 0x20, 0x10,
+    0x21, 0x20, 0x01, 0xdf, 0xff, 0xc0, 0x00, 0x00, 0x4d, 0x0d, 0x2d, 0x0c, 0x3d, 0x01, 0x01, 0x5d,
+    0xff, 0xc0, 0x00, 0x00, 0x41, 0xd5, 0xff, 0xda, 0xff, 0x1a, 0x44, 0x48, 0x04, 0xd0, 0x64, 0x80,
+    0x41, 0xd2, 0xff, 0x1a, 0x44, 0x62, 0x64, 0x00, 0x61, 0xd1, 0xff, 0x10, 0x66, 0x80, 0x62, 0x26,
+    0x00, 0x67, 0x3f, 0x13, 0x31, 0xd0, 0xff, 0x10, 0x33, 0x80, 0x28, 0x03, 0x0c, 0x43, 0x85, 0x3a,
+    0x00, 0x26, 0x42, 0x16, 0x46, 0x13, 0x00, 0x00, 0x41, 0xca, 0xff, 0x22, 0x2c, 0x1a, 0x1a, 0x44,
+    0x48, 0x04, 0x20, 0x2f, 0xc0, 0x47, 0x32, 0x80, 0x06, 0xf6, 0xff, 0x22, 0x2c, 0x1a, 0x27, 0x3f,
+    0x38, 0x61, 0xc2, 0xff, 0x22, 0x2c, 0x1a, 0x1a, 0x66, 0x68, 0x06, 0x67, 0x32, 0xb9, 0x21, 0xbd,
+    0xff, 0x3d, 0x0c, 0x10, 0x22, 0x80, 0x01, 0x48, 0xff, 0xc0, 0x00, 0x00, 0x21, 0xba, 0xff, 0x1c,
+    0x03, 0x1a, 0x22, 0x01, 0xbf, 0xff, 0xc0, 0x00, 0x00, 0x0c, 0x02, 0x46, 0x03, 0x00, 0x5c, 0x32,
+    0x06, 0x02, 0x00, 0x00, 0x00, 0x5c, 0x42, 0x46, 0x00, 0x00, 0x5c, 0x52, 0x91, 0xb7, 0xff, 0x9a,
+    0x11, 0x08, 0x71, 0xc8, 0x61, 0xd8, 0x51, 0xe8, 0x41, 0xf8, 0x31, 0x12, 0xc1, 0x20, 0x0d, 0xf0,
+    0xb0, 0x10, 0x00, 0x00, 0xc0, 0x10, 0x00, 0x00, 0xd0, 0x10, 0x00, 0x00, 0x12, 0xc1, 0xe0, 0x91,
+    0xfe, 0xff, 0xc9, 0x61, 0xd9, 0x51, 0xe9, 0x41, 0x09, 0x71, 0xf9, 0x31, 0xcd, 0x03, 0x90, 0x11,
+    0xc0, 0xed, 0x02, 0xdd, 0x04, 0x31, 0xa1, 0xff, 0x9c, 0x14, 0x22, 0xa0, 0x62, 0x47, 0xb3, 0x02,
+    0x06, 0x2d, 0x00, 0x21, 0xf4, 0xff, 0x1a, 0x22, 0x49, 0x02, 0x86, 0x01, 0x00, 0x21, 0xf1, 0xff,
+    0x1a, 0x22, 0x39, 0x02, 0x21, 0x9c, 0xff, 0x2a, 0xf1, 0x2d, 0x0f, 0x01, 0x1f, 0xff, 0xc0, 0x00,
+    0x00, 0x46, 0x1c, 0x00, 0x22, 0xd1, 0x10, 0x01, 0x1c, 0xff, 0xc0, 0x00, 0x00, 0x21, 0xe9, 0xff,
+    0xfd, 0x0c, 0x1a, 0x22, 0x28, 0x02, 0xc7, 0xb2, 0x06, 0x21, 0xe6, 0xff, 0x1a, 0x22, 0xf8, 0x02,
+    0x2d, 0x0e, 0x3d, 0x01, 0x4d, 0x0f, 0x01, 0x95, 0xff, 0xc0, 0x00, 0x00, 0x8c, 0x52, 0x22, 0xa0,
+    0x63, 0xc6, 0x18, 0x00, 0x00, 0x21, 0x8b, 0xff, 0x3d, 0x01, 0x10, 0x22, 0x80, 0xf0, 0x4f, 0x20,
+    0x01, 0x11, 0xff, 0xc0, 0x00, 0x00, 0xac, 0x7d, 0x22, 0xd1, 0x10, 0x3d, 0x01, 0x4d, 0x0f, 0x01,
+    0x0d, 0xff, 0xc0, 0x00, 0x00, 0x21, 0xd6, 0xff, 0x32, 0xd1, 0x10, 0x10, 0x22, 0x80, 0x01, 0x0e,
+    0xff, 0xc0, 0x00, 0x00, 0x21, 0xd3, 0xff, 0x1c, 0x03, 0x1a, 0x22, 0x01, 0x85, 0xff, 0xc0, 0x00,
+    0x00, 0xfa, 0xee, 0xf0, 0xcc, 0xc0, 0x56, 0xac, 0xf8, 0x21, 0xcd, 0xff, 0x31, 0x7a, 0xff, 0x1a,
+    0x22, 0x3a, 0x31, 0x01, 0x05, 0xff, 0xc0, 0x00, 0x00, 0x21, 0xc9, 0xff, 0x1c, 0x03, 0x1a, 0x22,
+    0x01, 0x7c, 0xff, 0xc0, 0x00, 0x00, 0x2d, 0x0c, 0x91, 0xc8, 0xff, 0x9a, 0x11, 0x08, 0x71, 0xc8,
+    0x61, 0xd8, 0x51, 0xe8, 0x41, 0xf8, 0x31, 0x12, 0xc1, 0x20, 0x0d, 0xf0, 0x00, 0x02, 0x00, 0x60,
+    0x00, 0x00, 0x00, 0x10, 0x40, 0x02, 0x00, 0x60, 0xff, 0xff, 0xff, 0x00, 0x12, 0xc1, 0xe0, 0x0c,
+    0x02, 0x29, 0x01, 0x31, 0xfa, 0xff, 0x21, 0xfa, 0xff, 0x02, 0x61, 0x07, 0xc9, 0x61, 0xc0, 0x20,
+    0x00, 0x22, 0x63, 0x00, 0xc0, 0x20, 0x00, 0xc8, 0x03, 0x20, 0xcc, 0x10, 0x56, 0x4c, 0xff, 0x21,
+    0xf5, 0xff, 0xc0, 0x20, 0x00, 0x38, 0x02, 0x21, 0xf4, 0xff, 0x20, 0x23, 0x10, 0x29, 0x01, 0x0c,
+    0x43, 0x2d, 0x01, 0x01, 0x63, 0xff, 0xc0, 0x00, 0x00, 0x08, 0x71, 0x2d, 0x0c, 0xc8, 0x61, 0x12,
+    0xc1, 0x20, 0x0d, 0xf0, 0x00, 0x80, 0xfe, 0x3f, 0x84, 0x49, 0x00, 0x40, 0x12, 0xc1, 0xd0, 0xc9,
+    0xa1, 0x09, 0xb1, 0x7c, 0xfc, 0x22, 0xc1, 0x11, 0x0c, 0x13, 0xc5, 0x1c, 0x00, 0x26, 0x12, 0x02,
+    0x46, 0x30, 0x00, 0x22, 0x01, 0x11, 0xc2, 0x41, 0x10, 0xb6, 0x82, 0x02, 0x46, 0x2b, 0x00, 0x31,
+    0xf5, 0xff, 0x30, 0x22, 0xa0, 0x28, 0x02, 0xa0, 0x02, 0x00, 0x2d, 0x01, 0x1c, 0x03, 0x85, 0x1a,
+    0x00, 0x66, 0x82, 0x0a, 0x28, 0x01, 0x32, 0x21, 0x01, 0x05, 0xa6, 0xff, 0x06, 0x07, 0x00, 0x3c,
+    0x12, 0xc6, 0x05, 0x00, 0x00, 0x00, 0x10, 0x21, 0x20, 0x32, 0xa0, 0x10, 0x85, 0x18, 0x00, 0x66,
+    0xa2, 0x0f, 0x22, 0x21, 0x00, 0x38, 0x11, 0x48, 0x21, 0x05, 0xb3, 0xff, 0x22, 0x41, 0x10, 0x86,
+    0x1a, 0x00, 0x4c, 0x12, 0x06, 0xfd, 0xff, 0x2d, 0x01, 0x1c, 0x03, 0xc5, 0x16, 0x00, 0x66, 0xb2,
+    0x0e, 0x28, 0x01, 0x38, 0x11, 0x48, 0x21, 0x58, 0x31, 0x85, 0xcf, 0xff, 0x06, 0xf7, 0xff, 0x00,
+    0x5c, 0x12, 0x86, 0xf5, 0xff, 0x00, 0x10, 0x21, 0x20, 0x32, 0xa0, 0x10, 0x85, 0x14, 0x00, 0x66,
+    0xa2, 0x0d, 0x22, 0x21, 0x00, 0x38, 0x11, 0x48, 0x21, 0x05, 0xe1, 0xff, 0x06, 0xef, 0xff, 0x00,
+    0x22, 0xa0, 0x61, 0x46, 0xed, 0xff, 0x45, 0xf0, 0xff, 0xc6, 0xeb, 0xff, 0x00, 0x00, 0x01, 0xd2,
+    0xff, 0xc0, 0x00, 0x00, 0x06, 0xe9, 0xff, 0x00, 0x0c, 0x02, 0x22, 0x41, 0x10, 0x0c, 0x13, 0x22,
+    0xc1, 0x10, 0xc5, 0x0f, 0x00, 0x22, 0x01, 0x11, 0x06, 0x06, 0x00, 0x00, 0x00, 0x22, 0xc1, 0x10,
+    0x0c, 0x13, 0xc5, 0x0e, 0x00, 0x22, 0x01, 0x11, 0x32, 0xc2, 0xfa, 0x30, 0x30, 0x74, 0xb6, 0x23,
+    0x02, 0x06, 0xc8, 0xff, 0x08, 0xb1, 0xc8, 0xa1, 0x12, 0xc1, 0x30, 0x0d, 0xf0, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x10, 0x40, 0x4f, 0x48, 0x41, 0x49, 0x00, 0x75, 0x19, 0x03, 0x10, 0x27, 0x00, 0x00,
+    0x00, 0x11, 0x00, 0x40, 0xa8, 0x10, 0x00, 0x40, 0xbc, 0x0f, 0x00, 0x40, 0x58, 0x3f, 0x00, 0x40,
+    0xcc, 0x2e, 0x00, 0x40, 0x1c, 0xe2, 0x00, 0x40, 0xd8, 0x39, 0x00, 0x40, 0x80, 0x00, 0x00, 0x40,
+    0x21, 0xf4, 0xff, 0x12, 0xc1, 0xe0, 0xc9, 0x61, 0xc8, 0x02, 0x21, 0xf2, 0xff, 0x09, 0x71, 0x29,
+    0x01, 0x0c, 0x02, 0xd9, 0x51, 0xc9, 0x11, 0x01, 0xf4, 0xff, 0xc0, 0x00, 0x00, 0x01, 0xf3, 0xff,
+    0xc0, 0x00, 0x00, 0xac, 0x2c, 0x22, 0xa3, 0xe8, 0x01, 0xf2, 0xff, 0xc0, 0x00, 0x00, 0x21, 0xea,
+    0xff, 0xc0, 0x31, 0x41, 0x2a, 0x23, 0x3d, 0x0c, 0x01, 0xef, 0xff, 0xc0, 0x00, 0x00, 0x3d, 0x02,
+    0x22, 0xa0, 0x00, 0x01, 0xed, 0xff, 0xc0, 0x00, 0x00, 0xc1, 0xe4, 0xff, 0x2d, 0x0c, 0x01, 0xe8,
+    0xff, 0xc0, 0x00, 0x00, 0x2d, 0x01, 0x32, 0xa0, 0x04, 0x45, 0x04, 0x00, 0xc5, 0xe7, 0xff, 0xdd,
+    0x02, 0x2d, 0x0c, 0x01, 0xe3, 0xff, 0xc0, 0x00, 0x00, 0x66, 0x6d, 0x1f, 0x4b, 0x21, 0x31, 0xdc,
+    0xff, 0x46, 0x00, 0x00, 0x4b, 0x22, 0xc0, 0x20, 0x00, 0x48, 0x02, 0x37, 0x94, 0xf5, 0x31, 0xd9,
+    0xff, 0xc0, 0x20, 0x00, 0x39, 0x02, 0x3d, 0xf0, 0x86, 0x01, 0x00, 0x00, 0x01, 0xdc, 0xff, 0xc0,
+    0x00, 0x00, 0x08, 0x71, 0xc8, 0x61, 0xd8, 0x51, 0x12, 0xc1, 0x20, 0x0d, 0xf0, 0x00, 0x00, 0x00,
+    0x12, 0xc1, 0xf0, 0x02, 0x61, 0x03, 0x01, 0xea, 0xfe, 0xc0, 0x00, 0x00, 0x08, 0x31, 0x12, 0xc1,
+    0x10, 0x0d, 0xf0, 0x00, 0x64, 0x3b, 0x00, 0x40, 0x12, 0xc1, 0xd0, 0xe9, 0x81, 0x09, 0xb1, 0xc9,
+    0xa1, 0xd9, 0x91, 0xf9, 0x71, 0x29, 0x01, 0x39, 0x11, 0xe2, 0xa0, 0xc0, 0x01, 0xfa, 0xff, 0xc0,
+    0x00, 0x00, 0xcd, 0x02, 0xe7, 0x92, 0xf4, 0x0c, 0x0d, 0xe2, 0xa0, 0xc0, 0xf2, 0xa0, 0xdb, 0x86,
+    0x0d, 0x00, 0x00, 0x00, 0x01, 0xf4, 0xff, 0xc0, 0x00, 0x00, 0x20, 0x42, 0x20, 0xe7, 0x12, 0x40,
+    0xf7, 0x92, 0x1c, 0x22, 0x61, 0x02, 0x01, 0xef, 0xff, 0xc0, 0x00, 0x00, 0x52, 0xa0, 0xdc, 0x48,
+    0x21, 0x57, 0x12, 0x09, 0x52, 0xa0, 0xdd, 0x57, 0x12, 0x05, 0x46, 0x05, 0x00, 0x00, 0x4d, 0x0c,
+    0x38, 0x01, 0xda, 0x23, 0x42, 0x42, 0x00, 0x1b, 0xdd, 0x38, 0x11, 0x37, 0x9d, 0xc5, 0xc6, 0x00,
+    0x00, 0x00, 0x00, 0x0c, 0x0d, 0xc2, 0xa0, 0xc0, 0x01, 0xe3, 0xff, 0xc0, 0x00, 0x00, 0xc7, 0x92,
+    0xf6, 0x08, 0xb1, 0x2d, 0x0d, 0xc8, 0xa1, 0xd8, 0x91, 0xe8, 0x81, 0xf8, 0x71, 0x12, 0xc1, 0x30,
+    0x0d, 0xf0, 0x00, 0x00,
+};
+
+static const unsigned char espStubData[] = {
+    0xfe, 0x05, 0x10, 0x40, 0x1a, 0x06, 0x10, 0x40, 0x3b, 0x06, 0x10, 0x40, 0x5a, 0x06, 0x10, 0x40,
+    0x7a, 0x06, 0x10, 0x40, 0x82, 0x06, 0x10, 0x40, 0x8c, 0x06, 0x10, 0x40, 0x8c, 0x06, 0x10, 0x40,
+};
+
+#endif // ESPSTUBDATA_H
@@ -0,0 +1,126 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esptelemetry.h"
+
+#include <QtGlobal>
+#include <qmath.h>
+
+EspTelemetry::EspTelemetry() : mBaudRate(0) {
+    reset();
+}
+
+void EspTelemetry::reset() {
+    mPayloadBytes.storeRelease(0);
+    mWireBytes.storeRelease(0);
+    mReceivedBytes.storeRelease(0);
+    mEscapeBytes.storeRelease(0);
+    mFrames.storeRelease(0);
+    mTimeouts.storeRelease(0);
+    mRetries.storeRelease(0);
+    for(int i=0;i<ESP_TELEMETRY_BUCKETS;i++) {
+        mAckRtt[i].storeRelease(0);
+        mCommandRtt[i].storeRelease(0);
+    }
+    mRateStartMs = 0;
+    mRateBytes = 0;
+    mInstantRate.storeRelease(0);
+    mInstantRateMs.storeRelease(0);
+    mClock.start();
+}
+
+void EspTelemetry::addPayload(quint32 bytes) {
+    mPayloadBytes.fetchAndAddRelaxed(bytes);
+
+    // The rate is published once per window, the clock is read per block of
+    // payload, never per byte
+    mRateBytes += bytes;
+    qint64 now = mClock.elapsed();
+    qint64 span = now - mRateStartMs;
+    if(span >= ESP_TELEMETRY_RATE_WINDOW) {
+        mInstantRate.storeRelease((quint32)(mRateBytes * 1000 / span));
+        mInstantRateMs.storeRelease(now);
+        mRateStartMs = now;
+        mRateBytes = 0;
+    }
+}
+
+void EspTelemetry::addFrame(int dataBytes, int encodedBytes) {
+    // Two of the encoded bytes are the frame delimiters, the rest of the
+    // growth comes from escaping
+    mFrames.fetchAndAddRelaxed(1);
+    mWireBytes.fetchAndAddRelaxed(encodedBytes);
+    mEscapeBytes.fetchAndAddRelaxed(qMax(0, encodedBytes - dataBytes - 2));
+}
+
+int EspTelemetry::bucket(qint64 us) {
+    int b = 0;
+    while(b < ESP_TELEMETRY_BUCKETS - 1 && (us >> (ESP_TELEMETRY_FIRST_BUCKET + b)) > 0) b++;
+    return b;
+}
+
+EspTelemetrySnapshot EspTelemetry::snapshot() const {
+    EspTelemetrySnapshot snap;
+    snap.payloadBytes = mPayloadBytes.loadAcquire();
+    snap.wireBytes = mWireBytes.loadAcquire();
+    snap.receivedBytes = mReceivedBytes.loadAcquire();
+    snap.escapeBytes = mEscapeBytes.loadAcquire();
+    snap.frames = mFrames.loadAcquire();
+    snap.timeouts = mTimeouts.loadAcquire();
+    snap.retries = mRetries.loadAcquire();
+    snap.baudRate = mBaudRate.loadAcquire();
+    snap.elapsedMs = mClock.elapsed();
+
+    // A rate not refreshed for two windows belongs to a transfer that stopped
+    if(snap.elapsedMs - mInstantRateMs.loadAcquire() <= 2 * ESP_TELEMETRY_RATE_WINDOW) {
+        snap.instantThroughput = mInstantRate.loadAcquire();
+    }
+
+    snap.ackRtt.resize(ESP_TELEMETRY_BUCKETS);
+    snap.commandRtt.resize(ESP_TELEMETRY_BUCKETS);
+    for(int i=0;i<ESP_TELEMETRY_BUCKETS;i++) {
+        snap.ackRtt[i] = mAckRtt[i].loadAcquire();
+        snap.commandRtt[i] = mCommandRtt[i].loadAcquire();
+    }
+    return snap;
+}
+
+qint64 EspTelemetrySnapshot::bucketLimitUs(int bucket) {
+    return (qint64)1 << (ESP_TELEMETRY_FIRST_BUCKET + bucket);
+}
+
+qint64 EspTelemetrySnapshot::percentileUs(const QVector<quint32> &histogram, double percentile) {
+    // Upper limit of the bucket holding the percentile, 0 without samples
+    quint64 total = 0;
+    for(int i=0;i<histogram.size();i++) total += histogram.at(i);
+    if(total == 0) return 0;
+
+    quint64 target = qMax<quint64>(1, (quint64)qCeil(total * percentile));
+    quint64 count = 0;
+    for(int i=0;i<histogram.size();i++) {
+        count += histogram.at(i);
+        if(count >= target) return bucketLimitUs(i);
+    }
+    return bucketLimitUs(histogram.size() - 1);
+}
@@ -0,0 +1,110 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPTELEMETRY_H
+#define ESPTELEMETRY_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QVector>
+
+// Round trip histograms have one bucket per power of two: the first holds
+// everything below 2^ESP_TELEMETRY_FIRST_BUCKET us, the last everything
+// from about two seconds up
+#define ESP_TELEMETRY_BUCKETS       16
+#define ESP_TELEMETRY_FIRST_BUCKET  7
+// Time over which the instantaneous throughput is averaged, in milliseconds
+#define ESP_TELEMETRY_RATE_WINDOW   500
+
+// Values of an EspTelemetry at one point in time, a plain copy that may be
+// kept and compared freely
+class EspTelemetrySnapshot {
+public:
+    EspTelemetrySnapshot() : payloadBytes(0), wireBytes(0), receivedBytes(0), escapeBytes(0), frames(0), timeouts(0), retries(0), baudRate(0), elapsedMs(0), instantThroughput(0) { }
+    double averageThroughput() const { return elapsedMs ? payloadBytes * 1000.0 / elapsedMs : 0.0; }
+    double escapeOverhead() const { return wireBytes ? (double)escapeBytes / wireBytes : 0.0; }
+    static qint64 percentileUs(const QVector<quint32> &histogram, double percentile);
+    static qint64 bucketLimitUs(int bucket);
+public:
+    // Image bytes delivered, written or read back
+    quint64 payloadBytes;
+    // Bytes sent on the link, framing and commands included
+    quint64 wireBytes;
+    quint64 receivedBytes;
+    // Bytes added by SLIP escaping of the frames sent
+    quint64 escapeBytes;
+    quint64 frames;
+    quint32 timeouts;
+    quint32 retries;
+    int baudRate;
+    qint64 elapsedMs;
+    // Bytes per second over the last ESP_TELEMETRY_RATE_WINDOW
+    double instantThroughput;
+    // Stub write ack and ROM command reply round trips
+    QVector<quint32> ackRtt;
+    QVector<quint32> commandRtt;
+};
+
+// Live counters of an EspRom session. Every update is a relaxed atomic add
+// with no lock and no allocation, so it can stay on in production; any
+// thread may take a snapshot() while the session runs. Updates come from the
+// thread running the session only.
+class EspTelemetry {
+public:
+    EspTelemetry();
+    void reset();
+    void addPayload(quint32 bytes);
+    void addFrame(int dataBytes, int encodedBytes);
+    void addRaw(int bytes) { mWireBytes.fetchAndAddRelaxed(bytes); }
+    void addReceived(int bytes) { mReceivedBytes.fetchAndAddRelaxed(bytes); }
+    void addTimeout() { mTimeouts.fetchAndAddRelaxed(1); }
+    void addRetry() { mRetries.fetchAndAddRelaxed(1); }
+    void setBaudRate(int baudRate) { mBaudRate.storeRelease(baudRate); }
+    void addAckRtt(qint64 us) { mAckRtt[bucket(us)].fetchAndAddRelaxed(1); }
+    void addCommandRtt(qint64 us) { mCommandRtt[bucket(us)].fetchAndAddRelaxed(1); }
+    EspTelemetrySnapshot snapshot() const;
+    static int bucket(qint64 us);
+private:
+    QElapsedTimer mClock;
+    QAtomicInteger<quint64> mPayloadBytes;
+    QAtomicInteger<quint64> mWireBytes;
+    QAtomicInteger<quint64> mReceivedBytes;
+    QAtomicInteger<quint64> mEscapeBytes;
+    QAtomicInteger<quint64> mFrames;
+    QAtomicInteger<quint32> mTimeouts;
+    QAtomicInteger<quint32> mRetries;
+    QAtomicInt mBaudRate;
+    QAtomicInteger<quint32> mAckRtt[ESP_TELEMETRY_BUCKETS];
+    QAtomicInteger<quint32> mCommandRtt[ESP_TELEMETRY_BUCKETS];
+    // Instantaneous rate: the window is only touched by the updating thread,
+    // readers see the last published rate and when it was published
+    qint64 mRateStartMs;
+    quint64 mRateBytes;
+    QAtomicInteger<quint32> mInstantRate;
+    QAtomicInteger<qint64> mInstantRateMs;
+private:
+    Q_DISABLE_COPY(EspTelemetry)
+};
+
+#endif // ESPTELEMETRY_H
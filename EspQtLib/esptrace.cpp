@@ -0,0 +1,206 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "esptrace.h"
+
+#include <QThread>
+#include <QDateTime>
+#include <QtEndian>
+
+#include <string.h>
+
+#define ERR_TraceOpen   "Unable to open trace file %1"
+#define ERR_TraceWrite  "Unable to write trace file: %1"
+#define ERR_TraceFormat "Not a trace file"
+#define ERR_TraceVersion    "Unsupported trace version %1"
+#define ERR_TraceTruncated  "Trace file truncated"
+
+// Moves the records from the buffer to the file until stopped
+class EspTraceRecorder::Writer : public QThread {
+public:
+    Writer(EspTraceRecorder *recorder) : mRecorder(recorder), mStop(0) { }
+    void stop() { mStop.storeRelease(1); }
+protected:
+    virtual void run() {
+        while(!mStop.loadAcquire()) {
+            mRecorder->drain();
+            msleep(ESP_TRACE_FLUSH_MS);
+        }
+        mRecorder->drain();
+    }
+private:
+    EspTraceRecorder *mRecorder;
+    QAtomicInt mStop;
+};
+
+// Offsets in the ring are masked, its size is rounded up to a power of two
+static quint32 ringSize(quint32 size) {
+    quint32 ring = 0x1000;
+    while(ring < size && ring < 0x40000000) ring <<= 1;
+    return ring;
+}
+
+EspTraceRecorder::EspTraceRecorder(const QString &fileName, const QString &label, quint32 bufferSize) : mFile(fileName), mOpen(false), mMask(ringSize(bufferSize) - 1), mHead(0), mTail(0), mDropped(0), mWriter(0) {
+    if(!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        mErrorString = QString(ERR_TraceOpen).arg(fileName);
+        qDebug("EspTraceRecorder %s", mErrorString.toLatin1().constData());
+        return;
+    }
+
+    QByteArray name = label.toUtf8().left(0xFFFF);
+    QByteArray header(ESP_TRACE_MAGIC);
+    uchar fields[12];
+    qToLittleEndian<quint16>(ESP_TRACE_VERSION, fields);
+    qToLittleEndian<quint16>(name.size(), fields + 2);
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), fields + 4);
+    header.append((const char *)fields, sizeof(fields));
+    header.append(name);
+    mFile.write(header);
+
+    // Preallocated once, recording never allocates
+    mBuffer.resize(mMask + 1);
+    mClock.start();
+    mOpen = true;
+
+    mWriter = new Writer(this);
+    mWriter->start(QThread::LowPriority);
+}
+
+EspTraceRecorder::~EspTraceRecorder() {
+    if(mWriter) {
+        mWriter->stop();
+        mWriter->wait();
+        delete mWriter;
+    }
+    if(mDropped.loadAcquire()) qDebug("EspTraceRecorder dropped %llu records", mDropped.loadAcquire());
+    mFile.close();
+}
+
+void EspTraceRecorder::record(EspTraceRecord::Type type, const char *data, int len) {
+    if(!mOpen) return;
+
+    len = qMin(len, 0xFFFF);
+    quint32 need = ESP_TRACE_RECORD_HEADER + len;
+    quint32 head = mHead.loadAcquire();
+    quint32 tail = mTail.loadAcquire();
+    if(need > (quint32)mBuffer.size() - (head - tail)) {
+        mDropped.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    uchar header[ESP_TRACE_RECORD_HEADER];
+    qToLittleEndian<quint64>(mClock.nsecsElapsed() / 1000, header);
+    header[8] = type;
+    header[9] = 0;
+    qToLittleEndian<quint16>(len, header + 10);
+    copyIn(head, (const char *)header, sizeof(header));
+    copyIn(head + sizeof(header), data, len);
+
+    // Published only once complete, the writer never sees half a record
+    mHead.storeRelease(head + need);
+}
+
+void EspTraceRecorder::baudRate(int baudRate) {
+    uchar data[4];
+    qToLittleEndian<quint32>(baudRate, data);
+    record(EspTraceRecord::BaudRate, (const char *)data, sizeof(data));
+}
+
+void EspTraceRecorder::copyIn(quint32 position, const char *data, int len) {
+    quint32 offset = position & mMask;
+    quint32 first = qMin<quint32>(len, mBuffer.size() - offset);
+    memcpy(mBuffer.data() + offset, data, first);
+    if(first < (quint32)len) memcpy(mBuffer.data(), data + first, len - first);
+}
+
+bool EspTraceRecorder::drain() {
+    quint32 head = mHead.loadAcquire();
+    quint32 tail = mTail.loadAcquire();
+    bool res = true;
+
+    while(tail != head) {
+        quint32 offset = tail & mMask;
+        quint32 chunk = qMin<quint32>(head - tail, mBuffer.size() - offset);
+        if(mFile.write(mBuffer.constData() + offset, chunk) != (qint64)chunk && res) {
+            // The records are released anyway, a full disk must not stall the session
+            qDebug("%s", qPrintable(QString(ERR_TraceWrite).arg(mFile.errorString())));
+            res = false;
+        }
+        tail += chunk;
+        mTail.storeRelease(tail);
+    }
+
+    mFile.flush();
+    return res;
+}
+
+EspTraceReader::EspTraceReader(QIODevice *device) : mDevice(device), mStartMs(0) {
+}
+
+bool EspTraceReader::readHeader() {
+    QByteArray magic = mDevice->read(8);
+    QByteArray fields = mDevice->read(12);
+    if(magic != ESP_TRACE_MAGIC || fields.size() != 12) {
+        mErrorString = ERR_TraceFormat;
+        return false;
+    }
+
+    const uchar *ptr = (const uchar *)fields.constData();
+    quint16 version = qFromLittleEndian<quint16>(ptr);
+    if(version != ESP_TRACE_VERSION) {
+        mErrorString = QString(ERR_TraceVersion).arg(version);
+        return false;
+    }
+
+    quint16 labelSize = qFromLittleEndian<quint16>(ptr + 2);
+    mStartMs = qFromLittleEndian<qint64>(ptr + 4);
+    QByteArray label = mDevice->read(labelSize);
+    if(label.size() != labelSize) {
+        mErrorString = ERR_TraceTruncated;
+        return false;
+    }
+    mLabel = QString::fromUtf8(label);
+    return true;
+}
+
+bool EspTraceReader::next(EspTraceRecord &record) {
+    char header[ESP_TRACE_RECORD_HEADER];
+    qint64 len = mDevice->read(header, sizeof(header));
+    if(len == 0) return false;
+    if(len != sizeof(header)) {
+        mErrorString = ERR_TraceTruncated;
+        return false;
+    }
+
+    const uchar *ptr = (const uchar *)header;
+    record.timeUs = qFromLittleEndian<quint64>(ptr);
+    record.type = ptr[8];
+    quint16 size = qFromLittleEndian<quint16>(ptr + 10);
+    record.data = mDevice->read(size);
+    if(record.data.size() != size) {
+        mErrorString = ERR_TraceTruncated;
+        return false;
+    }
+    return true;
+}
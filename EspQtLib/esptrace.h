@@ -0,0 +1,113 @@
+/*
+ * ESP8266 ROM Bootloader C++/QT5 Utility
+ *
+ * This file is part of the espqtlib library.
+ *     (https://github.com/persuader72/EspQtLib)
+ * Copyright (c) 2016 Stefano Pagnottelli
+ *
+ * This work is inspered from the esptoool.py
+ *     (https://github.com/espressif/esptool)
+ * Copyright (C) 2014-2016 Fredrik Ahlberg, Angus Gratton, Espressif Systems, other contributors as noted.
+ *
+ * espqtlib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * espqtlib is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESPTRACE_H
+#define ESPTRACE_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+
+class QIODevice;
+
+// Trace file layout, all values little endian:
+//   header: magic "ESPTRACE", u16 version, u16 label length, i64 start time
+//           in ms since the epoch, label (UTF-8)
+//   record: u64 time in us from the start, u8 type, u8 reserved, u16 length,
+//           then length bytes of data
+#define ESP_TRACE_MAGIC         "ESPTRACE"
+#define ESP_TRACE_VERSION       1
+#define ESP_TRACE_RECORD_HEADER 12
+// Size of the record buffer, must be a power of two
+#define ESP_TRACE_BUFFER        0x100000
+// Period of the writer thread, in milliseconds
+#define ESP_TRACE_FLUSH_MS      50
+
+// One record of a trace
+class EspTraceRecord {
+public:
+    // Frames are traced decoded, SLIP framing is not recorded
+    enum Type { FrameSent=1, FrameReceived=2, RawSent=3, BaudRate=4, Marker=5 };
+    EspTraceRecord() : timeUs(0), type(0) { }
+public:
+    quint64 timeUs;
+    quint8 type;
+    QByteArray data;
+};
+
+// Records the traffic of one session to a file. record() copies the bytes
+// into a lock free ring buffer and returns, a writer thread moves them to
+// disk; when the disk falls behind records are dropped and counted, the
+// session is never slowed down. Records must come from a single thread,
+// the one running the session.
+class EspTraceRecorder {
+public:
+    EspTraceRecorder(const QString &fileName, const QString &label=QString(), quint32 bufferSize=ESP_TRACE_BUFFER);
+    ~EspTraceRecorder();
+    bool isOpen() const { return mOpen; }
+    QString errorString() const { return mErrorString; }
+    void record(EspTraceRecord::Type type, const char *data, int len);
+    void record(EspTraceRecord::Type type, const QByteArray &data) { record(type, data.constData(), data.size()); }
+    void baudRate(int baudRate);
+    void marker(const QString &text) { record(EspTraceRecord::Marker, text.toUtf8()); }
+    quint64 droppedRecords() const { return mDropped.loadAcquire(); }
+private:
+    class Writer;
+    friend class Writer;
+    void copyIn(quint32 position, const char *data, int len);
+    bool drain();
+private:
+    QFile mFile;
+    bool mOpen;
+    QString mErrorString;
+    QElapsedTimer mClock;
+    QByteArray mBuffer;
+    quint32 mMask;
+    QAtomicInteger<quint32> mHead;
+    QAtomicInteger<quint32> mTail;
+    QAtomicInteger<quint64> mDropped;
+    Writer *mWriter;
+private:
+    Q_DISABLE_COPY(EspTraceRecorder)
+};
+
+// Reads back a trace written by EspTraceRecorder
+class EspTraceReader {
+public:
+    EspTraceReader(QIODevice *device);
+    bool readHeader();
+    bool next(EspTraceRecord &record);
+    QString label() const { return mLabel; }
+    qint64 startMsecsSinceEpoch() const { return mStartMs; }
+    QString errorString() const { return mErrorString; }
+private:
+    QIODevice *mDevice;
+    QString mLabel;
+    qint64 mStartMs;
+    QString mErrorString;
+};
+
+#endif // ESPTRACE_H
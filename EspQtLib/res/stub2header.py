@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+#
+# Converts a flasher stub in the esptool JSON format into the C++ header
+# compiled in the library, so the stub needs no parsing at run time.
+#
+#   python3 res/stub2header.py res/stub_flasher.json espstubdata.h
+
+import json
+import sys
+
+
+def array(name, data):
+    lines = ['static const unsigned char %s[] = {' % name]
+    for i in range(0, len(data), 16):
+        lines.append('    ' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+    if not data:
+        lines.append('    0x00')
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: stub2header.py stub.json header.h')
+
+    with open(sys.argv[1]) as f:
+        stub = json.loads(f.read().replace('\\\n', ''))
+
+    code = bytes.fromhex(stub['code'])
+    data = bytes.fromhex(stub.get('data', ''))
+
+    out = [
+        '// Generated by res/stub2header.py from %s, do not edit' % sys.argv[1].split('/')[-1],
+        '',
+        '#ifndef ESPSTUBDATA_H',
+        '#define ESPSTUBDATA_H',
+        '',
+        '#define ESP_STUB_CODE_START   0x%08x' % stub['code_start'],
+        '#define ESP_STUB_DATA_START   0x%08x' % stub.get('data_start', 0),
+        '#define ESP_STUB_PARAMS_START 0x%08x' % stub['params_start'],
+        '#define ESP_STUB_ENTRY        0x%08x' % stub['entry'],
+        '#define ESP_STUB_NUM_PARAMS   %d' % stub['num_params'],
+        '#define ESP_STUB_CODE_SIZE    %d' % len(code),
+        '#define ESP_STUB_DATA_SIZE    %d' % len(data),
+        '',
+        array('espStubCode', code),
+        '',
+        array('espStubData', data),
+        '',
+        '#endif // ESPSTUBDATA_H',
+        '',
+    ]
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
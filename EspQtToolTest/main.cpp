@@ -29,6 +29,12 @@ int main(int argc, char *argv[]) {
     parser.addVersionOption();
     parser.addOption(QCommandLineOption(QStringList() << "p" << "port", QCoreApplication::translate("main", "Serial port name"), "name", "/dev/ttyUSB0"));
     parser.addOption(QCommandLineOption(QStringList() << "b" << "baud", QCoreApplication::translate("main", "Serial port baudrate"), "name", QString::number(115200)));
+    parser.addOption(QCommandLineOption(QStringList() << "d" << "diff", QCoreApplication::translate("main", "Write only the sectors that differ from the flash content")));
+    parser.addOption(QCommandLineOption(QStringList() << "v" << "verify", QCoreApplication::translate("main", "Verify the written sectors against their digests")));
+    parser.addOption(QCommandLineOption(QStringList() << "s" << "skip-blank", QCoreApplication::translate("main", "Erase the blank sectors of the image instead of sending them")));
+    parser.addOption(QCommandLineOption(QStringList() << "a" << "auto-baud", QCoreApplication::translate("main", "Negotiate the fastest stable baudrate for the flasher")));
+    parser.addOption(QCommandLineOption(QStringList() << "t" << "trace", QCoreApplication::translate("main", "Record the protocol traffic to this file"), "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "r" << "resume", QCoreApplication::translate("main", "Resume an interrupted write, progress is kept in this journal"), "file"));
     parser.addPositionalArgument("command", QCoreApplication::translate("main", "Perform commands"));
     parser.process(app);
 
@@ -36,7 +42,7 @@ int main(int argc, char *argv[]) {
     QString portname = parser.value("port");
     int baudrate =  parser.value("baud").toInt(&ok);
 
-    MainClass *mc = new MainClass(portname,  baudrate);
+    MainClass *mc = new MainClass(portname,  baudrate, parser.value("trace"));
     Q_UNUSED(mc);
 
     /*QFile f("rboot.bin");
@@ -24,11 +24,12 @@
 
 #include <QDebug>
 #include <QFile>
+#include <QFileInfo>
 #include <QCoreApplication>
 #include <QCommandLineParser>
 
-MainClass::MainClass(const QString &portname, int baud, QObject *parent) : QObject(parent) {
-    mEspInt = new EspInterface(portname, baud, this);
+MainClass::MainClass(const QString &portname, int baud, const QString &traceFile, QObject *parent) : QObject(parent) {
+    mEspInt = new EspInterface(portname, baud, traceFile, this);
     connect(mEspInt, SIGNAL(operationCompleted(int,bool)),this,SLOT(onOperationTerminated(int,bool)));
 }
 
@@ -44,42 +45,48 @@ void MainClass::chipIdDone() {
     qApp->exit();
 }
 
-void MainClass::readFlash(quint32 address, quint32 size) {
-    mEspInt->readFlash(address, size);
+void MainClass::readFlash(quint32 address, quint32 size, const QString &filename) {
+    mEspInt->readFlashFile(address, size, filename);
 }
 
-void MainClass::readFlashDone(const QByteArray &data) {
-    QString filename = "out.bin";
+void MainClass::readFlashDone(const QString &filename) {
     QTextStream out(stdout);
-    QFile file(filename);
-    if(file.open(QIODevice::WriteOnly)) {
-        file.write(data);
-        file.close();
-        out << QString("Writed %1 bytes of flash memory on file %2\n").arg(data.size()).arg(filename);
-    } else {
-        out << QString("Failed to write file %1\n").arg(filename);
-    }
+    out << QString("Writed %1 bytes of flash memory on file %2\n").arg(QFileInfo(filename).size()).arg(filename);
     qApp->exit();
 }
 
 void MainClass::writeFlash(quint32 address, const QString &filename) {
     QTextStream out(stdout);
-    QFile file(filename);
 
-    if(file.open(QIODevice::ReadOnly)) {
-        QByteArray data =  file.readAll();
-        mEspInt->writeFlash(address, data, true);
+    if(QFileInfo(filename).isReadable()) {
+        mEspInt->writeFlashFile(address, filename, true);
     } else {
         out << QString("Failed to read file %1\n").arg(filename);
+        qApp->exit();
     }
 }
 
 void MainClass::writeFlashDone() {
     QTextStream out(stdout);
-    out << QString("Writed X bytes to flash  memory\n");
+    EspWriteStats stats = mEspInt->writeStats();
+    out << QString("Writed %1 bytes to flash memory in %2 ms (%3 bytes/s)\n").arg(stats.payloadBytes).arg(stats.elapsedMs).arg(stats.throughput(), 0, 'f', 0);
+    if(stats.window) out << QString("Window %1 bytes, ack round trip %2 us, link use %3%\n").arg(stats.window).arg(stats.ackRttUs).arg(stats.linkUtilisation * 100, 0, 'f', 0);
+    if(stats.skippedBytes) out << QString("Skipped %1 blank bytes\n").arg(stats.skippedBytes);
+    if(stats.resumedBytes) out << QString("Resumed, %1 bytes were already in flash\n").arg(stats.resumedBytes);
+    if(stats.verified) out << QString("Verified, all blocks match\n");
+    printTelemetry();
     qApp->exit();
 }
 
+void MainClass::printTelemetry() {
+    QTextStream out(stdout);
+    EspTelemetrySnapshot link = mEspInt->telemetry();
+    out << QString("Link %1 baud, %2 bytes sent, SLIP escapes %3%, %4 timeouts, %5 retries\n").arg(link.baudRate).arg(link.wireBytes).arg(link.escapeOverhead() * 100, 0, 'f', 1).arg(link.timeouts).arg(link.retries);
+    if(EspTelemetrySnapshot::percentileUs(link.ackRtt, 0.5)) {
+        out << QString("Ack round trip p50 < %1 us, p99 < %2 us\n").arg(EspTelemetrySnapshot::percentileUs(link.ackRtt, 0.5)).arg(EspTelemetrySnapshot::percentileUs(link.ackRtt, 0.99));
+    }
+}
+
 void MainClass::flashId() {
     mEspInt->flashId();
 }
@@ -93,6 +100,21 @@ void MainClass::flashIdDone() {
     qApp->exit();
 }
 
+void MainClass::inventory() {
+    mEspInt->deviceInventory();
+}
+
+void MainClass::inventoryDone() {
+    QTextStream out(stdout);
+    QVariantMap inventory = mEspInt->operationResultData().toMap();
+    quint32 flashid = inventory.value("flashId").toUInt();
+    out << QString("MAC: %1\n").arg(QString(inventory.value("macId").toByteArray().toHex()));
+    out << QString("Chip ID: %1\n").arg(inventory.value("chipId").toUInt(), 8, 16, QChar('0'));
+    out << QString("Flash manufacturer: %1\n").arg(flashid & 0xFF, 2, 16, QChar('0'));
+    out << QString("Flash device: %1%2\n").arg((flashid>>8) & 0xFF, 2, 16, QChar('0')).arg((flashid>>16) & 0xFF, 2, 16, QChar('0'));
+    qApp->exit();
+}
+
 void MainClass::executeCommand() {
     QCommandLineParser parser;
     parser.setApplicationDescription("EspQtTool - Tool for read/write flash of esp8266");
@@ -100,10 +122,24 @@ void MainClass::executeCommand() {
     parser.addVersionOption();
     parser.addOption(QCommandLineOption(QStringList() << "p" << "port", QCoreApplication::translate("main", "Serial port name"), "name", "/dev/ttyUSB0"));
     parser.addOption(QCommandLineOption(QStringList() << "b" << "baud", QCoreApplication::translate("main", "Serial port baudrate"), "name", QString::number(115200)));
+    parser.addOption(QCommandLineOption(QStringList() << "d" << "diff", QCoreApplication::translate("main", "Write only the sectors that differ from the flash content")));
+    parser.addOption(QCommandLineOption(QStringList() << "v" << "verify", QCoreApplication::translate("main", "Verify the written sectors against their digests")));
+    parser.addOption(QCommandLineOption(QStringList() << "s" << "skip-blank", QCoreApplication::translate("main", "Erase the blank sectors of the image instead of sending them")));
+    parser.addOption(QCommandLineOption(QStringList() << "a" << "auto-baud", QCoreApplication::translate("main", "Negotiate the fastest stable baudrate for the flasher")));
+    parser.addOption(QCommandLineOption(QStringList() << "t" << "trace", QCoreApplication::translate("main", "Record the protocol traffic to this file"), "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "r" << "resume", QCoreApplication::translate("main", "Resume an interrupted write, progress is kept in this journal"), "file"));
     parser.addPositionalArgument("command", QCoreApplication::translate("main", "Perform commands"));
     parser.process(*qApp);
 
     const QStringList args = parser.positionalArguments();
+    EspRom::WriteOptions options = EspRom::WriteDefault;
+    if(parser.isSet("diff")) options |= EspRom::WriteDifferential;
+    if(parser.isSet("verify")) options |= EspRom::WriteVerify;
+    if(parser.isSet("skip-blank")) options |= EspRom::WriteSkipBlank;
+    if(parser.isSet("resume")) options |= EspRom::WriteResume;
+    mEspInt->setWriteOptions(options);
+    mEspInt->setResumeJournal(parser.value("resume"));
+    mEspInt->setAutoBaud(parser.isSet("auto-baud"));
 
     if(args.size() < 1) {
         QTextStream out(stdout);
@@ -115,6 +151,8 @@ void MainClass::executeCommand() {
             chipId();
         } else if(args.at(0) == "flash_id") {
             flashId();
+        } else if(args.at(0) == "inventory") {
+            inventory();
         } else if(args.at(0) == "write_flash") {
             if(args.size() >= 3) {
                 bool ok;
@@ -127,7 +165,8 @@ void MainClass::executeCommand() {
                 bool ok;
                 quint32 address = args.at(1).mid(0,2)=="0x" ? args.at(1).toInt(&ok,16) : args.at(1).toInt(&ok,10);
                 quint32 size = args.at(2).mid(0,2)=="0x" ? args.at(2).toInt(&ok,16) : args.at(2).toInt(&ok,10);
-                readFlash(address, size);
+                QString filename = args.size() >= 4 ? args.at(3) : QString("out.bin");
+                readFlash(address, size, filename);
             }
         }
 
@@ -141,6 +180,10 @@ void MainClass::onOperationTerminated(int op, bool res) {
     if(res == false) {
         QTextStream out(stdout);
         out << QCoreApplication::translate("main", "Error %1.\n\n").arg(mEspInt->lastError());
+        if(op == EspInterface::opWriteFlash) {
+            QList<quint32> mismatches = mEspInt->writeStats().mismatchedBlocks;
+            for(int i=0;i<mismatches.size();i++) out << QString("Block at 0x%1 differs\n").arg(mismatches.at(i), 6, 16, QChar('0'));
+        }
         qApp->exit();
     } else {
         if(op == EspInterface::opConnect) {
@@ -149,8 +192,10 @@ void MainClass::onOperationTerminated(int op, bool res) {
             chipIdDone();
         } else if(op == EspInterface::opFlashId) {
             flashIdDone();
+        } else if(op == EspInterface::opInventory) {
+            inventoryDone();
         } else if(op == EspInterface::opReadFlash) {
-            readFlashDone(mEspInt->operationResultData().toByteArray());
+            readFlashDone(mEspInt->operationResultData().toString());
         } else if(op == EspInterface::opWriteFlash) {
             writeFlashDone();
         }
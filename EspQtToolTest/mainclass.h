@@ -9,15 +9,18 @@ class EspInterface;
 class MainClass : QObject {
     Q_OBJECT
 public:
-    MainClass(const QString &portname, int baud, QObject *parent=0);
+    MainClass(const QString &portname, int baud, const QString &traceFile=QString(), QObject *parent=0);
     void chipId();
     void chipIdDone();
-    void readFlash(quint32 address, quint32 size);
-    void readFlashDone(const QByteArray &data);
+    void readFlash(quint32 address, quint32 size, const QString &filename);
+    void readFlashDone(const QString &filename);
     void writeFlash(quint32 address, const QString &filename);
     void writeFlashDone();
+    void printTelemetry();
     void flashId();
     void flashIdDone();
+    void inventory();
+    void inventoryDone();
     void executeCommand();
 private slots:
     void onOperationTerminated(int op, bool res);
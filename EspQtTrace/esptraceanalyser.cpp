@@ -0,0 +1,229 @@
+#include "esptraceanalyser.h"
+#include "esptelemetry.h"
+#include "espprotocol.h"
+
+#include <QDateTime>
+#include <QStringList>
+#include <QtEndian>
+
+// Header of ROM commands and replies, replies end with their status bytes
+#define ROM_HEADER 8
+
+EspLatencyStats::EspLatencyStats() : count(0), failed(0), lost(0), totalUs(0), minUs(0), maxUs(0), histogram(ESP_TELEMETRY_BUCKETS, 0) {
+}
+
+void EspLatencyStats::add(quint64 us) {
+    if(count == 0 || us < minUs) minUs = us;
+    if(us > maxUs) maxUs = us;
+    totalUs += us;
+    count++;
+    histogram[EspTelemetry::bucket(us)]++;
+}
+
+EspTraceAnalyser::EspTraceAnalyser(quint64 gapUs) : mGapUs(gapUs), mTimeline(0), mStubCommand(0), mStubStartUs(0), mStubArgs(false), mRawOffset(0),
+    mRecords(0), mLastUs(0), mFramesSent(0), mFramesReceived(0), mBytesSent(0), mBytesReceived(0), mRawBytes(0), mUnmatched(0), mGaps(0), mLongestGapUs(0), mBaudChanges(0) {
+}
+
+void EspTraceAnalyser::add(const EspTraceRecord &record) {
+    // Silences on the link are where a slow station spends its time
+    if(mRecords > 0 && record.timeUs - mLastUs >= mGapUs) {
+        mGaps++;
+        event(mLastUs, QString("idle for %1").arg(formatUs(record.timeUs - mLastUs)));
+    }
+    if(mRecords > 0) mLongestGapUs = qMax(mLongestGapUs, record.timeUs - mLastUs);
+    mLastUs = record.timeUs;
+    mRecords++;
+
+    switch(record.type) {
+    case EspTraceRecord::FrameSent: frameSent(record); break;
+    case EspTraceRecord::FrameReceived: frameReceived(record); break;
+    case EspTraceRecord::RawSent: rawSent(record); break;
+    case EspTraceRecord::BaudRate:
+        if(record.data.size() == 4) {
+            mBaudChanges++;
+            event(record.timeUs, QString("baud rate %1").arg(qFromLittleEndian<quint32>((const uchar *)record.data.constData())));
+        }
+        break;
+    case EspTraceRecord::Marker: event(record.timeUs, QString::fromUtf8(record.data)); break;
+    default: break;
+    }
+}
+
+void EspTraceAnalyser::finish() {
+    // Whatever is still waiting was never answered
+    for(int i=0;i<mPendingRom.size();i++) mStats[romCommandName(mPendingRom.at(i).first)].lost++;
+    mPendingRom.clear();
+    if(mStubCommand) mStats[stubCommandName(mStubCommand)].lost++;
+    mStubCommand = 0;
+}
+
+void EspTraceAnalyser::frameSent(const EspTraceRecord &record) {
+    const QByteArray &data = record.data;
+    mFramesSent++;
+    mBytesSent += data.size();
+
+    if(mStubCommand && mStubArgs) {
+        // Checked first, the arguments may look like a ROM command
+        mStubArgs = false;
+        QStringList args;
+        for(int i=0;i+4<=data.size();i+=4) args << QString("0x%1").arg(qFromLittleEndian<quint32>((const uchar *)data.constData() + i), 0, 16);
+        event(record.timeUs, QString("-> %1 %2").arg(stubCommandName(mStubCommand)).arg(args.join(' ')));
+    } else if(data.size() >= ROM_HEADER && data.at(0) == 0x00) {
+        quint8 op = data.at(1);
+        // Talking to the ROM again, the stub session is over
+        if(mStubCommand) {
+            mStats[stubCommandName(mStubCommand)].lost++;
+            mStubCommand = 0;
+        }
+        // Syncs are only repeated after a timeout, the earlier ones are lost
+        if(op == 0x08) {
+            for(int i=mPendingRom.size()-1;i>=0;i--) {
+                if(mPendingRom.at(i).first != op) continue;
+                mStats[romCommandName(op)].lost++;
+                mPendingRom.removeAt(i);
+            }
+        }
+        mPendingRom.append(qMakePair(op, record.timeUs));
+        event(record.timeUs, QString("-> %1, %2 bytes").arg(romCommandName(op)).arg(data.size() - ROM_HEADER));
+    } else if(data.size() == 1) {
+        if(mStubCommand) mStats[stubCommandName(mStubCommand)].lost++;
+        mStubCommand = data.at(0);
+        mStubStartUs = record.timeUs;
+        mStubArgs = true;
+        mRawOffset = 0;
+        mWriteMarks.clear();
+    }
+}
+
+void EspTraceAnalyser::rawSent(const EspTraceRecord &record) {
+    mRawBytes += record.data.size();
+    mRawOffset += record.data.size();
+    if(mStubCommand == CMD_FLASH_WRITE) mWriteMarks.enqueue(qMakePair(mRawOffset, record.timeUs));
+}
+
+void EspTraceAnalyser::frameReceived(const EspTraceRecord &record) {
+    const QByteArray &data = record.data;
+    mFramesReceived++;
+    mBytesReceived += data.size();
+
+    if(mStubCommand) {
+        if(data.size() == 1) {
+            endStubCommand(record.timeUs, (quint8)data.at(0));
+        } else if(data.size() == 4 && mStubCommand == CMD_FLASH_WRITE) {
+            // The round trip of the newest chunk the ack covers
+            quint32 offset = qFromLittleEndian<quint32>((const uchar *)data.constData());
+            qint64 sentAt = -1;
+            while(!mWriteMarks.isEmpty() && mWriteMarks.head().first <= offset) sentAt = mWriteMarks.dequeue().second;
+            if(sentAt >= 0) mStats["stub write ack"].add(record.timeUs - sentAt);
+        }
+        return;
+    }
+
+    if(data.size() >= ROM_HEADER && data.at(0) == 0x01) {
+        quint8 op = data.at(1);
+        int pending = -1;
+        for(int i=0;i<mPendingRom.size() && pending<0;i++) if(mPendingRom.at(i).first == op) pending = i;
+        if(pending < 0) {
+            // Extra sync replies, or the answer to a command given up on
+            mUnmatched++;
+            return;
+        }
+
+        // Commands queued before this one were skipped by the ROM
+        for(int i=0;i<pending;i++) mStats[romCommandName(mPendingRom.at(i).first)].lost++;
+        quint64 sentAt = mPendingRom.at(pending).second;
+        mPendingRom = mPendingRom.mid(pending + 1);
+
+        EspLatencyStats &stats = mStats[romCommandName(op)];
+        stats.add(record.timeUs - sentAt);
+        bool ok = data.size() >= ROM_HEADER + 2 && data.at(data.size() - 2) == 0;
+        if(!ok) stats.failed++;
+        event(record.timeUs, QString("<- %1 %2 in %3").arg(romCommandName(op)).arg(ok ? "ok" : "failed").arg(formatUs(record.timeUs - sentAt)));
+    } else if(data.contains("OHAI")) {
+        event(record.timeUs, "<- stub greeting");
+    } else {
+        mUnmatched++;
+    }
+}
+
+void EspTraceAnalyser::endStubCommand(quint64 timeUs, int status) {
+    EspLatencyStats &stats = mStats[stubCommandName(mStubCommand)];
+    stats.add(timeUs - mStubStartUs);
+    if(status != 0) stats.failed++;
+    event(timeUs, QString("<- %1 status %2 in %3").arg(stubCommandName(mStubCommand)).arg(status).arg(formatUs(timeUs - mStubStartUs)));
+    mStubCommand = 0;
+    mWriteMarks.clear();
+}
+
+void EspTraceAnalyser::event(quint64 timeUs, const QString &text) {
+    if(!mTimeline) return;
+    *mTimeline << qSetFieldWidth(12) << right << formatUs(timeUs) << qSetFieldWidth(0) << "  " << text << endl;
+}
+
+void EspTraceAnalyser::printSummary(QTextStream &out, const EspTraceReader &reader) const {
+    QDateTime start = QDateTime::fromMSecsSinceEpoch(reader.startMsecsSinceEpoch());
+    out << QString("Trace of %1 started %2, %3 long\n").arg(reader.label().isEmpty() ? QString("unnamed session") : reader.label()).arg(start.toString(Qt::ISODate)).arg(formatUs(mLastUs));
+    out << QString("%1 records, %2 frames sent (%3 bytes), %4 raw bytes, %5 frames received (%6 bytes)\n")
+           .arg(mRecords).arg(mFramesSent).arg(mBytesSent).arg(mRawBytes).arg(mFramesReceived).arg(mBytesReceived);
+    out << QString("%1 baud changes, %2 unmatched replies, %3 idle gaps, longest silence %4\n")
+           .arg(mBaudChanges).arg(mUnmatched).arg(mGaps).arg(formatUs(mLongestGapUs));
+}
+
+void EspTraceAnalyser::printLatency(QTextStream &out) const {
+    out << qSetFieldWidth(20) << left << "command" << qSetFieldWidth(8) << right << "count" << "failed" << "lost"
+        << qSetFieldWidth(12) << "min" << "avg" << "p50" << "p99" << "max" << qSetFieldWidth(0) << endl;
+
+    QMap<QString, EspLatencyStats>::const_iterator it;
+    for(it = mStats.constBegin(); it != mStats.constEnd(); ++it) {
+        const EspLatencyStats &stats = it.value();
+        out << qSetFieldWidth(20) << left << it.key() << qSetFieldWidth(8) << right << stats.count << stats.failed << stats.lost << qSetFieldWidth(12);
+        if(stats.count) {
+            // Percentiles are bucket limits, read them as "below"
+            out << formatUs(stats.minUs) << formatUs(stats.averageUs())
+                << QString("<%1").arg(formatUs(EspTelemetrySnapshot::percentileUs(stats.histogram, 0.5)))
+                << QString("<%1").arg(formatUs(EspTelemetrySnapshot::percentileUs(stats.histogram, 0.99)))
+                << formatUs(stats.maxUs);
+        } else {
+            out << "-" << "-" << "-" << "-" << "-";
+        }
+        out << qSetFieldWidth(0) << endl;
+    }
+}
+
+QString EspTraceAnalyser::romCommandName(quint8 op) {
+    switch(op) {
+    case ESP_FLASH_BEGIN: return "FLASH_BEGIN";
+    case ESP_FLASH_DATA: return "FLASH_DATA";
+    case ESP_FLASH_END: return "FLASH_END";
+    case ESP_MEM_BEGIN: return "MEM_BEGIN";
+    case ESP_MEM_END: return "MEM_END";
+    case ESP_MEM_DATA: return "MEM_DATA";
+    case ESP_SYNC: return "SYNC";
+    case ESP_WRITE_REG: return "WRITE_REG";
+    case ESP_READ_REG: return "READ_REG";
+    // esptool stubs, seen in traces of other tools
+    case 0x10: return "FLASH_DEFL_BEGIN";
+    case 0x11: return "FLASH_DEFL_DATA";
+    case 0x12: return "FLASH_DEFL_END";
+    case 0x13: return "SPI_FLASH_MD5";
+    default: return QString("ROM_%1").arg(op, 2, 16, QChar('0'));
+    }
+}
+
+QString EspTraceAnalyser::stubCommandName(quint8 cmd) {
+    switch(cmd) {
+    case CMD_FLASH_WRITE: return "stub write";
+    case CMD_FLASH_READ: return "stub read";
+    case CMD_FLASH_DIGEST: return "stub digest";
+    case CMD_FLASH_READ_CHIP_ID: return "stub chip id";
+    case CMD_FLASH_ERASE_CHIP: return "stub erase chip";
+    case CMD_BOOT_FW: return "stub boot";
+    default: return QString("stub %1").arg(cmd);
+    }
+}
+
+QString EspTraceAnalyser::formatUs(quint64 us) {
+    if(us >= 1000000) return QString("%1 s").arg(us / 1e6, 0, 'f', 3);
+    if(us >= 1000) return QString("%1 ms").arg(us / 1e3, 0, 'f', 2);
+    return QString("%1 us").arg(us);
+}
@@ -0,0 +1,80 @@
+#ifndef ESPTRACEANALYSER_H
+#define ESPTRACEANALYSER_H
+
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QQueue>
+#include <QVector>
+#include <QTextStream>
+
+#include "esptrace.h"
+
+// Latency of one kind of command
+class EspLatencyStats {
+public:
+    EspLatencyStats();
+    void add(quint64 us);
+    qint64 averageUs() const { return count ? totalUs / count : 0; }
+public:
+    quint32 count;
+    // Completed with an error status
+    quint32 failed;
+    // Sent and never answered
+    quint32 lost;
+    quint64 totalUs;
+    quint64 minUs;
+    quint64 maxUs;
+    QVector<quint32> histogram;
+};
+
+// Decodes the frames of a trace back into ROM and stub commands, matching
+// every command with its reply. Records are fed in order and not kept, a
+// trace of any length is analysed in constant memory.
+class EspTraceAnalyser {
+public:
+    EspTraceAnalyser(quint64 gapUs=500000);
+    void setTimeline(QTextStream *out) { mTimeline = out; }
+    void add(const EspTraceRecord &record);
+    void finish();
+    void printSummary(QTextStream &out, const EspTraceReader &reader) const;
+    void printLatency(QTextStream &out) const;
+public:
+    static QString romCommandName(quint8 op);
+    static QString stubCommandName(quint8 cmd);
+    static QString formatUs(quint64 us);
+private:
+    void frameSent(const EspTraceRecord &record);
+    void frameReceived(const EspTraceRecord &record);
+    void rawSent(const EspTraceRecord &record);
+    void endStubCommand(quint64 timeUs, int status);
+    void event(quint64 timeUs, const QString &text);
+private:
+    quint64 mGapUs;
+    QTextStream *mTimeline;
+    QMap<QString, EspLatencyStats> mStats;
+    // ROM commands waiting for their reply, the ROM answers in order
+    QList< QPair<quint8, quint64> > mPendingRom;
+    // Stub command running, its arguments frame is still expected
+    quint8 mStubCommand;
+    quint64 mStubStartUs;
+    bool mStubArgs;
+    // Stub write: offsets of the data sent and when, matched by the acks
+    quint32 mRawOffset;
+    QQueue< QPair<quint32, quint64> > mWriteMarks;
+private:
+    quint64 mRecords;
+    quint64 mLastUs;
+    quint64 mFramesSent;
+    quint64 mFramesReceived;
+    quint64 mBytesSent;
+    quint64 mBytesReceived;
+    quint64 mRawBytes;
+    quint32 mUnmatched;
+    quint32 mGaps;
+    quint64 mLongestGapUs;
+    quint32 mBaudChanges;
+};
+
+#endif // ESPTRACEANALYSER_H
@@ -0,0 +1,65 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFile>
+
+#include "esptrace.h"
+#include "esptraceanalyser.h"
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("EspQtTrace");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("EspQtTrace - Decodes the protocol traces recorded by EspQtLib");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(QCommandLineOption(QStringList() << "t" << "timeline", QCoreApplication::translate("main", "Print every command and reply in time order")));
+    parser.addOption(QCommandLineOption(QStringList() << "g" << "gap", QCoreApplication::translate("main", "Report silences on the link longer than this"), "ms", QString::number(500)));
+    parser.addPositionalArgument("trace", QCoreApplication::translate("main", "Trace files to analyse"));
+    parser.process(app);
+
+    QTextStream out(stdout);
+    const QStringList files = parser.positionalArguments();
+    if(files.isEmpty()) {
+        out << QCoreApplication::translate("main", "You must provide a trace file.\n\n");
+        out << parser.helpText();
+        return 1;
+    }
+
+    int res = 0;
+    foreach(const QString &fileName, files) {
+        QFile file(fileName);
+        if(!file.open(QIODevice::ReadOnly)) {
+            out << QString("Unable to open %1\n").arg(fileName);
+            res = 1;
+            continue;
+        }
+
+        EspTraceReader reader(&file);
+        if(!reader.readHeader()) {
+            out << QString("%1: %2\n").arg(fileName).arg(reader.errorString());
+            res = 1;
+            continue;
+        }
+
+        EspTraceAnalyser analyser(parser.value("gap").toULongLong() * 1000);
+        if(parser.isSet("timeline")) analyser.setTimeline(&out);
+
+        EspTraceRecord record;
+        while(reader.next(record)) analyser.add(record);
+        analyser.finish();
+
+        // A trace cut short by a crash is still worth reading up to the cut
+        if(!reader.errorString().isEmpty()) out << QString("%1: %2\n").arg(fileName).arg(reader.errorString());
+
+        out << endl;
+        analyser.printSummary(out, reader);
+        out << endl;
+        analyser.printLatency(out);
+        out << endl;
+    }
+
+    return res;
+}